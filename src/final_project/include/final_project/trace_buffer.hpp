@@ -0,0 +1,160 @@
+#ifndef FINAL_PROJECT_TRACE_BUFFER_HPP_
+#define FINAL_PROJECT_TRACE_BUFFER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace trace
+{
+
+/// Stages traced between a part showing up in a logical camera and the robot getting its goal.
+/// The ids are part of the trace file format, new stages are added at the end.
+enum stage : uint16_t
+{
+  camera_update = 1,      ///< logical camera plugin OnUpdate
+  camera_publish = 2,     ///< logical camera image published
+  camera_callback = 3,    ///< image received by part_pose_listener
+  transform_done = 4,     ///< parts of the image transformed to the map frame
+  waypoint_resolved = 5,  ///< waypoint matched to a part of the image, arg is the waypoint
+  goal_sent = 6,          ///< goal to the waypoint sent to Nav2, arg is the waypoint
+  goal_accepted = 7,      ///< goal to the waypoint accepted by Nav2, arg is the waypoint
+};
+
+/// One trace event. commit is written last, a record whose commit does not match its position is being written or torn.
+struct record
+{
+  uint64_t time_ns;  ///< steady clock, CLOCK_MONOTONIC on Linux, comparable across processes
+  uint64_t id;       ///< id of the camera image the event belongs to, see image_id
+  uint16_t stage;
+  uint16_t reserved;
+  uint32_t arg;
+  uint64_t commit;   ///< position of the record in the trace plus one
+};
+
+/// Header of a trace file.
+struct file_header
+{
+  uint64_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t capacity;
+  std::atomic<uint64_t> head;  ///< number of records written since the file was created
+};
+
+constexpr uint64_t trace_magic = 0x3145434152544d47ull;  // "GMTRACE1"
+constexpr uint32_t trace_version = 1;
+
+/// Trace buffer in a memory mapped file, typically in /dev/shm. Writers never block and never call into the kernel: a record
+/// is a slot reserved with one atomic increment and a few stores, and the oldest records are overwritten when the buffer is
+/// full. The file stays readable after the process exits, so traces of several processes are merged offline by time and id.
+class TraceBuffer
+{
+public:
+  /// Creates or truncates the trace file.
+  /// \param[in] file Path of the trace file
+  /// \param[in] capacity Number of records kept
+  /// \throws std::runtime_error if the file cannot be created or mapped
+  TraceBuffer(const std::string & file, uint64_t capacity)
+  : size_(sizeof(file_header) + capacity * sizeof(record))
+  {
+    int fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      throw std::runtime_error("Cannot create trace file " + file);
+    }
+    void * data = MAP_FAILED;
+    if (::ftruncate(fd, static_cast<off_t>(size_)) == 0) {
+      data = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      throw std::runtime_error("Cannot map trace file " + file);
+    }
+    header_ = static_cast<file_header *>(data);
+    records_ = reinterpret_cast<record *>(static_cast<uint8_t *>(data) + sizeof(file_header));
+    header_->version = trace_version;
+    header_->record_size = sizeof(record);
+    header_->capacity = capacity;
+    header_->head.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = trace_magic;
+  }
+
+  ~TraceBuffer()
+  {
+    ::munmap(header_, size_);
+  }
+
+  TraceBuffer(const TraceBuffer &) = delete;
+  TraceBuffer & operator=(const TraceBuffer &) = delete;
+
+  /// Records an event now.
+  void emit(stage event, uint64_t id, uint32_t arg = 0) noexcept
+  {
+    emit_at(now_ns(), event, id, arg);
+  }
+
+  /// Records an event that happened at time_ns, e.g. before its id was known.
+  void emit_at(uint64_t time_ns, stage event, uint64_t id, uint32_t arg = 0) noexcept
+  {
+    uint64_t position = header_->head.fetch_add(1, std::memory_order_relaxed);
+    record & slot = records_[position % header_->capacity];
+    __atomic_store_n(&slot.commit, 0, __ATOMIC_RELAXED);
+    slot.time_ns = time_ns;
+    slot.id = id;
+    slot.stage = event;
+    slot.reserved = 0;
+    slot.arg = arg;
+    __atomic_store_n(&slot.commit, position + 1, __ATOMIC_RELEASE);
+  }
+
+  static uint64_t now_ns() noexcept
+  {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+private:
+  size_t size_;
+  file_header * header_;
+  record * records_;
+};
+
+/// Hashes bytes with FNV-1a.
+inline uint64_t hash_bytes(const void * data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) noexcept
+{
+  const uint8_t * bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+/// Id of a logical camera image (mage_msgs::msg::AdvancedLogicalCameraImage), computed from its content so that the plugin
+/// and the subscriber get the same id without a field in the message. Images of a static scene repeat their id, an event is
+/// matched with the latest event of the previous stage with the same id.
+template<typename Image>
+uint64_t image_id(const Image & image) noexcept
+{
+  auto hash_pose = [](const auto & pose, uint64_t hash) {
+      const double values[7] = {pose.position.x, pose.position.y, pose.position.z, pose.orientation.x, pose.orientation.y,
+        pose.orientation.z, pose.orientation.w};
+      return hash_bytes(values, sizeof(values), hash);
+    };
+  uint64_t hash = hash_pose(image.sensor_pose, 0xcbf29ce484222325ull);
+  for (const auto & part_pose : image.part_poses) {
+    const uint8_t codes[2] = {static_cast<uint8_t>(part_pose.part.type), static_cast<uint8_t>(part_pose.part.color)};
+    hash = hash_pose(part_pose.pose, hash_bytes(codes, sizeof(codes), hash));
+  }
+  return hash;
+}
+
+}  // namespace trace
+
+#endif  // FINAL_PROJECT_TRACE_BUFFER_HPP_
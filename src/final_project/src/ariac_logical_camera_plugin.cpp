@@ -1,4 +1,5 @@
 #include <final_project/ariac_logical_camera_plugin.hpp>
+#include <final_project/trace_buffer.hpp>
 #include <mage_msgs/msg/advanced_logical_camera_image.hpp>
 #include <mage_msgs/msg/part_pose.hpp>
 #include <gazebo/sensors/LogicalCameraSensor.hh>
@@ -6,6 +7,7 @@
 #include <gazebo_ros/conversions/geometry_msgs.hpp>
 #include <gazebo_ros/node.hpp>
 #include <gazebo_ros/utils.hpp>
+#include <cstdlib>
 #include <memory>
 #include <rclcpp/rclcpp.hpp>
 
@@ -50,6 +52,9 @@ public:
   rclcpp::Subscription<mage_msgs::msg::Sensors>::SharedPtr
       sensor_health_sub_;
 
+  /// Latency trace of the published images, null unless LOGICAL_CAMERA_TRACE_DIR is set
+  std::unique_ptr<trace::TraceBuffer> trace_;
+
   /// Publish latest logical camera data to ROS
   void OnUpdate();
 };
@@ -90,6 +95,17 @@ void AriacLogicalCameraPlugin::Load(gazebo::sensors::SensorPtr _sensor, sdf::Ele
   impl_->camera_name_ = _sdf->Get<std::string>("camera_name");
   impl_->sensor_type_ = _sdf->Get<std::string>("sensor_type");
 
+  // Trace the updates and publications of the images, one file per camera
+  const char * trace_dir = std::getenv("LOGICAL_CAMERA_TRACE_DIR");
+  if (trace_dir != nullptr && *trace_dir != '\0') {
+    try {
+      impl_->trace_ = std::make_unique<trace::TraceBuffer>(
+        std::string(trace_dir) + "/" + impl_->camera_name_ + ".trace", 1 << 16);
+    } catch (const std::exception & e) {
+      RCLCPP_WARN(impl_->ros_node_->get_logger(), "%s", e.what());
+    }
+  }
+
   // if (impl_->sensor_type_ == "basic") {
   //   impl_->basic_pub_ =
   //       impl_->ros_node_
@@ -128,6 +144,7 @@ void AriacLogicalCameraPluginPrivate::OnUpdate()
   //   return;
   // }
 
+  const uint64_t update_time = trace_ ? trace::TraceBuffer::now_ns() : 0;
   const auto & image = this->sensor_->Image();
 
   geometry_msgs::msg::Pose sensor_pose = gazebo_ros::Convert<geometry_msgs::msg::Pose>(
@@ -197,7 +214,17 @@ void AriacLogicalCameraPluginPrivate::OnUpdate()
     advanced_image_msg_->part_poses = parts;
     // advanced_image_msg_->tray_poses = trays;
 
+    uint64_t trace_id = 0;
+    if (trace_) {
+      trace_id = trace::image_id(*advanced_image_msg_);
+      trace_->emit_at(update_time, trace::camera_update, trace_id);
+    }
+
     advanced_pub_->publish(*advanced_image_msg_);
+
+    if (trace_) {
+      trace_->emit(trace::camera_publish, trace_id);
+    }
   }
 }
 
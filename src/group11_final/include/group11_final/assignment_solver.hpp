@@ -0,0 +1,54 @@
+/**
+ * @file assignment_solver.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the AssignmentSolver class. This class is used to assign the waypoints to the robots of a fleet.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief  This class solves the linear assignment problem on a rectangular cost matrix: every row (robot) gets at most one column
+ * (waypoint) and every column at most one row, with the smallest total cost. Infinite costs are forbidden pairs.
+ *
+ * The Hungarian algorithm solves the problem exactly in O(n^3) and is used when the whole fleet is assigned at once. The auction
+ * algorithm lets the rows bid for their best column until no row is outbid, its cost grows with the number of bids instead of the
+ * size of the matrix, so it is used when a few robots become idle while the others keep their goals.
+ *
+ */
+class AssignmentSolver
+{
+public:
+    /**
+     * @brief Solves the assignment exactly with the Hungarian algorithm (shortest augmenting paths with potentials).
+     *
+     * @param costs row major rows x cols matrix
+     * @param rows
+     * @param cols
+     * @return std::vector<long> column assigned to each row, -1 when the row is not assigned
+     */
+    static std::vector<long> hungarian(const std::vector<double> &costs, size_t rows, size_t cols);
+
+    /**
+     * @brief Solves the assignment with the forward auction algorithm. The total cost is within rows * epsilon of the optimum.
+     *
+     * @param costs row major rows x cols matrix
+     * @param rows
+     * @param cols
+     * @param epsilon minimum bid increment, in the unit of the costs
+     * @return std::vector<long> column assigned to each row, -1 when the row is not assigned
+     */
+    static std::vector<long> auction(const std::vector<double> &costs, size_t rows, size_t cols, double epsilon = 1e-3);
+
+    /**
+     * @brief Computes the total cost of an assignment.
+     *
+     */
+    static double assignment_cost(const std::vector<double> &costs, size_t cols, const std::vector<long> &assignment);
+};
@@ -0,0 +1,102 @@
+/**
+ * @file distance_field.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the DistanceField class. This class stores the clearance of every cell of the map and places the goals.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include "occupancy_grid.hpp"
+#include <limits>
+#include <vector>
+
+/**
+ * @brief  This class computes the exact Euclidean distance from every cell to the closest cell that is not free (the clearance), with
+ * the separable algorithm of Felzenszwalb and Huttenlocher. The column pass sweeps whole rows at a time so that the inner loops run
+ * over contiguous memory and are vectorized by the compiler, the row pass computes the lower envelope of parabolas per row.
+ * The field is used to move goals out of the obstacles to a standoff pose with enough clearance. With a clearance cap, a map update
+ * only recomputes a window around the changed cells, since a capped clearance only depends on the cells within the cap.
+ *
+ */
+class DistanceField
+{
+public:
+    /**
+     * @brief Construct a new Distance Field object
+     *
+     * @param grid
+     * @param max_clearance clearances above this value are stored as max_clearance, in meters
+     */
+    explicit DistanceField(const OccupancyGrid &grid, double max_clearance = std::numeric_limits<double>::infinity());
+
+    /**
+     * @brief Updates the clearances after cells of the grid changed. Without a clearance cap the whole field is recomputed,
+     * otherwise only the cells within the cap of the changed cells. The reachable cells are cleared.
+     *
+     * @param grid same size as the grid the field was built from
+     * @param changed cells whose state changed
+     */
+    void update(const OccupancyGrid &grid, const std::vector<map_cell> &changed);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    /**
+     * @brief Returns the clearance of a cell in meters, 0 for the cells that are not free or outside the map.
+     *
+     */
+    float clearance(int x, int y) const
+    {
+        return x >= 0 && y >= 0 && x < width_ && y < height_ ? clearance_[static_cast<size_t>(y) * width_ + x] : 0.0f;
+    }
+
+    /**
+     * @brief Marks the cells with at least min_clearance that are connected to start through cells with at least min_clearance.
+     * When start itself is too close to an obstacle the closest cell with enough clearance is used.
+     *
+     * @param start
+     * @param min_clearance in meters
+     * @return true if a start cell with enough clearance was found
+     */
+    bool compute_reachable(const map_cell &start, double min_clearance);
+
+    /**
+     * @brief Returns true if the reachable cells have been computed.
+     *
+     */
+    bool has_reachable() const { return !reachable_.empty(); }
+
+    /**
+     * @brief Finds the standoff cell for a target: the cell closest to the target with at least min_clearance that is reachable
+     * (when the reachable cells have been computed).
+     *
+     * @param target
+     * @param min_clearance in meters
+     * @param max_radius search radius around the target in meters
+     * @param goal
+     * @return true if a cell was found
+     */
+    bool standoff(const map_cell &target, double min_clearance, double max_radius, map_cell &goal) const;
+
+private:
+    /**
+     * @brief Computes the clearances of the cells in [x0, x1] x [y0, y1] from the cells in the window grown by margin cells. Outside
+     * the window the cells count as free, the map border counts as blocked.
+     *
+     */
+    void compute(const OccupancyGrid &grid, int x0, int y0, int x1, int y1, int margin);
+
+    int width_;
+    int height_;
+    double resolution_;
+    // Clearance cap, rounded up to a float so that the capped cells pass a check against the cap
+    float max_clearance_;
+    // Clearance cap in cells
+    int radius_;
+    std::vector<float> clearance_;
+    std::vector<uint8_t> reachable_;
+};
@@ -0,0 +1,202 @@
+/**
+ * @file distance_matrix.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the DistanceMatrix class. This class computes the travel cost on the map between waypoints.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include "occupancy_grid.hpp"
+#include "route_cache.hpp"
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief  This class computes the shortest path length on the free cells of an OccupancyGrid between all pairs of a set of cells.
+ * One Dial (bucketed Dijkstra) search with 8-connected moves runs per source cell, the searches run in parallel on a pool of threads
+ * started with the object and stop as soon as all the targets are settled. Cells inside obstacles (parts on pallets or in bins) are first snapped to the
+ * nearest free cell and the snap distance is added to the cost.
+ *
+ * Along with the cost, each path is walked back from its target to recover its turning points and the direction in which it arrives
+ * at the target. Since the moves are symmetric, the direction in which the path from i to j leaves i is the arrival direction of the
+ * path from j to i turned by pi. The results are kept in a RouteCache keyed by the pair of cells and the version of the map.
+ *
+ * Cells can also be tracked: their complete distance fields are kept, and when some cells of the map change the fields are repaired
+ * in place like LPA* / D* Lite instead of searched again. Only the cells whose shortest path went through a blocked cell are reset
+ * and searched from their remaining neighbours, and the cells around a freed cell are relaxed, so the work is proportional to the
+ * area affected by the change. The routes between the tracked cells are then put in the cache for the new version of the map.
+ *
+ */
+class DistanceMatrix
+{
+public:
+    /**
+     * @brief Construct a new Distance Matrix object
+     *
+     * @param grid map to search on
+     * @param threads number of worker threads, 0 uses the hardware concurrency
+     * @param snap_radius maximum distance in cells from a cell to the free cell it is snapped to
+     * @param cache route cache, possibly shared or persistent, null for a cache of 4096 routes in memory
+     */
+    DistanceMatrix(std::shared_ptr<const OccupancyGrid> grid, size_t threads = 0, int snap_radius = 20,
+                   std::shared_ptr<RouteCache> cache = nullptr);
+
+    /**
+     * @brief Stops the worker threads.
+     *
+     */
+    ~DistanceMatrix();
+    DistanceMatrix(const DistanceMatrix &) = delete;
+    DistanceMatrix &operator=(const DistanceMatrix &) = delete;
+
+    /**
+     * @brief Computes the travel cost between all pairs of cells. Pairs already computed are taken from the cache.
+     *
+     * @param cells
+     * @param arrivals if not null, filled with the row major matrix of the headings (radians, map frame) in which the path from i
+     * arrives at j, NaN when there is no path
+     * @return std::vector<double> row major cells.size() x cells.size() matrix in meters, infinity when there is no path
+     */
+    std::vector<double> compute(const std::vector<map_cell> &cells, std::vector<double> *arrivals = nullptr);
+
+    /**
+     * @brief Reads the map again, to be called when the map changes. The cached routes of the previous version of the map are no
+     * longer used.
+     *
+     */
+    void clear();
+
+    /**
+     * @brief Keeps the complete distance fields of the cells, so that their routes are repaired instead of searched again when the
+     * map changes (see update), and puts the routes between all the tracked cells in the cache. The cells tracked the longest ago
+     * are dropped when the fields would use more than 64 MB.
+     *
+     * @param cells
+     */
+    void track(const std::vector<map_cell> &cells);
+
+    /**
+     * @brief Applies a change of some cells of the map, already changed in the grid, and repairs the distance fields and the
+     * routes of the tracked cells.
+     *
+     * @param changed cells whose state may have changed
+     * @return size_t number of routes between tracked cells whose length changed
+     */
+    size_t update(const std::vector<map_cell> &changed);
+
+    size_t tracked_count() const { return tracked_.size(); }
+
+    const OccupancyGrid &grid() const { return *grid_; }
+    RouteCache &cache() { return *cache_; }
+
+private:
+    /**
+     * @brief  struct to store a cell snapped to the free space
+     *
+     */
+    struct snapped_cell
+    {
+        size_t index;   // index of the free cell in passable_, npos when no free cell was found
+        double offset;  // distance from the original cell to the free cell in meters
+    };
+
+    /**
+     * @brief  struct to store a tracked cell and its distance field
+     *
+     */
+    struct tracked_cell
+    {
+        map_cell cell;
+        snapped_cell snapped;
+        std::vector<uint32_t> distances;  // empty until searched, in cost units (10 per cell)
+    };
+
+    /**
+     * @brief Snaps a cell to the nearest free cell.
+     *
+     */
+    snapped_cell snap(const map_cell &cell) const;
+
+    /**
+     * @brief Runs one search from a source and writes the routes to every target. A complete search does not stop at the targets
+     * and leaves the exact distance of every cell.
+     *
+     */
+    void search(const snapped_cell &source, const std::vector<snapped_cell> &targets, std::vector<uint32_t> &distances,
+                std::vector<uint32_t> &target_stamps, uint32_t stamp, RouteCache::route *routes, bool complete = false) const;
+
+    /**
+     * @brief Repairs a complete distance field after the cells blocked and freed have changed in passable_. First the cells that
+     * lost the neighbour their shortest path came from are reset, then the reset cells and the cells around the freed cells are
+     * searched again from their neighbours with a Dijkstra search that stops when no distance decreases any more.
+     *
+     * @return true if a distance changed
+     */
+    bool repair(size_t source, const std::vector<size_t> &blocked, const std::vector<size_t> &freed,
+                std::vector<uint32_t> &distances) const;
+
+    /**
+     * @brief Fills the route from a source to a target from the distance field of the source, infinitely long when the target was
+     * not reached.
+     *
+     */
+    void write_route(const snapped_cell &source, const std::vector<uint32_t> &distances, const snapped_cell &target,
+                     RouteCache::route &route) const;
+
+    /**
+     * @brief Runs a worker on the calling thread and on thread_count - 1 threads of the pool, and waits for all of them.
+     *
+     */
+    void run_workers(size_t thread_count, const std::function<void()> &worker) const;
+
+    /**
+     * @brief Loop of a thread of the pool, runs its share of each job until the object is destroyed.
+     *
+     */
+    void pool_thread() const;
+
+    /**
+     * @brief Walks the shortest path back from a target to the source, fills the waypoints of the route (source, turning points
+     * and target) and its arrival heading, NaN at the source.
+     *
+     */
+    void trace(const std::vector<uint32_t> &distances, size_t target, RouteCache::route &route) const;
+
+    size_t cell_index(const map_cell &cell) const { return static_cast<size_t>(cell.y) * grid_->width() + cell.x; }
+    size_t padded_index(const map_cell &cell) const { return static_cast<size_t>(cell.y + 1) * stride_ + cell.x + 1; }
+    map_cell padded_cell(size_t index) const
+    {
+        return map_cell{static_cast<int>(index % stride_) - 1, static_cast<int>(index / stride_) - 1};
+    }
+
+    std::shared_ptr<const OccupancyGrid> grid_;
+    // Free cells of the grid with a border of blocked cells, so that the search needs no bounds checks
+    std::vector<uint8_t> passable_;
+    size_t stride_;
+    size_t threads_;
+    int snap_radius_;
+    uint64_t map_hash_;
+    std::shared_ptr<RouteCache> cache_;
+    // Tracked cells, the most recently tracked last
+    std::vector<tracked_cell> tracked_;
+    size_t tracked_limit_;
+
+    // Pool of threads_ - 1 threads, waiting for the jobs of run_workers
+    std::vector<std::thread> pool_;
+    mutable std::mutex pool_mutex_;
+    mutable std::condition_variable job_ready_;
+    mutable std::condition_variable job_done_;
+    mutable const std::function<void()> *job_ = nullptr;
+    mutable uint64_t job_generation_ = 0;
+    mutable size_t job_slots_ = 0;    // pool threads still to start the current job
+    mutable size_t job_running_ = 0;  // pool threads that have not finished the current job
+    bool stopping_ = false;
+};
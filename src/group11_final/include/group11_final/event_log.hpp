@@ -0,0 +1,117 @@
+/**
+ * @file event_log.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the EventLog class. This class takes the frequent log messages off the callback thread.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief  struct to store a log event, the meaning of the fields depends on the event
+ *
+ */
+struct log_record
+{
+    uint16_t event;
+    uint8_t codes[2];  // enums, e.g. the type and color of a part
+    uint32_t index;
+    double values[3];  // e.g. a position
+};
+
+/**
+ * @brief  This class is an asynchronous log. The callback thread pushes fixed size binary records into a lock-free ring buffer,
+ * which costs a copy and two atomic operations, and a background thread formats the records and passes the lines to a sink.
+ *
+ * Each event has a rate limit applied by the background thread: records above the limit are counted and reported once a second
+ * instead of being formatted. When the ring buffer is full the records are dropped and reported the same way, the callback thread
+ * never waits for the log. The ring buffer has a single producer, records must be pushed from one thread.
+ *
+ */
+class EventLog
+{
+public:
+    using formatter = std::function<std::string(const log_record &)>;
+    using sink = std::function<void(const std::string &)>;
+
+    /**
+     * @brief Construct a new Event Log object, the thread starts with start()
+     *
+     * @param capacity number of records in the ring buffer, rounded up to a power of two
+     * @param output receives the formatted lines on the background thread
+     */
+    EventLog(size_t capacity, sink output);
+    ~EventLog();
+    EventLog(const EventLog &) = delete;
+    EventLog &operator=(const EventLog &) = delete;
+
+    /**
+     * @brief Registers an event. Must be called before start().
+     *
+     * @param event id of the event, small integers
+     * @param name used in the reports of suppressed records
+     * @param max_rate records per second formatted at most, 0 for no limit
+     * @param format
+     */
+    void register_event(uint16_t event, const std::string &name, double max_rate, formatter format);
+
+    /**
+     * @brief Starts the background thread. Records pushed before are formatted once it runs.
+     *
+     */
+    void start();
+
+    /**
+     * @brief Pushes a record without waiting.
+     *
+     * @return false when the ring buffer is full and the record was dropped
+     */
+    bool push(const log_record &record);
+
+    /**
+     * @brief Returns the number of records dropped because the ring buffer was full.
+     *
+     */
+    size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    /**
+     * @brief  struct to store a registered event and its rate limit
+     *
+     */
+    struct event_info
+    {
+        std::string name;
+        formatter format;
+        double max_rate = 0.0;
+        double tokens = 0.0;
+        std::chrono::steady_clock::time_point refilled;
+        size_t suppressed = 0;
+    };
+
+    void run();
+    void drain();
+    void report();
+
+    std::vector<log_record> ring_;
+    size_t mask_;
+    std::atomic<size_t> head_;  // next record to write, only written by the producer
+    std::atomic<size_t> tail_;  // next record to read, only written by the background thread
+    std::atomic<size_t> dropped_;
+    size_t dropped_reported_;
+    std::vector<event_info> events_;
+    sink output_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
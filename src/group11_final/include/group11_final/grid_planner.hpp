@@ -0,0 +1,156 @@
+/**
+ * @file grid_planner.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the GridPlanner class. This class plans shortest paths on the map with A* and Jump Point Search.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include "occupancy_grid.hpp"
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief  This class plans single shortest paths on the free cells of an OccupancyGrid, with the same 8-connected moves as the
+ * DistanceMatrix (diagonal moves may not cut the corner of an obstacle).
+ *
+ * Two planners are available: a plain A* search and JPS+, Jump Point Search with a preprocessed jump table. For each free cell and
+ * each of the 8 directions the table stores the number of steps to the next jump point (positive) or to the wall (negative or 0),
+ * so the search only expands the jump points and jumps over the cells between them in constant time. Both planners return the same
+ * path length. The search buffers are reused between queries, so one planner must not be used by several threads at the same time.
+ *
+ */
+class GridPlanner
+{
+public:
+    /**
+     * @brief  struct to store the result of a query
+     *
+     */
+    struct result
+    {
+        bool found = false;
+        double length = std::numeric_limits<double>::infinity();  // path length in meters
+        size_t expansions = 0;                                    // number of nodes taken from the open list
+        std::vector<map_cell> path;                               // every cell of the path from start to goal
+    };
+
+    /**
+     * @brief Construct a new Grid Planner object and builds the jump table.
+     *
+     * @param grid map to plan on
+     */
+    explicit GridPlanner(std::shared_ptr<const OccupancyGrid> grid);
+
+    /**
+     * @brief Rebuilds the jump table, to be called when the map changes.
+     *
+     */
+    void rebuild();
+
+    /**
+     * @brief Updates the jump table after the cells in [x0, x1] x [y0, y1] changed. Only the rows and columns crossing the box are
+     * recomputed, plus the cells before them that jumped through a changed entry.
+     *
+     * @param x0
+     * @param y0
+     * @param x1
+     * @param y1
+     */
+    void update(int x0, int y0, int x1, int y1);
+
+    /**
+     * @brief Plans a path with A*.
+     *
+     * @param start
+     * @param goal
+     * @return result not found when start or goal is not free or there is no path
+     */
+    result astar(const map_cell &start, const map_cell &goal);
+
+    /**
+     * @brief Plans a path with JPS+.
+     *
+     * @param start
+     * @param goal
+     * @return result not found when start or goal is not free or there is no path
+     */
+    result jps(const map_cell &start, const map_cell &goal);
+
+    /**
+     * @brief Returns the memory used by the jump table in bytes.
+     *
+     */
+    size_t jump_table_size() const { return jump_.size() * sizeof(jump_[0]); }
+
+    const OccupancyGrid &grid() const { return *grid_; }
+
+private:
+    /**
+     * @brief  struct to store an entry of the open list
+     *
+     */
+    struct open_entry
+    {
+        double f;
+        size_t index;
+
+        bool operator>(const open_entry &other) const { return f > other.f; }
+    };
+
+    /**
+     * @brief Computes the jump table entry of a cell for a direction from its neighbours and the entries of the next cell.
+     *
+     */
+    int16_t jump_entry(size_t index, int direction) const;
+
+    /**
+     * @brief Starts a new query: checks the cells and clears the search buffers.
+     *
+     * @return true if start and goal are free
+     */
+    bool begin_query(const map_cell &start, const map_cell &goal, result &query);
+
+    /**
+     * @brief Sets the cost, parent and arrival direction of a cell if the new cost is lower and pushes it on the open list.
+     *
+     */
+    void relax(size_t index, size_t parent, int direction, double cost, size_t goal);
+
+    /**
+     * @brief Octile distance from a cell to the goal in cells.
+     *
+     */
+    double heuristic(size_t index, size_t goal) const;
+
+    /**
+     * @brief Fills the path of a query by walking the parents back from the goal, with every cell between two jump points.
+     *
+     */
+    void build_path(size_t start, size_t goal, result &query) const;
+
+    size_t padded_index(const map_cell &cell) const { return static_cast<size_t>(cell.y + 1) * stride_ + cell.x + 1; }
+
+    std::shared_ptr<const OccupancyGrid> grid_;
+    // Free cells of the grid with a border of blocked cells, so that the searches need no bounds checks
+    std::vector<uint8_t> passable_;
+    size_t stride_;
+    std::array<long, 8> offsets_;
+    std::vector<std::array<int16_t, 8>> jump_;
+
+    // Search buffers, a cell belongs to the current query when its stamp matches
+    std::vector<uint32_t> stamps_;
+    std::vector<double> costs_;
+    std::vector<size_t> parents_;
+    std::vector<int8_t> directions_;
+    std::vector<uint8_t> closed_;
+    std::vector<open_entry> open_;
+    uint32_t stamp_;
+};
@@ -0,0 +1,210 @@
+/**
+ * @file hierarchical_planner.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the HierarchicalPlanner class. This class computes route costs on large maps with HPA*.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include "occupancy_grid.hpp"
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief  This class implements HPA* (hierarchical path-finding A*) on an OccupancyGrid, with the same 8-connected moves as the
+ * GridPlanner.
+ *
+ * The map is split in square clusters. Along the border of two clusters each run of free cells facing free cells is an entrance,
+ * with one transition in its middle (or one at each end when it is long). The transitions are the nodes of an abstract graph, whose
+ * edges are the steps across the borders and the shortest paths inside a cluster between its nodes. A query connects the start and
+ * the goal to the nodes of their clusters and runs A* on the abstract graph, the cell path is only refined when it is asked for.
+ * The routes are typically 4 to 10 % longer than the shortest path.
+ *
+ * When a region of the map changes only the entrances around it and the edges of the clusters it touches are rebuilt. The search
+ * buffers are reused between queries, so one planner must not be used by several threads at the same time.
+ *
+ */
+class HierarchicalPlanner
+{
+public:
+    /**
+     * @brief  struct to store the result of a query
+     *
+     */
+    struct result
+    {
+        bool found = false;
+        double length = std::numeric_limits<double>::infinity();  // route length in meters
+        size_t expansions = 0;                                    // number of abstract nodes taken from the open list
+        std::vector<map_cell> path;                               // every cell of the route, only filled when refined
+    };
+
+    /**
+     * @brief Construct a new Hierarchical Planner object and builds the abstract graph.
+     *
+     * @param grid map to plan on
+     * @param cluster_size side of the clusters in cells
+     */
+    explicit HierarchicalPlanner(std::shared_ptr<const OccupancyGrid> grid, int cluster_size = OccupancyGrid::tile_width);
+
+    /**
+     * @brief Rebuilds the part of the abstract graph affected by a change of the cells of a rectangle of the map.
+     *
+     * @param x0
+     * @param y0
+     * @param x1
+     * @param y1
+     * @return true if an entrance or an edge between the entrances of a cluster changed
+     */
+    bool update(int x0, int y0, int x1, int y1);
+
+    /**
+     * @brief Computes the route between two cells on the abstract graph.
+     *
+     * @param start
+     * @param goal
+     * @param refine fill the cell path of the route
+     * @return result not found when start or goal is not free or there is no route
+     */
+    result route(const map_cell &start, const map_cell &goal, bool refine = false);
+
+    /**
+     * @brief Returns the number of nodes of the abstract graph.
+     *
+     */
+    size_t node_count() const { return nodes_.size() - free_nodes_.size(); }
+
+    const OccupancyGrid &grid() const { return *grid_; }
+
+    /**
+     * @brief Returns the cluster of a cell. The routes from and to a cell are searched in its cluster up to the entrances.
+     *
+     */
+    size_t cluster_of(const map_cell &cell) const
+    {
+        return static_cast<size_t>(cell.y / cluster_size_) * clusters_x_ + static_cast<size_t>(cell.x / cluster_size_);
+    }
+
+private:
+    /**
+     * @brief  struct to store an edge of the abstract graph
+     *
+     */
+    struct abstract_edge
+    {
+        size_t target;
+        double cost;  // in cells
+    };
+
+    /**
+     * @brief  struct to store a node of the abstract graph, a transition cell on the border of a cluster
+     *
+     */
+    struct abstract_node
+    {
+        map_cell cell;
+        size_t cluster;
+        size_t references = 0;  // number of transitions placed on this cell, the node is removed at 0
+        std::vector<abstract_edge> edges;
+    };
+
+    /**
+     * @brief  struct to store an entry of an open list
+     *
+     */
+    struct open_entry
+    {
+        double f;
+        size_t index;
+
+        bool operator>(const open_entry &other) const { return f > other.f; }
+    };
+
+    /**
+     * @brief Removes and places again the transitions of a border. Border 2 * c is the east border of cluster c, 2 * c + 1 the north.
+     *
+     */
+    void build_border(size_t border);
+
+    /**
+     * @brief Recomputes the edges between the nodes of a cluster.
+     *
+     */
+    void build_cluster(size_t cluster);
+
+    /**
+     * @brief Returns the node on a cell, created if needed, with one more reference.
+     *
+     */
+    size_t acquire_node(const map_cell &cell);
+
+    /**
+     * @brief Drops one reference to a node and removes it with its edges when it is no longer used.
+     *
+     */
+    void release_node(size_t node);
+
+    /**
+     * @brief Runs Dijkstra from a cell inside its cluster until the nodes of the cluster and the extra cell (if in the cluster) are
+     * settled.
+     * The costs in cells and the parents are left in the cluster buffers.
+     *
+     */
+    void search_cluster(size_t cluster, const map_cell &source, const map_cell *extra = nullptr);
+
+    /**
+     * @brief Returns the cost in cells of a cell of the cluster after search_cluster, infinity when it was not reached.
+     *
+     */
+    double cluster_cost(const map_cell &cell) const;
+
+    /**
+     * @brief Appends the cells of the path found by search_cluster from its source to a cell, the source excluded.
+     *
+     */
+    void append_cluster_path(const map_cell &cell, std::vector<map_cell> &path) const;
+
+    size_t cell_index(const map_cell &cell) const { return static_cast<size_t>(cell.y) * grid_->width() + cell.x; }
+    int local_index(const map_cell &cell) const
+    {
+        return (cell.y - cluster_origin_.y + 1) * (cluster_width_ + 2) + cell.x - cluster_origin_.x + 1;
+    }
+
+    std::shared_ptr<const OccupancyGrid> grid_;
+    int cluster_size_;
+    size_t clusters_x_;
+    size_t clusters_y_;
+
+    std::vector<abstract_node> nodes_;
+    std::vector<size_t> free_nodes_;
+    std::vector<std::vector<size_t>> cluster_nodes_;
+    std::vector<std::vector<std::pair<size_t, size_t>>> border_transitions_;
+    std::unordered_map<size_t, size_t> node_at_;
+
+    // Cluster search buffers, indexed by the cell inside the cluster with a border of blocked cells. The free cells are kept until
+    // another cluster is searched.
+    size_t loaded_cluster_;
+    map_cell cluster_origin_;
+    int cluster_width_;
+    int cluster_height_;
+    std::vector<uint8_t> cluster_free_;
+    std::vector<double> cluster_costs_;
+    std::vector<int> cluster_parents_;
+    std::vector<uint32_t> cluster_targets_;
+    uint32_t cluster_stamp_;
+    std::vector<open_entry> cluster_open_;
+
+    // Abstract search buffers, the start and the goal are the two nodes after the graph nodes
+    std::vector<uint32_t> stamps_;
+    std::vector<double> costs_;
+    std::vector<size_t> parents_;
+    std::vector<uint8_t> closed_;
+    std::vector<open_entry> open_;
+    uint32_t stamp_;
+};
@@ -0,0 +1,190 @@
+/**
+ * @file mission_core.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the ROS independent logic of the PartPoseListener node: part classification, pose transforms, matching
+ * of the detected parts with the waypoints and queueing of the missions. The node converts its messages to these types.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+#include "mission_table.hpp"
+
+/**
+ * @brief  struct to store a position
+ *
+ */
+struct point3
+{
+    double x = 0.0;
+    double y = 0.0;
+    double z = 0.0;
+};
+
+/**
+ * @brief  struct to store an orientation as a unit quaternion
+ *
+ */
+struct quaternion
+{
+    double x = 0.0;
+    double y = 0.0;
+    double z = 0.0;
+    double w = 1.0;
+};
+
+/**
+ * @brief  struct to store a pose
+ *
+ */
+struct pose3
+{
+    point3 position;
+    quaternion orientation;
+};
+
+/**
+ * @brief  struct to store a rigid transform, e.g. from a camera frame to the map frame
+ *
+ */
+struct rigid_transform
+{
+    point3 translation;
+    quaternion rotation;
+};
+
+/**
+ * @brief  struct to store a detected part bound to a waypoint
+ *
+ */
+struct part_match
+{
+    size_t part;
+    size_t waypoint;
+};
+
+/**
+ * @brief  struct to store a marker seen for the first time and its mission
+ *
+ */
+struct marker_mission
+{
+    size_t index;  // position of the marker in the list of markers in view
+    long marker_id;
+    mission steps;
+};
+
+// Part codes of the logical camera messages (mage_msgs/msg/Part)
+namespace part_codes
+{
+    constexpr int red = 0;
+    constexpr int green = 1;
+    constexpr int blue = 2;
+    constexpr int orange = 3;
+    constexpr int purple = 4;
+    constexpr int battery = 10;
+    constexpr int pump = 11;
+    constexpr int sensor = 12;
+    constexpr int regulator = 13;
+}
+
+// Number of different parts, types times colors
+constexpr size_t part_key_count = 4 * 5;
+
+/**
+ * @brief Returns the index of a part in [0, part_key_count).
+ *
+ */
+inline size_t part_key_index(part_type type, part_color color)
+{
+    return static_cast<size_t>(type) * 5 + static_cast<size_t>(color);
+}
+
+/**
+ * @brief Converts the color and type codes of a logical camera message.
+ *
+ * @param color_code
+ * @param type_code
+ * @param color
+ * @param type
+ * @return true if both codes are known
+ */
+bool classify_part(int color_code, int type_code, part_color &color, part_type &type);
+
+/**
+ * @brief Applies a rigid transform to a pose, the same as tf2::doTransform.
+ *
+ */
+pose3 transform_pose(const rigid_transform &transform, const pose3 &pose);
+
+/**
+ * @brief Binds every part to the first open waypoint of the same type and color, in the order of the parts: a part takes the
+ * first waypoint from first without a pose, the next part of the same type and color the next one. The open waypoints are
+ * bucketed by part first, so this is O(parts + waypoints) instead of a scan of the waypoints for every part.
+ *
+ * @tparam Part has type and color members
+ * @tparam Waypoint has type, color and pose_assigned members
+ * @param parts
+ * @param waypoints
+ * @param first first waypoint that can be bound
+ * @return std::vector<part_match> the bindings, in the order of the parts
+ */
+template <typename Part, typename Waypoint>
+std::vector<part_match> match_parts(const std::vector<Part> &parts, const std::vector<Waypoint> &waypoints, size_t first = 0)
+{
+    // Counting sort of the open waypoints by part, keeping their order
+    std::array<size_t, part_key_count + 1> offsets{};
+    for (size_t i = first; i < waypoints.size(); ++i)
+    {
+        if (!waypoints[i].pose_assigned)
+        {
+            offsets[part_key_index(waypoints[i].type, waypoints[i].color) + 1]++;
+        }
+    }
+    for (size_t key = 0; key < part_key_count; ++key)
+    {
+        offsets[key + 1] += offsets[key];
+    }
+    std::vector<size_t> open(offsets[part_key_count]);
+    std::array<size_t, part_key_count + 1> next = offsets;
+    for (size_t i = first; i < waypoints.size(); ++i)
+    {
+        if (!waypoints[i].pose_assigned)
+        {
+            open[next[part_key_index(waypoints[i].type, waypoints[i].color)]++] = i;
+        }
+    }
+
+    std::vector<part_match> matches;
+    next = offsets;
+    for (size_t part = 0; part < parts.size(); ++part)
+    {
+        size_t key = part_key_index(parts[part].type, parts[part].color);
+        if (next[key] < offsets[key + 1])
+        {
+            matches.push_back(part_match{part, open[next[key]++]});
+        }
+    }
+    return matches;
+}
+
+/**
+ * @brief Returns the missions to queue for the markers in view: the markers seen for the first time that have a mission, in the
+ * order of the list. Every marker is added to seen, so a marker is queued once.
+ *
+ * @param marker_ids markers in view
+ * @param missions
+ * @param seen markers already seen, updated
+ * @param unknown receives the markers seen for the first time without a mission
+ * @return std::vector<marker_mission>
+ */
+std::vector<marker_mission> new_marker_missions(const std::vector<int64_t> &marker_ids, const MissionTable &missions,
+                                                std::unordered_set<long> &seen, std::vector<long> &unknown);
@@ -0,0 +1,127 @@
+/**
+ * @file mission_metrics.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the MissionMetrics class. This class measures the time spent in each stage of a mission.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief  struct to store the timing of the goal of one waypoint, times in seconds, NaN when the stage was not reached
+ *
+ */
+struct waypoint_metrics
+{
+    long marker_id;
+    size_t waypoint;
+    double dispatch_to_accept;
+    double accept_to_succeed;
+};
+
+/**
+ * @brief  struct to store the metrics of a mission, times in seconds from the start of the node, NaN when not reached yet
+ *
+ */
+struct mission_metrics
+{
+    long marker_id = -1;
+    double first_detection = 0.0;  // time to the first detected part
+    double all_detected = 0.0;     // time to all the parts of the first mission
+    double duration = 0.0;         // from the start of the mission to its last waypoint
+    double distance = 0.0;         // travelled during the mission, by all the robots, in meters
+    size_t waypoints_reached = 0;
+    size_t aborts = 0;
+    double mean_dispatch_to_accept = 0.0;
+    double mean_accept_to_succeed = 0.0;
+};
+
+/**
+ * @brief  This class collects the metrics of the missions from the events of the node: detections, goals sent, accepted, reached
+ * and aborted, and odometry. The node passes the times, so the class works with simulated time and does not depend on ROS.
+ *
+ * The metrics can be written as CSV: one waypoint row per reached waypoint and one mission row per finished mission, with the
+ * same columns.
+ *
+ */
+class MissionMetrics
+{
+public:
+    /**
+     * @brief Construct a new Mission Metrics object
+     *
+     * @param start_time time the node started, the origin of the detection times
+     */
+    explicit MissionMetrics(double start_time = 0.0);
+
+    void part_detected(double time);
+    void all_parts_detected(double time);
+    void mission_started(long marker_id, double time);
+    void goal_dispatched(size_t waypoint, double time);
+    void goal_accepted(size_t waypoint, double time);
+
+    /**
+     * @brief Records a reached waypoint.
+     *
+     * @return waypoint_metrics the timing of its goal
+     */
+    waypoint_metrics goal_succeeded(size_t waypoint, double time);
+    void goal_aborted(size_t waypoint);
+
+    /**
+     * @brief Adds the distance from the last odometry position of a robot.
+     *
+     */
+    void odometry(size_t robot, double x, double y);
+
+    /**
+     * @brief Returns the metrics of the current mission, up to time.
+     *
+     */
+    mission_metrics current(double time) const;
+
+    /**
+     * @brief Returns the metrics of the current mission, which ended at time.
+     *
+     */
+    mission_metrics mission_finished(double time);
+
+    static std::string csv_header();
+    static std::string csv_row(const waypoint_metrics &metrics);
+    static std::string csv_row(const mission_metrics &metrics);
+
+private:
+    /**
+     * @brief  struct to store the times of a goal in flight
+     *
+     */
+    struct goal_times
+    {
+        double dispatched;
+        double accepted;
+    };
+
+    double start_time_;
+    double first_detection_;
+    double all_detected_;
+    long marker_id_;
+    double mission_start_;
+    double distance_;
+    size_t waypoints_reached_;
+    size_t aborts_;
+    double dispatch_to_accept_sum_;
+    size_t accepted_count_;
+    double accept_to_succeed_sum_;
+    size_t timed_count_;  // reached waypoints with an accepted goal
+    std::unordered_map<size_t, goal_times> goals_;
+    std::vector<std::pair<double, double>> positions_;  // last odometry position of each robot
+    std::vector<bool> position_known_;
+};
@@ -0,0 +1,485 @@
+/**
+ * @file mission_sequencer.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the MissionSequencer class. This class sequences the missions of the PartPoseListener node and
+ * dispatches the goals of its waypoints to the robot or the fleet, without ROS.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+#include "mission_core.hpp"
+#include "mission_table.hpp"
+
+/**
+ * @brief  This class holds the current mission (its waypoints, the part bound to each of them and the progress) and the queue of
+ * the next missions, and decides which goals to send. It is event driven: the node forwards every event that can make a goal
+ * actionable (waypoint resolved, goal response, feedback or result, backoff elapsed, robot pose) and the sequencer calls back the
+ * node through its hooks to send the goals, cancel them, arm the retry timers and report the progress.
+ *
+ * With a single robot the waypoints are visited in order, one NavigateToPose goal each or, in through_poses mode, all the remaining
+ * waypoints in one goal once they are resolved. With a fleet the open waypoints are assigned to the idle robots over the travel
+ * costs from their positions. Every goal gets a sequence number, the responses and results of replaced goals are ignored. A failed
+ * goal is sent again after a backoff up to retry_limit times, then its waypoint is skipped.
+ *
+ * The hooks are called from the calling thread, and may call the sequencer again. A hook that is not set is skipped.
+ *
+ */
+class MissionSequencer
+{
+public:
+    // Waypoint index of the parts that are not bound to a waypoint
+    static constexpr size_t no_waypoint = std::numeric_limits<size_t>::max();
+    // Open waypoints offered to each idle robot of the fleet in one assignment
+    static constexpr size_t fleet_lookahead = 4;
+
+    /**
+     * @brief  states of the goal dispatcher
+     *
+     */
+    enum class goal_state
+    {
+        idle,     // no goal in flight, the next resolved waypoint can be sent
+        sending,  // goal sent, waiting for the server to accept it
+        active,   // goal accepted, waiting for the result
+        retrying  // goal failed, waiting for the backoff before sending it again
+    };
+
+    /**
+     * @brief  navigation modes
+     *
+     */
+    enum class navigation_mode
+    {
+        sequential,   // one NavigateToPose goal per waypoint
+        through_poses // one NavigateThroughPoses goal for all the resolved waypoints
+    };
+
+    /**
+     * @brief  results of a goal
+     *
+     */
+    enum class goal_result
+    {
+        succeeded,
+        aborted,
+        canceled,
+        unknown
+    };
+
+    /**
+     * @brief  levels of the log messages
+     *
+     */
+    enum class log_level
+    {
+        info,
+        warn,
+        error
+    };
+
+    /**
+     * @brief  struct to store the waypoints
+     *
+     */
+    struct waypoint
+    {
+        part_type type;
+        part_color color;
+        pose3 pose;
+        bool pose_assigned = false;
+        bool reached = false;  // fleet mode only, also set when the waypoint is skipped
+        long robot = -1;       // robot driving to the waypoint in fleet mode
+        int failures = 0;      // failed goals to the waypoint in fleet mode
+        uint64_t trace_id = 0; // camera image the pose was resolved from, when tracing
+    };
+
+    /**
+     * @brief  struct to store a mission waiting in the queue
+     *
+     */
+    struct queued_mission
+    {
+        long marker_id = -1;
+        pose3 marker_pose;  // in the frame of the aruco camera
+        std::vector<waypoint> waypoints;
+        bool planned = false;  // all waypoints resolved and their routes planned ahead
+    };
+
+    /**
+     * @brief  struct to store the dispatch state of a robot of the fleet
+     *
+     */
+    struct robot_state
+    {
+        std::string name;  // namespace of the robot
+        pose3 pose;        // last odometry pose
+        bool pose_known = false;
+        goal_state state = goal_state::idle;
+        size_t sequence = 0;
+        long waypoint = -1;          // waypoint the robot is driving to
+        std::vector<size_t> failed;  // waypoints the robot could not reach, not assigned to it again
+    };
+
+    /**
+     * @brief  struct to store the options of the sequencer
+     *
+     */
+    struct options
+    {
+        navigation_mode mode = navigation_mode::sequential;
+        double handoff_radius = 0.0;      // the next goal preempts the current one within this distance, 0 disables it
+        bool optimize_order = false;      // visit the waypoints in the order of the shortest path instead of the mission order
+        bool fixed_last_waypoint = false; // keep the last waypoint last when the order is optimized
+        bool approach_heading = true;     // orient the goals along the paths instead of the straight lines
+        int retry_limit = 3;              // retries of a failed goal before its waypoint is skipped
+        double retry_delay = 2.0;         // backoff before the first retry in seconds, doubled on every retry
+        std::vector<std::string> robots;  // namespaces of the robots of the fleet, empty for a single robot
+    };
+
+    /**
+     * @brief  struct to store the hooks to the node
+     *
+     */
+    struct hooks
+    {
+        // Sends the waypoints first to first + count - 1 as one goal of the single robot, tagged with sequence. Returns false
+        // when it could not be sent, e.g. the action server is gone.
+        std::function<bool(size_t first, size_t count, size_t sequence)> send_goal;
+        // Sends a robot of the fleet to its waypoint, tagged with sequence
+        std::function<void(size_t robot, size_t sequence)> send_fleet_goal;
+        // Cancels the goal in flight of a robot of the fleet, or of the single robot for -1
+        std::function<void(long robot)> cancel_goal;
+        // Calls retry_elapsed(robot, sequence) after delay seconds, robot is -1 for the single robot
+        std::function<void(long robot, double delay, size_t sequence)> schedule_retry;
+        // Returns true when the action server of a robot of the fleet is ready
+        std::function<bool(size_t robot)> robot_ready;
+        // Returns the travel costs between the points, see PartPoseListener::waypoint_cost_matrix. The straight line distances
+        // are used when it is not set.
+        std::function<std::vector<double>(const std::vector<point3> &points, std::vector<double> *arrivals, size_t first_waypoint)>
+            costs;
+        // Progress reports
+        std::function<void(size_t waypoint)> waypoint_reached;
+        std::function<void(size_t waypoint)> goal_aborted;
+        std::function<void()> waypoints_reordered;
+        // All the waypoints of the mission are reached or skipped, the node starts the next mission
+        std::function<void()> mission_done;
+        std::function<void(log_level level, const std::string &message)> log;
+    };
+
+    /**
+     * @brief Construct a new Mission Sequencer object, without a mission
+     *
+     * @param opts
+     * @param callbacks
+     */
+    MissionSequencer(options opts, hooks callbacks);
+
+    /**
+     * @brief Appends a mission to the queue.
+     *
+     */
+    void queue_mission(queued_mission next);
+
+    /**
+     * @brief Returns the first mission of the queue, nullptr when the queue is empty. Its waypoints can be resolved ahead.
+     *
+     */
+    queued_mission *next_mission() { return queue_.empty() ? nullptr : &queue_.front(); }
+    size_t queued_missions() const { return queue_.size(); }
+
+    /**
+     * @brief Builds the waypoints of the queued missions again from a new mission table.
+     *
+     * @param missions
+     * @param dropped receives the markers of the missions dropped because the table has no mission for them
+     */
+    void reload_queue(const MissionTable &missions, std::vector<long> &dropped);
+
+    /**
+     * @brief Makes the first mission of the queue the current mission. Its waypoints resolved ahead keep their pose and are
+     * bound to their part. The goals are only sent by navigate().
+     *
+     * @return false when the queue is empty
+     */
+    bool start_next_mission();
+
+    /**
+     * @brief Returns true when no mission was started yet or all the waypoints of the current mission are reached.
+     *
+     */
+    bool mission_finished() const;
+
+    /**
+     * @brief Replaces the waypoints that are not reached yet with the waypoints of a new mission. The waypoints of the new mission
+     * keep the pose and the part of an old waypoint of the same part. A goal in flight to a waypoint that moved or was removed is
+     * canceled.
+     *
+     * @param steps
+     * @return size_t the first waypoint that is not reached, the parts without a waypoint can be matched from there
+     */
+    size_t replace_mission(const mission &steps);
+
+    /**
+     * @brief Restores the mission of a snapshot.
+     *
+     * @param marker_id
+     * @param waypoints
+     * @param current_waypoint
+     */
+    void restore(long marker_id, std::vector<waypoint> waypoints, size_t current_waypoint);
+
+    /**
+     * @brief Sets where the single robot starts the current mission, the first node of the order optimization and the headings.
+     *
+     */
+    void set_mission_start(const pose3 &pose)
+    {
+        mission_start_ = pose;
+        last_reached_ = pose;
+    }
+
+    const std::vector<waypoint> &waypoints() const { return waypoints_; }
+    const pose3 &mission_start() const { return mission_start_; }
+    long marker_id() const { return marker_id_; }
+    size_t current_waypoint() const { return current_waypoint_; }
+    size_t resolved_waypoints() const { return resolved_waypoints_; }
+    size_t goal_sequence() const { return goal_sequence_; }
+    bool order_optimized() const { return order_optimized_; }
+    const robot_state &robot(size_t index) const { return robots_[index]; }
+    size_t robot_count() const { return robots_.size(); }
+
+    /**
+     * @brief Returns true when every waypoint has a pose. Since the waypoints are resolved one by one this is a counter check and
+     * does not scan the waypoints.
+     *
+     */
+    bool all_waypoints_resolved() const { return resolved_waypoints_ == waypoints_.size(); }
+
+    /**
+     * @brief Sets the pose of a waypoint resolved from a part and binds the part to it.
+     *
+     * @param index
+     * @param pose
+     * @param trace_id camera image the pose comes from
+     */
+    void resolve_waypoint(size_t index, const pose3 &pose, uint64_t trace_id);
+
+    /**
+     * @brief Returns the waypoint a part is bound to, no_waypoint when it is not bound.
+     *
+     */
+    size_t bound_waypoint(part_type type, part_color color) const { return bindings_[part_key_index(type, color)]; }
+
+    /**
+     * @brief Updates the pose of a waypoint whose part moved and sends the goal again if a robot is driving to it.
+     *
+     * @param index
+     * @param pose
+     */
+    void move_waypoint(size_t index, const pose3 &pose);
+
+    /**
+     * @brief Sets the orientation of a waypoint to a heading in radians.
+     *
+     */
+    void set_heading(size_t index, double heading);
+
+    /**
+     * @brief This function is the goal dispatcher. It is called on every event that can make a goal actionable (waypoint resolved,
+     * goal finished) and sends the current waypoint exactly once when no goal is in flight and its pose is assigned. In through_poses
+     * mode the remaining waypoints are batched when all of them are resolved. In fleet mode it assigns the idle robots.
+     *
+     */
+    void navigate();
+
+    /**
+     * @brief Marks the action server as ready and dispatches the waiting goals.
+     *
+     */
+    void server_available();
+
+    /**
+     * @brief Puts the dispatcher back in the waiting state when the action server is gone, the goal in flight is dropped.
+     *
+     */
+    void server_lost();
+    bool server_ready() const { return server_ready_; }
+
+    /**
+     * @brief Records the response to a goal of the single robot. A rejected goal is retried.
+     *
+     * @return true if the response is for the current goal
+     */
+    bool goal_response(size_t sequence, bool accepted);
+
+    /**
+     * @brief Records the result of a goal of the single robot and dispatches the next waypoint. A failed goal is retried.
+     *
+     */
+    void goal_finished(size_t sequence, goal_result result);
+
+    /**
+     * @brief Hands off to the next waypoint when the robot enters handoff_radius of the current one.
+     *
+     * @param sequence
+     * @param robot position of the robot
+     */
+    void goal_feedback(size_t sequence, const point3 &robot);
+
+    /**
+     * @brief Tracks the waypoints passed during a through_poses goal.
+     *
+     * @param sequence
+     * @param remaining number of poses of the goal still ahead
+     */
+    void poses_remaining(size_t sequence, size_t remaining);
+
+    /**
+     * @brief Sends a failed goal again once its backoff elapsed, robot is -1 for the single robot.
+     *
+     */
+    void retry_elapsed(long robot, size_t sequence);
+
+    /**
+     * @brief Reorders the remaining waypoints from their current order after the travel costs changed, when the order is optimized.
+     *
+     */
+    void routes_changed();
+
+    /**
+     * @brief Updates the pose of a robot of the fleet.
+     *
+     * @return true for the first pose of the robot
+     */
+    bool update_robot_pose(size_t index, const pose3 &pose);
+
+    /**
+     * @brief Records the response to the goal of a robot of the fleet. A rejected goal releases the waypoint.
+     *
+     * @return true if the response is for the current goal of the robot
+     */
+    bool fleet_goal_response(size_t index, size_t sequence, bool accepted);
+
+    /**
+     * @brief Records the result of the goal of a robot of the fleet and assigns the robot again. A waypoint that the robot could
+     * not reach is released for the other robots.
+     *
+     */
+    void fleet_goal_finished(size_t index, size_t sequence, goal_result result);
+
+private:
+    /**
+     * @brief Sends the waypoints first to first + count - 1 as one goal, facing their approach headings.
+     *
+     */
+    void send_goal(size_t first, size_t count);
+
+    /**
+     * @brief Handles an aborted or rejected goal of the single robot. The goal is sent again after the backoff until retry_limit
+     * is reached, then the current waypoint is skipped and the dispatcher moves on.
+     *
+     */
+    void goal_failed();
+
+    /**
+     * @brief Records that the single robot reached a waypoint and calls the waypoint_reached hook.
+     *
+     */
+    void reach_waypoint(size_t index);
+
+    /**
+     * @brief Returns the backoff in seconds before the given retry, 1 for the first retry.
+     *
+     */
+    double retry_backoff(int retry) const;
+
+    /**
+     * @brief Assigns the open waypoints (resolved, not reached and not assigned) to the idle robots over the travel costs from
+     * the robot positions: with the Hungarian solver when the whole fleet is idle, with the auction solver when robots become idle
+     * while the others keep their goals.
+     *
+     */
+    void dispatch_fleet();
+
+    /**
+     * @brief Sends a robot of the fleet to its waypoint.
+     *
+     */
+    void send_fleet_goal(size_t index);
+
+    /**
+     * @brief Handles an aborted or rejected goal of a robot of the fleet. The waypoint is released for the other robots, or
+     * skipped once it failed retry_limit + 1 times, and the robot waits for the backoff before it is assigned again.
+     *
+     */
+    void fleet_goal_failed(size_t index);
+
+    /**
+     * @brief Reports the end of the mission when the fleet reached every waypoint, otherwise assigns the idle robots.
+     *
+     */
+    void continue_fleet();
+
+    /**
+     * @brief Sets the orientation of the waypoints from first to last (exclusive) to their approach heading: the circular mean of
+     * the heading the path from the previous waypoint arrives in and the heading the path to the next resolved waypoint leaves in.
+     * Straight line bearings are used for the pairs without a path.
+     *
+     */
+    void assign_approach_headings(size_t first, size_t last);
+
+    /**
+     * @brief Reorders the remaining waypoints with the TourOptimizer, starting from the robot position. With improve_only the
+     * current order is improved with local search instead of solved again, and the waypoints of the goal in flight keep their place.
+     *
+     */
+    void optimize_waypoint_order(bool improve_only);
+
+    /**
+     * @brief Returns the travel costs between the points from the costs hook, or the straight line distances.
+     *
+     */
+    std::vector<double> costs(const std::vector<point3> &points, std::vector<double> *arrivals, size_t first_waypoint) const;
+
+    /**
+     * @brief Counts the resolved and reached waypoints again.
+     *
+     */
+    void count_waypoints();
+
+    void log(log_level level, const char *format, ...) const;
+
+    options options_;
+    hooks hooks_;
+    std::vector<waypoint> waypoints_;
+    std::deque<queued_mission> queue_;
+    std::array<size_t, part_key_count> bindings_;  // waypoint of each part, indexed by part_key_index
+    std::vector<robot_state> robots_;
+    pose3 mission_start_;  // where the robot starts the current mission
+    pose3 last_reached_;   // last waypoint the single robot reached, mission_start_ until it reaches one
+    long marker_id_;
+    size_t current_waypoint_;
+    size_t resolved_waypoints_;   // waypoints with a pose, the waypoints before current_waypoint_ always have one
+    size_t reached_waypoints_;    // waypoints reached by the fleet
+    size_t first_open_waypoint_;  // the fleet reached all the waypoints before it
+    goal_state goal_state_;
+    size_t goal_sequence_;
+    size_t batch_start_;
+    size_t batch_size_;
+    bool order_optimized_;
+    bool server_ready_;
+    int goal_retries_;  // failed goals to goal_retry_waypoint_
+    size_t goal_retry_waypoint_;
+};
@@ -0,0 +1,139 @@
+/**
+ * @file mission_snapshot.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the MissionSnapshot class. This class saves the detected parts and the mission progress to a file so that
+ * a restarted node resumes the mission without detecting the parts again.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include "mission_table.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief  struct to store a detected part in a snapshot, the pose is x, y, z and the quaternion x, y, z, w in the map frame
+ *
+ */
+struct snapshot_part
+{
+    part_color color;
+    part_type type;
+    double pose[7];
+    double weight;       // fused weight of the observations
+    double best_weight;  // weight of the best single observation
+};
+
+/**
+ * @brief  struct to store a waypoint in a snapshot
+ *
+ */
+struct snapshot_waypoint
+{
+    part_type type;
+    part_color color;
+    bool pose_assigned;
+    bool reached;
+    double pose[7];
+};
+
+/**
+ * @brief  struct to store the state saved in a snapshot
+ *
+ */
+struct snapshot
+{
+    long marker_id = -1;  // marker of the current mission, -1 when no mission was started
+    uint64_t current_waypoint_index = 0;
+    std::vector<snapshot_part> parts;
+    std::vector<snapshot_waypoint> waypoints;
+};
+
+/**
+ * @brief  This class reads and writes snapshots. A snapshot is a fixed size header followed by the part and the waypoint records,
+ * with a checksum of the records in the header.
+ *
+ * A snapshot is written to a temporary file that is synced and renamed over the previous one, then the directory is synced so that
+ * the rename survives a crash. A crash while writing leaves the previous snapshot in place. It is read by mapping the file, a file with another layout or a wrong checksum is rejected.
+ *
+ */
+class MissionSnapshot
+{
+public:
+    /**
+     * @brief Encodes a snapshot in the file format.
+     *
+     */
+    static std::vector<uint8_t> encode(const snapshot &state);
+
+    /**
+     * @brief Writes an encoded snapshot to a file atomically.
+     *
+     * @throws std::runtime_error if the file cannot be written
+     */
+    static void write(const std::string &file, const std::vector<uint8_t> &data);
+
+    /**
+     * @brief Reads a snapshot from a file.
+     *
+     * @return true if the file exists, false when there is no snapshot
+     * @throws std::runtime_error if the file cannot be read or is not a valid snapshot
+     */
+    static bool read(const std::string &file, snapshot &state);
+};
+
+/**
+ * @brief  This class writes the snapshots on a background thread, so that the fsyncs do not block the callbacks. Only the latest
+ * submitted snapshot is kept: a snapshot submitted while another one is written replaces the one waiting. A snapshot equal to the
+ * last one written is skipped, a snapshot that failed to be written is written again the next time it is submitted.
+ *
+ */
+class SnapshotWriter
+{
+public:
+    using error_sink = std::function<void(const std::string &)>;
+
+    /**
+     * @brief Construct a new Snapshot Writer object and starts its thread
+     *
+     * @param file
+     * @param on_error receives the write errors on the background thread
+     */
+    SnapshotWriter(const std::string &file, error_sink on_error);
+
+    /**
+     * @brief Writes the snapshot waiting, if any, and stops the thread.
+     *
+     */
+    ~SnapshotWriter();
+    SnapshotWriter(const SnapshotWriter &) = delete;
+    SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+    /**
+     * @brief Queues an encoded snapshot without waiting for the write.
+     *
+     */
+    void submit(std::vector<uint8_t> data);
+
+private:
+    void run();
+
+    std::string file_;
+    error_sink on_error_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<uint8_t> pending_;
+    bool has_pending_;
+    bool stop_;
+    std::vector<uint8_t> written_;  // only used by the background thread
+    std::thread thread_;
+};
@@ -0,0 +1,128 @@
+/**
+ * @file mission_table.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the MissionTable class. This class stores the missions of the aruco markers, parsed once at startup.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief  color of a part
+ *
+ */
+enum class part_color : uint8_t
+{
+    red,
+    green,
+    blue,
+    orange,
+    purple
+};
+
+/**
+ * @brief  type of a part
+ *
+ */
+enum class part_type : uint8_t
+{
+    battery,
+    pump,
+    sensor,
+    regulator
+};
+
+/**
+ * @brief  struct to store a waypoint of a mission, the part to drive to
+ *
+ */
+struct mission_waypoint
+{
+    part_type type;
+    part_color color;
+};
+
+/**
+ * @brief  struct to store a mission, a view into the MissionTable
+ *
+ */
+struct mission
+{
+    const mission_waypoint *waypoints = nullptr;
+    size_t size = 0;  // 0 when the marker has no mission
+
+    const mission_waypoint *begin() const { return waypoints; }
+    const mission_waypoint *end() const { return waypoints + size; }
+};
+
+/**
+ * @brief  This class stores the missions of all the aruco markers in one flat array, the waypoints of marker id are
+ * waypoints_[offsets_[id]] to waypoints_[offsets_[id + 1]], so finding the mission of a marker is one array lookup.
+ *
+ * The missions are read from the parameters aruco_<id>.wp<n>.type and aruco_<id>.wp<n>.color, with n counted from 1. A mission
+ * can have any number of waypoints, but they have to be numbered without gaps and every waypoint needs a known type and color.
+ *
+ */
+class MissionTable
+{
+public:
+    // Largest marker id, the table has one entry per id up to the largest id used
+    static constexpr long max_marker_id = 4095;
+
+    /**
+     * @brief Parses the missions from the parameters. Parameters that do not start with aruco_ are ignored.
+     *
+     * @param parameters pairs of parameter name and string value
+     * @return MissionTable
+     * @throws std::runtime_error if a mission parameter is malformed, has an unknown type or color, or a waypoint is missing
+     */
+    static MissionTable parse(const std::vector<std::pair<std::string, std::string>> &parameters);
+
+    /**
+     * @brief Returns the mission of a marker, empty when the marker has no mission.
+     *
+     */
+    mission find(long marker_id) const
+    {
+        if (marker_id < 0 || static_cast<size_t>(marker_id) + 1 >= offsets_.size())
+        {
+            return mission{};
+        }
+        uint32_t first = offsets_[static_cast<size_t>(marker_id)];
+        return mission{waypoints_.data() + first, offsets_[static_cast<size_t>(marker_id) + 1] - first};
+    }
+
+    /**
+     * @brief Returns the number of markers with a mission.
+     *
+     */
+    size_t mission_count() const { return mission_count_; }
+
+    /**
+     * @brief Parses a type or a color, case insensitive.
+     *
+     * @return true if the name is known
+     */
+    static bool parse_type(const std::string &name, part_type &type);
+    static bool parse_color(const std::string &name, part_color &color);
+
+    /**
+     * @brief Returns the name of a type or a color in upper case.
+     *
+     */
+    static const char *to_string(part_type type);
+    static const char *to_string(part_color color);
+
+private:
+    std::vector<mission_waypoint> waypoints_;
+    std::vector<uint32_t> offsets_;
+    size_t mission_count_ = 0;
+};
@@ -0,0 +1,186 @@
+/**
+ * @file occupancy_grid.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the OccupancyGrid class. This class loads a Nav2 map (yaml + pgm) for the mission planning.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+/**
+ * @brief  state of a map cell
+ *
+ */
+enum class cell_state : uint8_t
+{
+    free = 0,
+    occupied = 1,
+    unknown = 2
+};
+
+/**
+ * @brief  struct to store the index of a map cell, x is the column and y the row counted from the bottom of the map
+ *
+ */
+struct map_cell
+{
+    int x;
+    int y;
+};
+
+/**
+ * @brief  This class stores a Nav2 map with 2 bits per cell. The cells are classified with the trinary thresholds of the map yaml file.
+ *
+ * The cells are grouped in tiles of 32 columns x 8 rows. A row of a tile is one 64 bit word and a tile is one 64 byte cache line, so
+ * neighbouring rows are close in memory and a run of up to 32 cells of a row is tested with a single mask. Cells of the last tiles
+ * that fall outside the map are unknown.
+ *
+ */
+class OccupancyGrid
+{
+public:
+    static constexpr int tile_width = 32;
+    static constexpr int tile_height = 8;
+
+    OccupancyGrid() = default;
+    OccupancyGrid(OccupancyGrid &&) = default;
+    OccupancyGrid &operator=(OccupancyGrid &&) = default;
+
+    /**
+     * @brief Construct a new grid of the given size with all the cells in the same state.
+     *
+     */
+    OccupancyGrid(int width, int height, double resolution, double origin_x, double origin_y, cell_state state = cell_state::unknown);
+
+    /**
+     * @brief Loads a map from a Nav2 map yaml file and the pgm image it points to. The image is memory mapped and packed directly,
+     * without an intermediate byte per cell copy.
+     *
+     * @param yaml_path
+     * @return OccupancyGrid
+     * @throws std::runtime_error if the files cannot be read or parsed
+     */
+    static OccupancyGrid load(const std::string &yaml_path);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    double resolution() const { return resolution_; }
+    double origin_x() const { return origin_x_; }
+    double origin_y() const { return origin_y_; }
+
+    bool in_bounds(int x, int y) const { return x >= 0 && y >= 0 && x < width_ && y < height_; }
+
+    /**
+     * @brief Returns the state of a cell, cells outside the map are unknown.
+     *
+     */
+    cell_state state(int x, int y) const
+    {
+        if (!in_bounds(x, y))
+        {
+            return cell_state::unknown;
+        }
+        return static_cast<cell_state>((words_.get()[word_index(x, y)] >> bit_shift(x)) & 3u);
+    }
+
+    bool is_free(int x, int y) const { return state(x, y) == cell_state::free; }
+
+    /**
+     * @brief Changes the state of a cell, cells outside the map are ignored.
+     *
+     */
+    void set_state(int x, int y, cell_state state);
+
+    /**
+     * @brief Checks that all the cells from x0 to x1 (inclusive) of row y are free, one word per tile.
+     *
+     */
+    bool span_free(int y, int x0, int x1) const;
+
+    /**
+     * @brief Checks that all the cells of the rectangle are free (e.g. a rectangular footprint).
+     *
+     */
+    bool rect_free(int x0, int y0, int x1, int y1) const;
+
+    /**
+     * @brief Checks that all the cells within radius of a point in the map frame are free (a circular footprint).
+     *
+     */
+    bool footprint_free(double x, double y, double radius) const;
+
+    /**
+     * @brief Checks that every cell crossed by the segment between the centers of two cells is free.
+     *
+     */
+    bool line_of_sight(const map_cell &from, const map_cell &to) const;
+
+    /**
+     * @brief Converts a position in the map frame to the cell that contains it.
+     *
+     */
+    map_cell world_to_cell(double x, double y) const;
+
+    /**
+     * @brief Converts a cell to the position of its center in the map frame.
+     *
+     */
+    void cell_to_world(const map_cell &cell, double &x, double &y) const;
+
+    /**
+     * @brief Finds the free cell closest to the given cell, searching rings of growing radius.
+     *
+     * @param cell
+     * @param max_radius search radius in cells
+     * @param free closest free cell
+     * @return true if a free cell was found within max_radius
+     */
+    bool nearest_free(const map_cell &cell, int max_radius, map_cell &free) const;
+
+    /**
+     * @brief Returns the memory used by the cells in bytes.
+     *
+     */
+    size_t memory_size() const { return word_count_ * sizeof(uint64_t); }
+
+    /**
+     * @brief Returns a hash (FNV-1a) of the size, resolution, origin and cells of the map, used as the version of the map.
+     *
+     */
+    uint64_t content_hash() const;
+
+private:
+    /**
+     * @brief  deleter for the cache line aligned cell words
+     *
+     */
+    struct free_deleter
+    {
+        void operator()(uint64_t *words) const { std::free(words); }
+    };
+
+    size_t word_index(int x, int y) const
+    {
+        return (static_cast<size_t>(y / tile_height) * tiles_x_ + static_cast<size_t>(x / tile_width)) * tile_height + y % tile_height;
+    }
+    static unsigned bit_shift(int x) { return static_cast<unsigned>(x % tile_width) * 2u; }
+
+    void allocate(cell_state state);
+
+    int width_ = 0;
+    int height_ = 0;
+    double resolution_ = 0.05;
+    double origin_x_ = 0.0;
+    double origin_y_ = 0.0;
+    size_t tiles_x_ = 0;
+    size_t word_count_ = 0;
+    std::unique_ptr<uint64_t, free_deleter> words_;
+};
@@ -17,11 +17,30 @@
 #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
 #include "ros2_aruco_interfaces/msg/aruco_markers.hpp"
 #include <geometry_msgs/msg/pose_with_covariance_stamped.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
 #include <string>
+#include <unordered_set>
 #include <nav_msgs/msg/odometry.hpp>
+#include <nav_msgs/msg/occupancy_grid.hpp>
+#include <diagnostic_msgs/msg/diagnostic_status.hpp>
 #include <rclcpp_action/rclcpp_action.hpp>
+#include <std_srvs/srv/trigger.hpp>
 #include <nav2_msgs/action/navigate_to_pose.hpp>
 #include <nav2_msgs/action/navigate_through_poses.hpp>
+#include <final_project/trace_buffer.hpp>
+#include "mission_table.hpp"
+#include "mission_core.hpp"
+#include "mission_snapshot.hpp"
+#include "event_log.hpp"
+#include "mission_metrics.hpp"
+#include "distance_matrix.hpp"
+#include "distance_field.hpp"
+#include "grid_planner.hpp"
+#include "hierarchical_planner.hpp"
+#include "mission_sequencer.hpp"
 
 /**
  * @brief  This class is used to listen to the part poses from the logical cameras and aruco markers and send navigation goals to the robot.
@@ -32,18 +51,11 @@ class PartPoseListener : public rclcpp::Node
 public:
     // PartPoseListener();
 
-    /**
-     * @brief  struct to store the waypoints
-     *
-     */
-    struct waypoint
-    {
-        std::string type;
-        std::string color;
-        geometry_msgs::msg::Pose pose;
-        bool pose_assigned = false;
-    };
-    std::vector<waypoint> waypoints_;
+    // The waypoints and the queued missions are held by the sequencer
+    using waypoint = MissionSequencer::waypoint;
+    using queued_mission = MissionSequencer::queued_mission;
+    using goal_state = MissionSequencer::goal_state;
+    using navigation_mode = MissionSequencer::navigation_mode;
 
     /**
      * @brief  struct to store the detected parts
@@ -51,13 +63,15 @@ public:
      */
     struct detected_part
     {
-        std::string type;
-        std::string color;
+        part_type type;
+        part_color color;
         geometry_msgs::msg::Pose pose;
+        uint64_t trace_id = 0;  // camera image the part was first seen in, when tracing
     };
     std::vector<detected_part> detected_parts_;
     geometry_msgs::msg::Pose initial_pose_;
     rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr odom_subscription_;
+    rclcpp::Subscription<nav_msgs::msg::OccupancyGrid>::SharedPtr map_update_subscription_;
 
     /**
      * @brief Construct a new part pose listener::part pose listener object
@@ -66,54 +80,91 @@ public:
     PartPoseListener() : Node("PartPoseListener"),
                          tf_buffer(this->get_clock()),
                          tf_listener(tf_buffer),
-                         aruco_marker_id_(-1),
                          id_received_(false),
                          info_logged_(false),
-                         total_parts_to_detect(5),
-                         parts_detected(0),
                          all_parts_logged_(false),
                          initial_pose_set_(false),
-                         declared(false),
-                         current_waypoint_index_(0)
+                         action_server_timeouts_(0)
     {
+        // The messages logged for every part and waypoint on every camera message go through an asynchronous log: the callbacks
+        // push binary records into a ring buffer of log_buffer_size records and a background thread formats them, at most
+        // log_rate_limit messages per second of each kind (0 for no limit).
+        start_event_log(static_cast<size_t>(std::max(this->declare_parameter<int>("log_buffer_size", 4096), 2)),
+                        this->declare_parameter<double>("log_rate_limit", 20.0));
 
-        auto qos = rclcpp::SensorDataQoS();
+        // Mission metrics (detection times, goal latencies, distance, aborts) are published on metrics_topic after every reached
+        // waypoint and mission, and appended to the CSV file metrics_csv when it is set.
+        metrics_ = MissionMetrics(now_seconds());
+        metrics_publisher_ = this->create_publisher<diagnostic_msgs::msg::DiagnosticStatus>(
+            this->declare_parameter<std::string>("metrics_topic", "~/metrics"), 10);
+        metrics_csv_ = this->declare_parameter<std::string>("metrics_csv", "");
+        open_metrics_csv();
 
-        // Initialization of the subscribers, publishers and clients
-        camera1_subscription = this->create_subscription<mage_msgs::msg::AdvancedLogicalCameraImage>(
-            "/mage/camera1/image", qos,
-            [this](const mage_msgs::msg::AdvancedLogicalCameraImage::SharedPtr msg)
+        // Latency trace from the logical camera plugin to the accepted goals, written to trace_file (e.g. in /dev/shm) when it
+        // is set. The plugin writes its own file when LOGICAL_CAMERA_TRACE_DIR is set, scripts/trace_latency.py merges them.
+        std::string trace_file = this->declare_parameter<std::string>("trace_file", "");
+        if (!trace_file.empty())
+        {
+            try
             {
-                this->camera_callback(msg, "Camera 1");
-            });
-
-        camera2_subscription = this->create_subscription<mage_msgs::msg::AdvancedLogicalCameraImage>(
-            "/mage/camera2/image", qos,
-            [this](const mage_msgs::msg::AdvancedLogicalCameraImage::SharedPtr msg)
+                trace_ = std::make_unique<trace::TraceBuffer>(trace_file, 1 << 16);
+            }
+            catch (const std::exception &e)
             {
-                this->camera_callback(msg, "Camera 2");
-            });
+                RCLCPP_WARN(this->get_logger(), "%s", e.what());
+            }
+        }
 
-        camera3_subscription = this->create_subscription<mage_msgs::msg::AdvancedLogicalCameraImage>(
-            "/mage/camera3/image", qos,
-            [this](const mage_msgs::msg::AdvancedLogicalCameraImage::SharedPtr msg)
-            {
-                this->camera_callback(msg, "Camera 3");
-            });
-        camera4_subscription = this->create_subscription<mage_msgs::msg::AdvancedLogicalCameraImage>(
-            "/mage/camera4/image", qos,
-            [this](const mage_msgs::msg::AdvancedLogicalCameraImage::SharedPtr msg)
+        // Tracking parameters. In continuous mode the camera subscriptions stay alive after all the parts are detected
+        // and only parts that moved more than the threshold are pushed to the waypoints.
+        continuous_tracking_ = this->declare_parameter<bool>("continuous_tracking", false);
+        tracking_update_threshold_ = this->declare_parameter<double>("tracking_update_threshold", 0.05);
+
+        // Fusion parameters. The standard deviation of an observation grows with the range and the off-axis angle
+        // of the part as seen from the camera.
+        fusion_base_sigma_ = this->declare_parameter<double>("fusion_base_sigma", 0.01);
+        fusion_range_sigma_ = this->declare_parameter<double>("fusion_range_sigma", 0.02);
+        fusion_angle_sigma_ = this->declare_parameter<double>("fusion_angle_sigma", 0.05);
+        fusion_outlier_gate_ = this->declare_parameter<double>("fusion_outlier_gate", 3.0);
+        fusion_outlier_limit_ = this->declare_parameter<int>("fusion_outlier_limit", 3);
+        // The weight of the estimate is multiplied by fusion_decay before each observation, so it stays below
+        // weight / (1 - fusion_decay) and a slow motion inside the gate is still followed. 1 keeps every observation.
+        fusion_decay_ = std::clamp(this->declare_parameter<double>("fusion_decay", 0.9), 0.0, 1.0);
+
+        // The missions of all the markers are parsed once from the aruco_<id>.wp<n> parameters, an invalid mission stops the node
+        std::vector<std::pair<std::string, std::string>> mission_parameters;
+        for (const auto &parameter : this->get_node_parameters_interface()->get_parameter_overrides())
+        {
+            if (parameter.second.get_type() == rclcpp::ParameterType::PARAMETER_STRING)
             {
-                this->camera_callback(msg, "Camera 4");
-            });
+                mission_parameters.emplace_back(parameter.first, parameter.second.get<std::string>());
+            }
+        }
+        try
+        {
+            missions_ = std::make_shared<const MissionTable>(MissionTable::parse(mission_parameters));
+        }
+        catch (const std::exception &ex)
+        {
+            RCLCPP_FATAL(this->get_logger(), "Invalid mission parameters: %s", ex.what());
+            throw;
+        }
+        RCLCPP_INFO(this->get_logger(), "Loaded the missions of %zu markers", missions_->mission_count());
 
-        camera5_subscription = this->create_subscription<mage_msgs::msg::AdvancedLogicalCameraImage>(
-            "/mage/camera5/image", qos,
-            [this](const mage_msgs::msg::AdvancedLogicalCameraImage::SharedPtr msg)
+        // The ~/reload_missions service parses the missions of mission_file (the installed waypoint_params.yaml when empty) and swaps
+        // them in while the node runs. The detected parts are kept and matched against the new mission of the current marker.
+        mission_file_ = this->declare_parameter<std::string>("mission_file", "");
+        reload_missions_service_ = this->create_service<std_srvs::srv::Trigger>(
+            "~/reload_missions",
+            [this](const std::shared_ptr<std_srvs::srv::Trigger::Request> request,
+                   std::shared_ptr<std_srvs::srv::Trigger::Response> response)
             {
-                this->camera_callback(msg, "Camera 5");
+                this->reload_missions_callback(request, response);
             });
 
+        // Initialization of the subscribers, publishers and clients
+        subscribe_cameras();
+
         aruco_marker_subscription_ = this->create_subscription<ros2_aruco_interfaces::msg::ArucoMarkers>(
             "aruco_markers", 10,
             std::bind(&PartPoseListener::aruco_marker_callback, this, std::placeholders::_1));
@@ -126,9 +177,122 @@ public:
             });
         initialpose_publisher_ = this->create_publisher<geometry_msgs::msg::PoseWithCovarianceStamped>("/initialpose", 10);
         navigate_to_pose_client_ = rclcpp_action::create_client<nav2_msgs::action::NavigateToPose>(this, "navigate_to_pose");
-        navigation_timer_ = this->create_wall_timer(
-            std::chrono::seconds(1),
-            std::bind(&PartPoseListener::navigate_to_waypoints, this));
+
+        // In through_poses mode all the resolved waypoints are sent as one NavigateThroughPoses goal so that the robot does not
+        // stop at every waypoint. Waypoints that resolve late are sent one by one with NavigateToPose.
+        MissionSequencer::options sequencer_options;
+        std::string mode = this->declare_parameter<std::string>("navigation_mode", "sequential");
+        navigation_mode_ = mode == "through_poses" ? navigation_mode::through_poses : navigation_mode::sequential;
+        sequencer_options.mode = navigation_mode_;
+        if (mode != "through_poses" && mode != "sequential")
+        {
+            RCLCPP_WARN(this->get_logger(), "Unknown navigation_mode '%s', using sequential", mode.c_str());
+        }
+        navigate_through_poses_client_ = rclcpp_action::create_client<nav2_msgs::action::NavigateThroughPoses>(this, "navigate_through_poses");
+
+        // In fleet mode each namespace of robot_namespaces is a robot with its own Nav2 stack (<ns>/navigate_to_pose, <ns>/odom).
+        // The resolved waypoints are assigned to the idle robots with the smallest total travel cost on the map, and a robot gets
+        // a new waypoint when it finishes. navigation_mode, handoff_radius and optimize_order only apply to a single robot.
+        for (const auto &name : this->declare_parameter<std::vector<std::string>>("robot_namespaces", std::vector<std::string>{}))
+        {
+            if (name.empty())
+            {
+                continue;
+            }
+            size_t index = robots_.size();
+            fleet_robot robot;
+            robot.name = name;
+            robot.client = rclcpp_action::create_client<nav2_msgs::action::NavigateToPose>(this, name + "/navigate_to_pose");
+            robot.initialpose_publisher = this->create_publisher<geometry_msgs::msg::PoseWithCovarianceStamped>(name + "/initialpose", 10);
+            robot.odom_subscription = this->create_subscription<nav_msgs::msg::Odometry>(
+                name + "/odom", 10,
+                [this, index](const nav_msgs::msg::Odometry::SharedPtr msg)
+                {
+                    this->fleet_odom_callback(index, msg);
+                });
+            robots_.push_back(std::move(robot));
+            sequencer_options.robots.push_back(name);
+        }
+
+        // When the robot gets within handoff_radius of the current waypoint the next goal preempts it, so the robot does not
+        // stop at every waypoint. 0 disables the handoff.
+        sequencer_options.handoff_radius = this->declare_parameter<double>("handoff_radius", 0.0);
+
+        // When optimize_order is set the dispatcher waits until all the waypoints are resolved and visits them in the order of the
+        // shortest path from the robot instead of the parameter order. fixed_last_waypoint keeps the last waypoint of the mission last.
+        sequencer_options.optimize_order = this->declare_parameter<bool>("optimize_order", false);
+        sequencer_options.fixed_last_waypoint = this->declare_parameter<bool>("fixed_last_waypoint", false);
+
+        // Routes planned on the map are cached across missions. With route_cache_file set the cache is a memory mapped file, so a
+        // restarted node finds the routes of the previous runs on the same map without planning them again.
+        route_cache_file_ = this->declare_parameter<std::string>("route_cache_file", "");
+        route_cache_capacity_ = this->declare_parameter<int>("route_cache_capacity", 4096);
+
+        // On maps of at least hierarchical_map_cells cells the travel costs come from HPA* routes on an abstract graph of the map,
+        // typically 4 to 10 % longer than the shortest paths but without a search of the map per waypoint. 0 disables HPA*.
+        hierarchical_map_cells_ = this->declare_parameter<int>("hierarchical_map_cells", 1000000);
+
+        // Parts are on pallets and in bins, so the goals are moved to the closest reachable cell with goal_clearance around it,
+        // at most goal_max_standoff away from the part, facing the part unless approach_heading is set.
+        adjust_goals_ = this->declare_parameter<bool>("adjust_goals", true);
+        goal_clearance_ = this->declare_parameter<double>("goal_clearance", 0.25);
+        goal_max_standoff_ = this->declare_parameter<double>("goal_max_standoff", 1.0);
+
+        // Travel costs for the mission planning come from shortest paths on the Nav2 map. An empty map_yaml uses the map of the
+        // final_project package, without a map the costs fall back to straight line distances.
+        load_map(this->declare_parameter<std::string>("map_yaml", ""));
+
+        // With approach_heading set, the orientation of each goal is the mean of the direction the path arrives in and the direction
+        // it leaves to the next waypoint, so the robot does not turn in place at the goal.
+        approach_heading_ = this->declare_parameter<bool>("approach_heading", true);
+        sequencer_options.approach_heading = approach_heading_;
+
+        // Occupancy changes (a dropped pallet, a person) are received as full grids on map_updates_topic, e.g. the global costmap.
+        // The routes between the waypoints are repaired where the map changed and the remaining waypoints are reordered from their
+        // current order. An empty topic disables the updates.
+        std::string map_updates_topic = this->declare_parameter<std::string>("map_updates_topic", "");
+        if (!map_updates_topic.empty() && map_)
+        {
+            map_update_subscription_ = this->create_subscription<nav_msgs::msg::OccupancyGrid>(
+                map_updates_topic, rclcpp::QoS(1),
+                [this](const nav_msgs::msg::OccupancyGrid::SharedPtr msg)
+                {
+                    this->map_update_callback(msg);
+                });
+        }
+
+        // The action server is polled instead of waited for so that the executor keeps processing the cameras while Nav2 starts.
+        // Goals stay queued in the sequencer until the server is discovered.
+        action_server_timeout_ = this->declare_parameter<double>("action_server_timeout", 30.0);
+        action_server_wait_start_ = this->get_clock()->now();
+        action_server_timer_ = this->create_wall_timer(
+            std::chrono::milliseconds(200),
+            std::bind(&PartPoseListener::check_action_server, this));
+
+        // A goal that is aborted or rejected is sent again up to goal_retry_limit times, after goal_retry_delay seconds doubled on
+        // every retry. Then the waypoint is skipped so that the mission goes on. In fleet mode the limit applies per waypoint and
+        // the robot waits for the backoff before it takes a new waypoint.
+        sequencer_options.retry_limit = std::max(this->declare_parameter<int>("goal_retry_limit", 3), 0);
+        sequencer_options.retry_delay = std::max(this->declare_parameter<double>("goal_retry_delay", 2.0), 0.0);
+
+        // The missions, their waypoints and the goal dispatch are held by the sequencer, the node sends the goals it asks for and
+        // forwards it the responses, feedback and results
+        sequencer_ = std::make_unique<MissionSequencer>(sequencer_options, sequencer_hooks());
+
+        // The detected parts and the mission progress are saved to snapshot_file every snapshot_period seconds when they changed.
+        // A restarted node loads them and resumes the mission as soon as Nav2 is up, while the cameras refresh the restored parts.
+        // An empty snapshot_file disables the snapshots.
+        snapshot_file_ = this->declare_parameter<std::string>("snapshot_file", "");
+        double snapshot_period = this->declare_parameter<double>("snapshot_period", 1.0);
+        if (!snapshot_file_.empty())
+        {
+            restore_snapshot();
+            snapshot_writer_ = std::make_unique<SnapshotWriter>(snapshot_file_, [this](const std::string &error)
+                                                                { RCLCPP_WARN(this->get_logger(), "%s", error.c_str()); });
+            snapshot_timer_ = this->create_wall_timer(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(std::max(snapshot_period, 0.1))),
+                std::bind(&PartPoseListener::save_snapshot, this));
+        }
     }
 
 private:
@@ -138,8 +302,8 @@ private:
      */
     struct part_key
     {
-        std::string color;
-        std::string type;
+        part_color color;
+        part_type type;
 
         bool operator==(const part_key &other) const
         {
@@ -155,23 +319,99 @@ private:
     {
         std::size_t operator()(const part_key &key) const
         {
-            return std::hash<std::string>()(key.color) ^ std::hash<std::string>()(key.type);
+            return static_cast<std::size_t>(key.color) * 16 + static_cast<std::size_t>(key.type);
         }
     };
 
+    /**
+     * @brief  struct to store the latest estimate of a part
+     *
+     */
+    struct part_estimate
+    {
+        geometry_msgs::msg::Pose pose;
+        rclcpp::Time stamp;
+        size_t detected_index;
+        double weight;
+        double best_weight;
+        int outliers;
+        geometry_msgs::msg::Point pushed_position;
+        bool restored = false;  // loaded from the snapshot and not seen by a camera since
+    };
+
+    /**
+     * @brief  events of the asynchronous log, the frequent messages of the callbacks
+     *
+     */
+    enum class log_event : uint16_t
+    {
+        detected_part,
+        waypoint,
+        part_pose,
+        part_moved
+    };
+
+    /**
+     * @brief  struct to store the clients of a robot of the fleet, its dispatch state is in the sequencer
+     *
+     */
+    struct fleet_robot
+    {
+        std::string name;  // namespace of the robot
+        rclcpp_action::Client<nav2_msgs::action::NavigateToPose>::SharedPtr client;
+        rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr odom_subscription;
+        rclcpp::Publisher<geometry_msgs::msg::PoseWithCovarianceStamped>::SharedPtr initialpose_publisher;
+        rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateToPose>::SharedPtr goal_handle;
+        rclcpp::TimerBase::SharedPtr retry_timer;  // backoff after a failed goal
+    };
+
     // Decleration of the variables
-    std::unordered_map<part_key, geometry_msgs::msg::Pose, part_key_hash> part_poses_;
+    std::vector<fleet_robot> robots_;
+    std::unordered_map<part_key, part_estimate, part_key_hash> part_poses_;
     tf2_ros::Buffer tf_buffer;
     tf2_ros::TransformListener tf_listener;
-    long aruco_marker_id_;
     bool id_received_;
     bool info_logged_;
-    size_t total_parts_to_detect;
-    size_t parts_detected;
     bool all_parts_logged_;
     bool initial_pose_set_;
-    bool declared;
-    size_t current_waypoint_index_;
+    // Current mission table. A reload parses the new table completely before replacing it, so a malformed file keeps the old one.
+    // All the callbacks run on the single threaded executor of main, the table needs no synchronization.
+    std::shared_ptr<const MissionTable> missions_;
+    std::string mission_file_;
+    std::string snapshot_file_;
+    std::unique_ptr<SnapshotWriter> snapshot_writer_;
+    std::unique_ptr<MissionSequencer> sequencer_;
+    std::unordered_set<long> markers_seen_;
+    navigation_mode navigation_mode_;
+    std::string route_cache_file_;
+    int route_cache_capacity_;
+    int hierarchical_map_cells_;
+    std::shared_ptr<OccupancyGrid> map_;
+    std::unique_ptr<DistanceMatrix> distance_matrix_;
+    std::unique_ptr<EventLog> event_log_;
+    MissionMetrics metrics_;
+    std::string metrics_csv_;
+    std::ofstream metrics_file_;  // kept open, the rows are buffered and flushed at the end of each mission
+    std::unique_ptr<trace::TraceBuffer> trace_;
+    rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticStatus>::SharedPtr metrics_publisher_;
+    std::unique_ptr<DistanceField> distance_field_;
+    std::unique_ptr<GridPlanner> grid_planner_;  // single pair queries, e.g. from a robot position
+    std::unique_ptr<HierarchicalPlanner> hierarchical_planner_;  // route costs on large maps
+    bool adjust_goals_;
+    double goal_clearance_;
+    double goal_max_standoff_;
+    bool approach_heading_;
+    double action_server_timeout_;
+    rclcpp::Time action_server_wait_start_;
+    int action_server_timeouts_;
+    bool continuous_tracking_;
+    double tracking_update_threshold_;
+    double fusion_base_sigma_;
+    double fusion_range_sigma_;
+    double fusion_angle_sigma_;
+    double fusion_outlier_gate_;
+    int fusion_outlier_limit_;
+    double fusion_decay_;
 
     /**
      * @brief  Callback function for the logical camera messages. This function receives the logical camera messages and stores the part poses in detected_parts_ vector.
@@ -182,22 +422,64 @@ private:
     void camera_callback(const mage_msgs::msg::AdvancedLogicalCameraImage::SharedPtr msg, const std::string &camera_name);
 
     /**
-     * @brief  Callback function for the aruco marker messages. This function receives the aruco marker id and gets the respective parameters and stores it in waypoints_ vector.
-     * This fuction also resets the aruco_marker_subscription_ after getting the marker id.
+     * @brief  Callback function for the aruco marker messages. This function queues the mission of every marker id seen for the
+     * first time in the sequencer and starts it right away when no mission is running. The subscription stays alive so that the
+     * missions of the markers found later are chained after the current one.
      *
      * @param msg
      */
     void aruco_marker_callback(const ros2_aruco_interfaces::msg::ArucoMarkers::SharedPtr msg);
 
     /**
-     * @brief Checks the map of parts and colors and saves the part type and color to the respective variables.
+     * @brief Callback function for the ~/reload_missions service. The missions of mission_file_ are parsed and swapped in, an
+     * invalid file leaves the current missions in place. When a marker was already received its waypoints are replaced with
+     * apply_mission.
+     *
+     * @param request
+     * @param response
+     */
+    void reload_missions_callback(const std::shared_ptr<std_srvs::srv::Trigger::Request> request,
+                                  std::shared_ptr<std_srvs::srv::Trigger::Response> response);
+
+    /**
+     * @brief This function replaces the waypoints that are not reached yet with the waypoints of a new mission. The waypoints of the
+     * new mission keep the pose of an old waypoint of the same part, the others are matched against the detected parts. A goal in
+     * flight to a waypoint that moved or was removed is canceled.
+     *
+     * @param steps
+     */
+    void apply_mission(const mission &steps);
+
+    /**
+     * @brief This function makes the first mission of the queue of the sequencer the current mission, resolves its waypoints with
+     * the detected parts and navigates to them. Its waypoints resolved ahead by prefetch_mission keep their pose.
+     *
+     */
+    void start_next_mission();
+
+    /**
+     * @brief This function builds the hooks through which the sequencer sends the goals, arms the retry timers and reports the
+     * progress to the metrics.
+     *
+     */
+    MissionSequencer::hooks sequencer_hooks();
+
+    /**
+     * @brief This function calls back the sequencer once the backoff of a failed goal elapsed.
+     *
+     * @param robot index of the robot of the fleet, -1 for the single robot
+     * @param delay seconds
+     * @param sequence
+     */
+    void schedule_retry(long robot, double delay, size_t sequence);
+
+    /**
+     * @brief This function resolves the waypoints of the next queued mission with the detected parts while the current mission
+     * runs. Once they are all resolved the routes between them are planned, which puts them in the route cache before the mission
+     * starts.
      *
-     * @param part_color
-     * @param part_type
-     * @param pat_color
-     * @param pat_type
      */
-    void part_data(int part_color, int part_type, std::string &pat_color, std::string &pat_type);
+    void prefetch_mission();
 
     /**
      * @brief This function logs the part poses in the terminal.
@@ -205,12 +487,148 @@ private:
      */
     void log_all_part_poses();
 
+    /**
+     * @brief This function creates and starts the asynchronous log and registers the formats of its events.
+     *
+     * @param capacity number of records in the ring buffer
+     * @param max_rate messages per second of each event at most, 0 for no limit
+     */
+    void start_event_log(size_t capacity, double max_rate);
+
+    /**
+     * @brief This function pushes a part or waypoint event to the asynchronous log, it does not format anything.
+     *
+     */
+    void log_part(log_event event, uint32_t index, part_type type, part_color color, const geometry_msgs::msg::Point &position);
+
+    /**
+     * @brief This function creates the subscriptions of the five logical cameras.
+     *
+     */
+    void subscribe_cameras();
+
+    /**
+     * @brief This function starts the part detection again for a mission that needs parts not detected yet. The cameras are
+     * subscribed again when finish_part_detection reset them.
+     *
+     */
+    void resume_part_detection();
+
+    /**
+     * @brief Returns true when a camera saw every part of the current mission, the parts restored from the snapshot only count
+     * once they are seen again. This is the condition to finish the part detection.
+     *
+     */
+    bool required_parts_detected() const;
+
+    /**
+     * @brief This function is called once the parts of the mission are detected. It logs the part poses and, unless the tracking
+     * is continuous, resets the camera subscriptions.
+     *
+     */
+    void finish_part_detection();
+
+    /**
+     * @brief Returns the time of the node clock in seconds, the time of the metrics.
+     *
+     */
+    double now_seconds();
+
+    /**
+     * @brief These functions record a reached waypoint and a finished mission in the metrics, publish them and append them to the
+     * CSV file.
+     *
+     */
+    void record_waypoint_metrics(size_t waypoint);
+    void record_mission_metrics();
+
+    /**
+     * @brief This function publishes the metrics of the current mission on the metrics topic.
+     *
+     */
+    void publish_metrics();
+
+    /**
+     * @brief This function opens the metrics CSV file for appending and writes the header when the file is new.
+     *
+     */
+    void open_metrics_csv();
+
+    /**
+     * @brief This function appends a row to the metrics CSV file. The row stays in the stream buffer, the callbacks do not wait
+     * for the disk.
+     *
+     */
+    void append_metrics_csv(const std::string &row);
+
+    /**
+     * @brief This function records a trace event of a waypoint. The argument is the part of the waypoint rather than its index,
+     * so that the events still match when the waypoints are reordered.
+     *
+     * @param stage
+     * @param index
+     */
+    void trace_waypoint(trace::stage stage, size_t index)
+    {
+        if (trace_ && index < sequencer_->waypoints().size())
+        {
+            const waypoint &waypoint = sequencer_->waypoints()[index];
+            trace_->emit(stage, waypoint.trace_id, static_cast<uint32_t>(waypoint.type) << 8 | static_cast<uint32_t>(waypoint.color));
+        }
+    }
+
+    /**
+     * @brief This function hands the detected parts and the progress of the current mission to the snapshot writer, which saves
+     * them to snapshot_file_ on its thread when they changed since the last snapshot.
+     *
+     */
+    void save_snapshot();
+
+    /**
+     * @brief This function loads the snapshot of snapshot_file_ at startup. The parts are restored as detected, and the waypoints
+     * and the current waypoint when the mission of the marker still has the same parts.
+     *
+     */
+    void restore_snapshot();
+
     /**
      * @brief This function compares the detected parts with the waypoints and updates the pose of the waypoints.
      *
      */
     void process_detected_parts();
 
+    /**
+     * @brief This function computes the weight (inverse variance) of an observation from the range and the off-axis angle
+     * of the part in the camera frame.
+     *
+     * @param camera_pose pose of the part in the camera frame
+     * @return double
+     */
+    double observation_weight(const geometry_msgs::msg::Pose &camera_pose) const;
+
+    /**
+     * @brief This function fuses a new observation into the estimate of an already detected part with a recursive weighted mean,
+     * the older observations fading by fusion_decay_. Observations outside the outlier gate are rejected until fusion_outlier_limit_
+     * of them arrive in a row, then the part is considered moved and the estimate restarts from the observation. The stamp of the
+     * estimate is the time of the last accepted observation. If the estimate moved more than tracking_update_threshold_
+     * since it was last pushed, the waypoint bound to the part is updated.
+     *
+     * @param key
+     * @param estimate
+     * @param pose
+     * @param weight
+     * @param stamp
+     */
+    void track_part(const part_key &key, part_estimate &estimate, const geometry_msgs::msg::Pose &pose, double weight, const rclcpp::Time &stamp);
+
+    /**
+     * @brief This function updates the pose of a waypoint and resends the goal if the robot is currently driving to it.
+     *
+     * @param index
+     * @param pose
+     */
+    void update_waypoint(size_t index, const geometry_msgs::msg::Pose &pose);
+
     /**
      * @brief This function logs the waypoints in the terminal.
      *
@@ -225,27 +643,99 @@ private:
     void odom_callback(const nav_msgs::msg::Odometry::SharedPtr msg);
 
     /**
-     * @brief This function is used to send the navigation goal to the robot.
+     * @brief This function is used to send the navigation goal of a waypoint to the robot. Every goal carries the sequence number
+     * given by the sequencer so that responses and results of goals that were replaced in the meantime are ignored.
      *
-     * @param pose
+     * @param index
+     * @param sequence
+     * @return false if the action server is not ready
      */
-    void send_navigation_goal(const geometry_msgs::msg::Pose &pose);
+    bool send_navigation_goal(size_t index, size_t sequence);
 
     /**
-     * @brief This function is used to extract each waypoint from the waypoints_ vector and send it to the send_navigation_goal function.
+     * @brief This function is used to send the waypoints from first to first + count - 1 as one NavigateThroughPoses goal. The
+     * progress is tracked from the number of poses remaining in the feedback.
      *
+     * @param first
+     * @param count
+     * @param sequence
+     * @return false if the action server is not ready
      */
-    void navigate_to_waypoints();
+    bool send_through_poses_goal(size_t first, size_t count, size_t sequence);
 
     /**
-     * @brief This fuction is used to verify if the robot has reached the goal.
+     * @brief This function puts the dispatcher back in the waiting state when the action server is gone.
      *
-     * @param result
+     * @return true if the action servers needed by navigation_mode_ are ready
+     */
+    bool action_servers_ready();
+
+    /**
+     * @brief Timer callback that polls the navigate_to_pose action server. When the server is discovered the queued goal is
+     * flushed. Each time action_server_timeout_ elapses without the server an error is reported and polling continues.
+     *
+     */
+    void check_action_server();
+
+    /**
+     * @brief This function loads the map used for the travel costs and creates the distance matrix on it.
+     *
+     * @param map_yaml path to the Nav2 map yaml file, empty for the map of the final_project package
+     */
+    void load_map(std::string map_yaml);
+
+    /**
+     * @brief This function computes the navigation goal for a part. The goal is the part pose on the ground or, when adjust_goals_
+     * is set and a map is loaded, the standoff pose closest to the part with goal_clearance_ around it, facing the part.
+     *
+     * @param part_pose pose of the part in the map frame
+     * @return geometry_msgs::msg::Pose
+     */
+    geometry_msgs::msg::Pose goal_pose(const geometry_msgs::msg::Pose &part_pose);
+
+    /**
+     * @brief This function computes the travel cost between every pair of points on the map, with HPA* on large maps and the
+     * distance matrix otherwise. Pairs without a path on the map (or all the pairs when no map is loaded) use the straight line
+     * distance.
+     *
+     * @param points
+     * @param arrivals if not null, filled with the heading in which the path from i arrives at j, NaN for the pairs without a path
+     * @param first_waypoint points from this one on are waypoints, whose cells are tracked for the map updates. The points before
+     * are robot positions, which move and are only costed with the bounded search.
+     * @return std::vector<double> row major points.size() x points.size() matrix
+     */
+    std::vector<double> waypoint_cost_matrix(const std::vector<point3> &points,
+                                             std::vector<double> *arrivals = nullptr, size_t first_waypoint = 0);
+
+    /**
+     * @brief Callback function for the map updates. The cells whose state differs from the map are changed, the distance matrix
+     * repairs the routes through them and, when routes changed, the sequencer reorders the remaining waypoints.
+     *
+     * @param msg grid with the size, resolution and origin of the loaded map
+     */
+    void map_update_callback(const nav_msgs::msg::OccupancyGrid::SharedPtr msg);
+
+    /**
+     * @brief This function sends a robot of the fleet to its waypoint, facing the direction in which its path arrives.
+     *
+     * @param index index of the robot
+     * @param sequence
+     */
+    void send_fleet_goal(size_t index, size_t sequence);
+
+    /**
+     * @brief This fuction is used to get the pose of a robot of the fleet and publish its first pose to its initialpose topic.
+     *
+     * @param index index of the robot
+     * @param msg
      */
-    void result_callback(const rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateToPose>::WrappedResult &result);
+    void fleet_odom_callback(size_t index, const nav_msgs::msg::Odometry::SharedPtr msg);
 
     // Decleration of the subscribers, publishers and clients
-    rclcpp::TimerBase::SharedPtr navigation_timer_;
+    rclcpp::TimerBase::SharedPtr action_server_timer_;
+    rclcpp::TimerBase::SharedPtr goal_retry_timer_;  // backoff after a failed goal of the single robot
+    rclcpp::TimerBase::SharedPtr snapshot_timer_;
+    rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr reload_missions_service_;
     rclcpp::Subscription<ros2_aruco_interfaces::msg::ArucoMarkers>::SharedPtr aruco_marker_subscription_;
     rclcpp::Publisher<geometry_msgs::msg::PoseWithCovarianceStamped>::SharedPtr initialpose_publisher_;
     rclcpp::Subscription<mage_msgs::msg::AdvancedLogicalCameraImage>::SharedPtr camera1_subscription;
@@ -255,4 +745,6 @@ private:
     rclcpp::Subscription<mage_msgs::msg::AdvancedLogicalCameraImage>::SharedPtr camera5_subscription;
     rclcpp_action::Client<nav2_msgs::action::NavigateToPose>::SharedPtr navigate_to_pose_client_;
     rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateToPose>::SharedPtr current_goal_handle_;
+    rclcpp_action::Client<nav2_msgs::action::NavigateThroughPoses>::SharedPtr navigate_through_poses_client_;
+    rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateThroughPoses>::SharedPtr current_poses_goal_handle_;
 };
@@ -0,0 +1,108 @@
+/**
+ * @file route_cache.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the RouteCache class. This class stores the routes planned between map cells across missions and runs.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include "occupancy_grid.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief  This class is a least recently used cache of routes keyed by (start cell, goal cell, map version hash). A route holds its
+ * length, the heading it arrives in and its turning points.
+ *
+ * The whole cache lives in one fixed size block: a header, the hash buckets and the slots. The slots are chained per bucket and
+ * linked in least recently used order by index, so the block has no pointers and can be a memory mapped file. With a file the
+ * cache survives restarts: a restarted node finds the routes of the previous runs without planning. A file that was not closed
+ * cleanly, or that has another layout, is cleared when it is opened.
+ *
+ */
+class RouteCache
+{
+public:
+    // Routes with more turning points are stored without them
+    static constexpr size_t max_waypoints = 30;
+
+    /**
+     * @brief  struct to store a cached route
+     *
+     */
+    struct route
+    {
+        double length = 0.0;              // in meters
+        double arrival = 0.0;             // heading in which the route arrives at the goal, NaN when unknown
+        bool has_waypoints = false;       // false when the route had too many turning points to be stored
+        std::vector<map_cell> waypoints;  // start, turning points and goal
+    };
+
+    /**
+     * @brief Construct a new Route Cache object
+     *
+     * @param capacity maximum number of routes
+     * @param file path of the file to map, empty for a cache in memory only
+     * @throws std::runtime_error if the file cannot be created or mapped
+     */
+    explicit RouteCache(size_t capacity, const std::string &file = "");
+    ~RouteCache();
+    RouteCache(const RouteCache &) = delete;
+    RouteCache &operator=(const RouteCache &) = delete;
+
+    /**
+     * @brief Looks up a route and marks it as the most recently used.
+     *
+     * @param map_hash version of the map, see OccupancyGrid::content_hash
+     * @param start index of the start cell
+     * @param goal index of the goal cell
+     * @param found
+     * @return true if the route is in the cache
+     */
+    bool find(uint64_t map_hash, uint32_t start, uint32_t goal, route &found);
+
+    /**
+     * @brief Adds or replaces a route, evicting the least recently used route when the cache is full.
+     *
+     */
+    void insert(uint64_t map_hash, uint32_t start, uint32_t goal, const route &value);
+
+    /**
+     * @brief Removes all the routes.
+     *
+     */
+    void clear();
+
+    /**
+     * @brief Writes the cache to its file, if any.
+     *
+     */
+    void flush();
+
+    size_t size() const;
+    size_t capacity() const { return capacity_; }
+    bool persistent() const { return persistent_; }
+
+private:
+    struct header;
+    struct slot;
+
+    header &head() const;
+    uint32_t *buckets() const;
+    slot *slots() const;
+    uint32_t &bucket_of(uint64_t map_hash, uint32_t start, uint32_t goal) const;
+    void unlink(uint32_t index);
+    void push_front(uint32_t index);
+    bool valid() const;
+
+    size_t capacity_;
+    size_t bucket_count_;
+    size_t size_bytes_;
+    bool persistent_;
+    uint8_t *data_;
+};
@@ -0,0 +1,72 @@
+/**
+ * @file tour_optimizer.hpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief This file declares the TourOptimizer class. This class is used to compute the order in which the waypoints are visited.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief  This class computes a short open path (visit order) through all the nodes of a distance matrix. Small problems are solved
+ * exactly with the bitmask dynamic programming (Held-Karp) solver, larger ones with nearest neighbour followed by 2-opt and Or-opt
+ * local search.
+ *
+ */
+class TourOptimizer
+{
+public:
+    /**
+     * @brief  struct to store the solver options
+     *
+     */
+    struct options
+    {
+        bool fixed_first = false;  // node 0 has to be visited first (e.g. the robot position)
+        bool fixed_last = false;   // node size - 1 has to be visited last
+        size_t exact_limit = 12;   // largest size solved with the exact solver
+        size_t max_passes = 100;   // maximum number of local search passes
+    };
+
+    /**
+     * @brief Computes the visit order of the nodes.
+     *
+     * @param costs row major size x size matrix, costs[i * size + j] is the cost to go from i to j
+     * @param size number of nodes
+     * @param opts solver options
+     * @return std::vector<size_t> the nodes in visit order
+     */
+    static std::vector<size_t> optimize(const std::vector<double> &costs, size_t size, const options &opts);
+
+    /**
+     * @brief Computes the cost of visiting the nodes in the given order.
+     *
+     * @param costs row major size x size matrix
+     * @param size number of nodes
+     * @param order visit order
+     * @return double
+     */
+    static double path_cost(const std::vector<double> &costs, size_t size, const std::vector<size_t> &order);
+
+    /**
+     * @brief Improves an existing order with 2-opt and Or-opt moves. The 2-opt moves assume a symmetric matrix.
+     *
+     * @param costs row major size x size matrix
+     * @param size number of nodes
+     * @param opts solver options
+     * @param order visit order, improved in place
+     */
+    static void improve(const std::vector<double> &costs, size_t size, const options &opts, std::vector<size_t> &order);
+
+private:
+    static std::vector<size_t> solve_exact(const std::vector<double> &costs, size_t size, const options &opts);
+    static std::vector<size_t> nearest_neighbour(const std::vector<double> &costs, size_t size, const options &opts);
+    static bool two_opt_pass(const std::vector<double> &costs, size_t size, const options &opts, std::vector<size_t> &order);
+    static bool or_opt_pass(const std::vector<double> &costs, size_t size, const options &opts, std::vector<size_t> &order);
+};
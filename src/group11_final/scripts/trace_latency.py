@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Per-stage latency distributions of the camera to goal pipeline.
+
+Reads the trace files written by the logical camera plugin (LOGICAL_CAMERA_TRACE_DIR) and by
+part_pose_listener (trace_file parameter), and prints the latency percentiles of each stage.
+
+Usage: trace_latency.py <trace_file> [<trace_file> ...]
+
+Every event of a stage is matched with the latest earlier event of the previous stage with the
+same image id, and for the waypoint stages the same part. The end to end latency follows these
+matches back from the accepted goal to the camera update.
+"""
+
+import bisect
+import struct
+import sys
+
+HEADER = struct.Struct('<QIIQQ')
+RECORD = struct.Struct('<QQHHIQ')
+MAGIC = 0x3145434152544d47
+VERSION = 1
+
+CAMERA_UPDATE = 1
+CAMERA_PUBLISH = 2
+CAMERA_CALLBACK = 3
+TRANSFORM_DONE = 4
+WAYPOINT_RESOLVED = 5
+GOAL_SENT = 6
+GOAL_ACCEPTED = 7
+
+# (stage, previous stage, match the part too)
+STAGES = [
+    (CAMERA_PUBLISH, CAMERA_UPDATE, False, 'plugin update -> publish'),
+    (CAMERA_CALLBACK, CAMERA_PUBLISH, False, 'publish -> camera callback'),
+    (TRANSFORM_DONE, CAMERA_CALLBACK, False, 'camera callback -> transform'),
+    (WAYPOINT_RESOLVED, TRANSFORM_DONE, False, 'transform -> waypoint resolved'),
+    (GOAL_SENT, WAYPOINT_RESOLVED, True, 'waypoint resolved -> goal sent'),
+    (GOAL_ACCEPTED, GOAL_SENT, True, 'goal sent -> goal accepted'),
+]
+
+
+def read_trace(path):
+    """Return the committed events of a trace file as (time_ns, id, stage, arg) tuples."""
+    with open(path, 'rb') as trace_file:
+        data = trace_file.read()
+    if len(data) < HEADER.size:
+        raise ValueError(f'{path}: not a trace file')
+    magic, version, record_size, capacity, head = HEADER.unpack_from(data, 0)
+    if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+        raise ValueError(f'{path}: not a trace file or unsupported version')
+    if len(data) < HEADER.size + capacity * RECORD.size:
+        raise ValueError(f'{path}: truncated')
+
+    events = []
+    # The buffer keeps the last capacity records, a record is complete when its commit matches
+    for position in range(max(0, head - capacity), head):
+        offset = HEADER.size + (position % capacity) * RECORD.size
+        time_ns, image_id, stage, _, arg, commit = RECORD.unpack_from(data, offset)
+        if commit == position + 1 and image_id != 0:
+            events.append((time_ns, image_id, stage, arg))
+    return events
+
+
+def match_stages(events):
+    """Match every event with its predecessor, return {event: previous event}."""
+    by_stage = {}
+    for event in events:
+        by_stage.setdefault(event[2], []).append(event)
+    for stage_events in by_stage.values():
+        stage_events.sort()
+
+    previous = {}
+    for stage, previous_stage, with_part, _ in STAGES:
+        candidates = {}
+        for event in by_stage.get(previous_stage, []):
+            key = (event[1], event[3]) if with_part else event[1]
+            candidates.setdefault(key, []).append(event)
+        times = {key: [event[0] for event in value] for key, value in candidates.items()}
+        for event in by_stage.get(stage, []):
+            key = (event[1], event[3]) if with_part else event[1]
+            if key not in times:
+                continue
+            index = bisect.bisect_right(times[key], event[0]) - 1
+            if index >= 0:
+                previous[event] = candidates[key][index]
+    return by_stage, previous
+
+
+def percentile(values, fraction):
+    index = min(len(values) - 1, int(fraction * len(values)))
+    return values[index]
+
+
+def print_distribution(name, latencies_ns):
+    if not latencies_ns:
+        print(f'{name:36s} {0:>8d}')
+        return
+    values = sorted(latency / 1e6 for latency in latencies_ns)
+    print(f'{name:36s} {len(values):>8d} {percentile(values, 0.5):>10.3f} {percentile(values, 0.9):>10.3f} '
+          f'{percentile(values, 0.99):>10.3f} {values[-1]:>10.3f}')
+
+
+def main(paths):
+    events = []
+    for path in paths:
+        events.extend(read_trace(path))
+    by_stage, previous = match_stages(events)
+
+    print(f'{"stage (ms)":36s} {"count":>8s} {"p50":>10s} {"p90":>10s} {"p99":>10s} {"max":>10s}')
+    for stage, _, _, name in STAGES:
+        print_distribution(name, [event[0] - previous[event][0]
+                                  for event in by_stage.get(stage, []) if event in previous])
+
+    # Follow the matches back to the camera update
+    end_to_end = []
+    for event in by_stage.get(GOAL_ACCEPTED, []):
+        first = event
+        while first in previous:
+            first = previous[first]
+        if first[2] == CAMERA_UPDATE:
+            end_to_end.append(event[0] - first[0])
+    print_distribution('plugin update -> goal accepted', end_to_end)
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+    main(sys.argv[1:])
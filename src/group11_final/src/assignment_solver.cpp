@@ -0,0 +1,225 @@
+#include "assignment_solver.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <limits>
+
+namespace
+{
+    /**
+     * @brief Solves a tall matrix (more rows than columns) transposed, with a solver that needs at least as many columns as rows.
+     *
+     */
+    template <typename Solver>
+    std::vector<long> solve_transposed(const std::vector<double> &costs, size_t rows, size_t cols, Solver solver)
+    {
+        std::vector<double> transposed(costs.size());
+        for (size_t i = 0; i < rows; ++i)
+        {
+            for (size_t j = 0; j < cols; ++j)
+            {
+                transposed[j * rows + i] = costs[i * cols + j];
+            }
+        }
+        std::vector<long> by_column = solver(transposed, cols, rows);
+        std::vector<long> assignment(rows, -1);
+        for (size_t j = 0; j < cols; ++j)
+        {
+            if (by_column[j] >= 0)
+            {
+                assignment[by_column[j]] = static_cast<long>(j);
+            }
+        }
+        return assignment;
+    }
+}
+
+std::vector<long> AssignmentSolver::hungarian(const std::vector<double> &costs, size_t rows, size_t cols)
+{
+    if (rows > cols)
+    {
+        return solve_transposed(costs, rows, cols, [](const std::vector<double> &c, size_t r, size_t k)
+                                { return hungarian(c, r, k); });
+    }
+
+    // Forbidden pairs get a cost larger than any assignment of allowed pairs and are dropped at the end
+    double largest = 0.0;
+    for (double cost : costs)
+    {
+        if (std::isfinite(cost))
+        {
+            largest = std::max(largest, std::abs(cost));
+        }
+    }
+    const double forbidden = (largest + 1.0) * static_cast<double>(rows + 1);
+    auto cost = [&](size_t i, size_t j)
+    {
+        double value = costs[i * cols + j];
+        return std::isfinite(value) ? value : forbidden;
+    };
+
+    // Rows and columns are counted from 1, column 0 is the virtual column the augmenting paths start from
+    const double infinity = std::numeric_limits<double>::infinity();
+    std::vector<double> row_potential(rows + 1, 0.0);
+    std::vector<double> column_potential(cols + 1, 0.0);
+    std::vector<size_t> column_row(cols + 1, 0);
+    std::vector<size_t> previous(cols + 1, 0);
+    for (size_t i = 1; i <= rows; ++i)
+    {
+        column_row[0] = i;
+        size_t column = 0;
+        std::vector<double> slack(cols + 1, infinity);
+        std::vector<uint8_t> visited(cols + 1, 0);
+        do
+        {
+            visited[column] = 1;
+            size_t row = column_row[column];
+            double delta = infinity;
+            size_t next = 0;
+            for (size_t j = 1; j <= cols; ++j)
+            {
+                if (visited[j])
+                {
+                    continue;
+                }
+                double reduced = cost(row - 1, j - 1) - row_potential[row] - column_potential[j];
+                if (reduced < slack[j])
+                {
+                    slack[j] = reduced;
+                    previous[j] = column;
+                }
+                if (slack[j] < delta)
+                {
+                    delta = slack[j];
+                    next = j;
+                }
+            }
+            for (size_t j = 0; j <= cols; ++j)
+            {
+                if (visited[j])
+                {
+                    row_potential[column_row[j]] += delta;
+                    column_potential[j] -= delta;
+                }
+                else
+                {
+                    slack[j] -= delta;
+                }
+            }
+            column = next;
+        } while (column_row[column] != 0);
+
+        // Flip the augmenting path
+        do
+        {
+            size_t before = previous[column];
+            column_row[column] = column_row[before];
+            column = before;
+        } while (column != 0);
+    }
+
+    std::vector<long> assignment(rows, -1);
+    for (size_t j = 1; j <= cols; ++j)
+    {
+        size_t row = column_row[j];
+        if (row != 0 && std::isfinite(costs[(row - 1) * cols + j - 1]))
+        {
+            assignment[row - 1] = static_cast<long>(j - 1);
+        }
+    }
+    return assignment;
+}
+
+std::vector<long> AssignmentSolver::auction(const std::vector<double> &costs, size_t rows, size_t cols, double epsilon)
+{
+    // The forward auction is only optimal when every row can be assigned, so the columns bid for a tall matrix
+    if (rows > cols)
+    {
+        return solve_transposed(costs, rows, cols, [epsilon](const std::vector<double> &c, size_t r, size_t k)
+                                { return auction(c, r, k, epsilon); });
+    }
+
+    // As in the Hungarian algorithm, forbidden pairs get a cost larger than any assignment of allowed pairs so that every row
+    // can be assigned, and are dropped at the end
+    double largest = 0.0;
+    for (double cost : costs)
+    {
+        if (std::isfinite(cost))
+        {
+            largest = std::max(largest, std::abs(cost));
+        }
+    }
+    const double forbidden = (largest + 1.0) * static_cast<double>(rows + 1);
+
+    std::vector<long> assignment(rows, -1);
+    std::vector<double> prices(cols, 0.0);
+    std::vector<long> owner(cols, -1);
+    std::deque<size_t> unassigned;
+    for (size_t i = 0; i < rows && cols > 0; ++i)
+    {
+        unassigned.push_back(i);
+    }
+
+    while (!unassigned.empty())
+    {
+        size_t row = unassigned.front();
+        unassigned.pop_front();
+
+        // Best and second best net value (benefit minus price) of the row
+        size_t best = 0;
+        double best_value = -std::numeric_limits<double>::infinity();
+        double second_value = best_value;
+        for (size_t j = 0; j < cols; ++j)
+        {
+            double cost = costs[row * cols + j];
+            double value = -(std::isfinite(cost) ? cost : forbidden) - prices[j];
+            if (value > best_value)
+            {
+                second_value = best_value;
+                best_value = value;
+                best = j;
+            }
+            else if (value > second_value)
+            {
+                second_value = value;
+            }
+        }
+        if (cols == 1)
+        {
+            second_value = best_value;
+        }
+
+        // The bid raises the price so that the row is indifferent between its two best columns, plus epsilon
+        prices[best] += best_value - second_value + epsilon;
+        if (owner[best] >= 0)
+        {
+            assignment[owner[best]] = -1;
+            unassigned.push_back(static_cast<size_t>(owner[best]));
+        }
+        owner[best] = static_cast<long>(row);
+        assignment[row] = static_cast<long>(best);
+    }
+
+    for (size_t i = 0; i < rows; ++i)
+    {
+        if (assignment[i] >= 0 && !std::isfinite(costs[i * cols + static_cast<size_t>(assignment[i])]))
+        {
+            assignment[i] = -1;
+        }
+    }
+    return assignment;
+}
+
+double AssignmentSolver::assignment_cost(const std::vector<double> &costs, size_t cols, const std::vector<long> &assignment)
+{
+    double total = 0.0;
+    for (size_t i = 0; i < assignment.size(); ++i)
+    {
+        if (assignment[i] >= 0)
+        {
+            total += costs[i * cols + static_cast<size_t>(assignment[i])];
+        }
+    }
+    return total;
+}
@@ -0,0 +1,255 @@
+#include "distance_field.hpp"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+
+namespace
+{
+    /**
+     * @brief 1D squared distance transform of a sampled function (lower envelope of parabolas).
+     *
+     * @param f sampled function, f.size() samples
+     * @param d squared distances, f.size() samples
+     * @param v scratch buffer of f.size() locations
+     * @param z scratch buffer of f.size() + 1 boundaries
+     */
+    void squared_distance_1d(const std::vector<double> &f, std::vector<double> &d, std::vector<int> &v, std::vector<double> &z)
+    {
+        const int n = static_cast<int>(f.size());
+        const double infinity = std::numeric_limits<double>::infinity();
+        int k = 0;
+        v[0] = 0;
+        z[0] = -infinity;
+        z[1] = infinity;
+        for (int q = 1; q < n; ++q)
+        {
+            double s = 0.0;
+            while (true)
+            {
+                int p = v[static_cast<size_t>(k)];
+                s = ((f[static_cast<size_t>(q)] + static_cast<double>(q) * q) - (f[static_cast<size_t>(p)] + static_cast<double>(p) * p)) / (2.0 * (q - p));
+                if (s > z[static_cast<size_t>(k)] || k == 0)
+                {
+                    break;
+                }
+                k--;
+            }
+            k++;
+            v[static_cast<size_t>(k)] = q;
+            z[static_cast<size_t>(k)] = s;
+            z[static_cast<size_t>(k) + 1] = infinity;
+        }
+
+        k = 0;
+        for (int q = 0; q < n; ++q)
+        {
+            while (z[static_cast<size_t>(k) + 1] < q)
+            {
+                k++;
+            }
+            int p = v[static_cast<size_t>(k)];
+            d[static_cast<size_t>(q)] = static_cast<double>(q - p) * (q - p) + f[static_cast<size_t>(p)];
+        }
+    }
+}
+
+DistanceField::DistanceField(const OccupancyGrid &grid, double max_clearance)
+    : width_(grid.width()),
+      height_(grid.height()),
+      resolution_(grid.resolution()),
+      max_clearance_(static_cast<float>(max_clearance)),
+      radius_(0)
+{
+    if (max_clearance_ < max_clearance)
+    {
+        max_clearance_ = std::nextafter(max_clearance_, std::numeric_limits<float>::infinity());
+    }
+    if (!std::isinf(max_clearance_))
+    {
+        radius_ = static_cast<int>(std::min(std::ceil(max_clearance / resolution_), static_cast<double>(width_ + height_)));
+    }
+    clearance_.assign(static_cast<size_t>(width_) * static_cast<size_t>(height_), 0.0f);
+    compute(grid, 0, 0, width_ - 1, height_ - 1, 0);
+}
+
+void DistanceField::update(const OccupancyGrid &grid, const std::vector<map_cell> &changed)
+{
+    reachable_.clear();
+    if (changed.empty())
+    {
+        return;
+    }
+    if (std::isinf(max_clearance_))
+    {
+        compute(grid, 0, 0, width_ - 1, height_ - 1, 0);
+        return;
+    }
+
+    // A capped clearance only depends on the cells within the cap, so only the cells within the cap of the changed cells change and
+    // they only need the cells within the cap around them
+    int x0 = width_;
+    int y0 = height_;
+    int x1 = -1;
+    int y1 = -1;
+    for (const auto &cell : changed)
+    {
+        x0 = std::min(x0, cell.x);
+        y0 = std::min(y0, cell.y);
+        x1 = std::max(x1, cell.x);
+        y1 = std::max(y1, cell.y);
+    }
+    compute(grid, std::max(0, x0 - radius_), std::max(0, y0 - radius_), std::min(width_ - 1, x1 + radius_),
+            std::min(height_ - 1, y1 + radius_), radius_);
+}
+
+void DistanceField::compute(const OccupancyGrid &grid, int x0, int y0, int x1, int y1, int margin)
+{
+    // Window of the cells the clearances are computed from
+    const int wx0 = std::max(0, x0 - margin);
+    const int wy0 = std::max(0, y0 - margin);
+    const int wx1 = std::min(width_ - 1, x1 + margin);
+    const int wy1 = std::min(height_ - 1, y1 + margin);
+    const size_t width = static_cast<size_t>(wx1 - wx0 + 1);
+    const size_t height = static_cast<size_t>(wy1 - wy0 + 1);
+    // Distance of the free cells outside the window, larger than any distance on the map
+    const float far = static_cast<float>(width_ + height_);
+
+    // 1 for the free cells, 0 for the others
+    std::vector<float> free(width * height);
+    for (size_t y = 0; y < height; ++y)
+    {
+        for (size_t x = 0; x < width; ++x)
+        {
+            free[y * width + x] = grid.is_free(wx0 + static_cast<int>(x), wy0 + static_cast<int>(y)) ? 1.0f : 0.0f;
+        }
+    }
+
+    // Column pass: distance to the closest blocked cell in the same column, the map border counts as blocked. Each sweep processes a
+    // whole row against the previous one, so the inner loops are branch free over contiguous memory.
+    const float top = wy0 == 0 ? 0.0f : far;
+    const float bottom = wy1 == height_ - 1 ? 0.0f : far;
+    std::vector<float> column(width * height);
+    for (size_t y = 0; y < height; ++y)
+    {
+        float *current = &column[y * width];
+        const float *mask = &free[y * width];
+        const float *previous = y > 0 ? &column[(y - 1) * width] : nullptr;
+        for (size_t x = 0; x < width; ++x)
+        {
+            current[x] = mask[x] * ((previous ? previous[x] : top) + 1.0f);
+        }
+    }
+    for (size_t y = height; y-- > 0;)
+    {
+        float *current = &column[y * width];
+        const float *next = y + 1 < height ? &column[(y + 1) * width] : nullptr;
+        for (size_t x = 0; x < width; ++x)
+        {
+            current[x] = std::min(current[x], (next ? next[x] : bottom) + 1.0f);
+        }
+    }
+
+    // Row pass: exact squared distance with the lower envelope of parabolas, with the cells on both sides of the row added
+    const double left = wx0 == 0 ? 0.0 : static_cast<double>(far) * far;
+    const double right = wx1 == width_ - 1 ? 0.0 : static_cast<double>(far) * far;
+    std::vector<double> f(width + 2), d(width + 2), z(width + 3);
+    std::vector<int> v(width + 2);
+    for (int y = y0; y <= y1; ++y)
+    {
+        const size_t row = static_cast<size_t>(y - wy0);
+        f[0] = left;
+        f[width + 1] = right;
+        for (size_t x = 0; x < width; ++x)
+        {
+            double c = column[row * width + x];
+            f[x + 1] = c * c;
+        }
+        squared_distance_1d(f, d, v, z);
+        for (int x = x0; x <= x1; ++x)
+        {
+            clearance_[static_cast<size_t>(y) * static_cast<size_t>(width_) + x] =
+                std::min(static_cast<float>(std::sqrt(d[static_cast<size_t>(x - wx0) + 1]) * resolution_), max_clearance_);
+        }
+    }
+}
+
+bool DistanceField::compute_reachable(const map_cell &start, double min_clearance)
+{
+    reachable_.assign(clearance_.size(), 0);
+
+    // Closest cell to start with enough clearance, within 2 m
+    map_cell seed = start;
+    if (clearance(start.x, start.y) < min_clearance)
+    {
+        int radius = static_cast<int>(std::ceil(2.0 / resolution_));
+        int best = std::numeric_limits<int>::max();
+        for (int dy = -radius; dy <= radius; ++dy)
+        {
+            for (int dx = -radius; dx <= radius; ++dx)
+            {
+                int distance = dx * dx + dy * dy;
+                if (distance < best && clearance(start.x + dx, start.y + dy) >= min_clearance)
+                {
+                    seed = map_cell{start.x + dx, start.y + dy};
+                    best = distance;
+                }
+            }
+        }
+        if (best == std::numeric_limits<int>::max())
+        {
+            reachable_.clear();
+            return false;
+        }
+    }
+
+    std::deque<map_cell> queue;
+    queue.push_back(seed);
+    reachable_[static_cast<size_t>(seed.y) * width_ + seed.x] = 1;
+    const int dx[] = {1, -1, 0, 0};
+    const int dy[] = {0, 0, 1, -1};
+    while (!queue.empty())
+    {
+        map_cell cell = queue.front();
+        queue.pop_front();
+        for (int k = 0; k < 4; ++k)
+        {
+            int nx = cell.x + dx[k];
+            int ny = cell.y + dy[k];
+            if (clearance(nx, ny) < min_clearance)
+            {
+                continue;
+            }
+            uint8_t &visited = reachable_[static_cast<size_t>(ny) * width_ + nx];
+            if (!visited)
+            {
+                visited = 1;
+                queue.push_back(map_cell{nx, ny});
+            }
+        }
+    }
+    return true;
+}
+
+bool DistanceField::standoff(const map_cell &target, double min_clearance, double max_radius, map_cell &goal) const
+{
+    int radius = static_cast<int>(std::ceil(max_radius / resolution_));
+    int best = radius * radius + 1;
+    for (int dy = -radius; dy <= radius; ++dy)
+    {
+        for (int dx = -radius; dx <= radius; ++dx)
+        {
+            int x = target.x + dx;
+            int y = target.y + dy;
+            int distance = dx * dx + dy * dy;
+            if (distance >= best || clearance(x, y) < min_clearance ||
+                (!reachable_.empty() && !reachable_[static_cast<size_t>(y) * width_ + x]))
+            {
+                continue;
+            }
+            goal = map_cell{x, y};
+            best = distance;
+        }
+    }
+    return best <= radius * radius;
+}
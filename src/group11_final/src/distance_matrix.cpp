@@ -0,0 +1,672 @@
+#include "distance_matrix.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <thread>
+
+namespace
+{
+    constexpr uint32_t straight_cost = 10;
+    constexpr uint32_t diagonal_cost = 14;
+    constexpr uint32_t bucket_count = diagonal_cost + 1;
+    constexpr uint32_t unreached = std::numeric_limits<uint32_t>::max();
+    constexpr size_t npos = std::numeric_limits<size_t>::max();
+    // Length of the path used for the arrival heading, in cost units (10 cells)
+    constexpr uint32_t heading_lookback = 10 * straight_cost;
+    // Memory for the distance fields of the tracked cells
+    constexpr size_t max_tracked_bytes = size_t(64) << 20;
+
+    /**
+     * @brief Offsets of the 8 neighbours of a cell in a grid with the given stride: straight moves first, then the diagonals as the
+     * sum of a horizontal and a vertical step.
+     *
+     */
+    struct neighbourhood
+    {
+        explicit neighbourhood(long stride)
+            : horizontal{1, 1, -1, -1},
+              vertical{stride, -stride, stride, -stride},
+              offsets{1, -1, stride, -stride, stride + 1, -stride + 1, stride - 1, -stride - 1}
+        {
+        }
+        std::array<long, 4> horizontal;
+        std::array<long, 4> vertical;
+        std::array<long, 8> offsets;
+    };
+}
+
+DistanceMatrix::DistanceMatrix(std::shared_ptr<const OccupancyGrid> grid, size_t threads, int snap_radius,
+                               std::shared_ptr<RouteCache> cache)
+    : grid_(std::move(grid)),
+      threads_(threads > 0 ? threads : std::max<size_t>(1, std::thread::hardware_concurrency())),
+      snap_radius_(snap_radius),
+      cache_(cache ? std::move(cache) : std::make_shared<RouteCache>(4096))
+{
+    clear();
+    // The threads are started once, the searches run on every dispatch and a thread creation costs about as much as a short search
+    for (size_t t = 1; t < threads_; ++t)
+    {
+        pool_.emplace_back(&DistanceMatrix::pool_thread, this);
+    }
+}
+
+DistanceMatrix::~DistanceMatrix()
+{
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        stopping_ = true;
+    }
+    job_ready_.notify_all();
+    for (auto &thread : pool_)
+    {
+        thread.join();
+    }
+}
+
+void DistanceMatrix::clear()
+{
+    map_hash_ = grid_->content_hash();
+    stride_ = static_cast<size_t>(grid_->width()) + 2;
+    passable_.assign(stride_ * (static_cast<size_t>(grid_->height()) + 2), 0);
+    for (int y = 0; y < grid_->height(); ++y)
+    {
+        for (int x = 0; x < grid_->width(); ++x)
+        {
+            passable_[padded_index(map_cell{x, y})] = grid_->is_free(x, y) ? 1 : 0;
+        }
+    }
+
+    // The tracked cells are searched again on the new map
+    tracked_limit_ = std::max<size_t>(1, max_tracked_bytes / (passable_.size() * sizeof(uint32_t)));
+    for (auto &tracked : tracked_)
+    {
+        tracked.snapped = snap(tracked.cell);
+        tracked.distances.clear();
+    }
+}
+
+DistanceMatrix::snapped_cell DistanceMatrix::snap(const map_cell &cell) const
+{
+    map_cell free;
+    if (!grid_->nearest_free(cell, snap_radius_, free))
+    {
+        return snapped_cell{npos, 0.0};
+    }
+    return snapped_cell{padded_index(free), std::hypot(free.x - cell.x, free.y - cell.y) * grid_->resolution()};
+}
+
+void DistanceMatrix::run_workers(size_t thread_count, const std::function<void()> &worker) const
+{
+    if (thread_count == 0)
+    {
+        return;
+    }
+    const size_t helpers = std::min(thread_count - 1, pool_.size());
+    if (helpers > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            job_ = &worker;
+            job_slots_ = helpers;
+            job_running_ = helpers;
+            job_generation_++;
+        }
+        job_ready_.notify_all();
+    }
+    worker();
+    if (helpers > 0)
+    {
+        std::unique_lock<std::mutex> lock(pool_mutex_);
+        job_done_.wait(lock, [this]
+                       { return job_running_ == 0; });
+        job_ = nullptr;
+    }
+}
+
+void DistanceMatrix::pool_thread() const
+{
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> lock(pool_mutex_);
+    while (true)
+    {
+        job_ready_.wait(lock, [this, generation]
+                        { return stopping_ || (job_generation_ != generation && job_slots_ > 0); });
+        if (stopping_)
+        {
+            return;
+        }
+        generation = job_generation_;
+        job_slots_--;
+        const std::function<void()> *job = job_;
+        lock.unlock();
+        (*job)();
+        lock.lock();
+        if (--job_running_ == 0)
+        {
+            job_done_.notify_one();
+        }
+    }
+}
+
+std::vector<double> DistanceMatrix::compute(const std::vector<map_cell> &cells, std::vector<double> *arrivals)
+{
+    const size_t size = cells.size();
+    const double infinity = std::numeric_limits<double>::infinity();
+    std::vector<double> costs(size * size, infinity);
+    std::vector<double> headings(size * size, std::numeric_limits<double>::quiet_NaN());
+    std::vector<RouteCache::route> routes(size * size);
+
+    std::vector<size_t> indices(size);
+    std::vector<snapped_cell> snapped(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        indices[i] = grid_->in_bounds(cells[i].x, cells[i].y) ? cell_index(cells[i]) : npos;
+        snapped[i] = snap(cells[i]);
+    }
+
+    // Fill the matrix from the cache and collect the sources that still have missing pairs
+    std::vector<size_t> sources;
+    for (size_t i = 0; i < size; ++i)
+    {
+        bool missing = false;
+        for (size_t j = 0; j < size; ++j)
+        {
+            RouteCache::route &route = routes[i * size + j];
+            if (indices[i] != npos && indices[j] != npos &&
+                cache_->find(map_hash_, static_cast<uint32_t>(indices[i]), static_cast<uint32_t>(indices[j]), route))
+            {
+                costs[i * size + j] = route.length;
+                headings[i * size + j] = route.arrival;
+            }
+            else if (snapped[i].index != npos && snapped[j].index != npos)
+            {
+                missing = true;
+            }
+        }
+        if (missing)
+        {
+            sources.push_back(i);
+        }
+    }
+
+    std::atomic<size_t> next_source(0);
+    auto worker = [&]()
+    {
+        std::vector<uint32_t> distances(passable_.size());
+        std::vector<uint32_t> target_stamps(distances.size(), 0);
+        uint32_t stamp = 0;
+        for (size_t k = next_source++; k < sources.size(); k = next_source++)
+        {
+            size_t i = sources[k];
+            search(snapped[i], snapped, distances, target_stamps, ++stamp, &routes[i * size]);
+        }
+    };
+
+    run_workers(std::min(threads_, sources.size()), worker);
+
+    for (size_t i : sources)
+    {
+        for (size_t j = 0; j < size; ++j)
+        {
+            // Pairs without a path are cached too, with an infinite length, so they are not searched again
+            const RouteCache::route &route = routes[i * size + j];
+            costs[i * size + j] = route.length;
+            headings[i * size + j] = route.arrival;
+            if (indices[i] != npos && indices[j] != npos)
+            {
+                cache_->insert(map_hash_, static_cast<uint32_t>(indices[i]), static_cast<uint32_t>(indices[j]), route);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        costs[i * size + i] = 0.0;
+    }
+    if (arrivals)
+    {
+        *arrivals = std::move(headings);
+    }
+    return costs;
+}
+
+void DistanceMatrix::search(const snapped_cell &source, const std::vector<snapped_cell> &targets, std::vector<uint32_t> &distances,
+                            std::vector<uint32_t> &target_stamps, uint32_t stamp, RouteCache::route *routes, bool complete) const
+{
+    const neighbourhood neighbours(static_cast<long>(stride_));
+    const auto &horizontal = neighbours.horizontal;
+    const auto &vertical = neighbours.vertical;
+    const auto &offsets = neighbours.offsets;
+
+    size_t remaining = 0;
+    for (const auto &target : targets)
+    {
+        if (target.index != npos && target_stamps[target.index] != stamp)
+        {
+            target_stamps[target.index] = stamp;
+            remaining++;
+        }
+    }
+
+    std::fill(distances.begin(), distances.end(), unreached);
+    std::array<std::vector<size_t>, bucket_count> buckets;
+    distances[source.index] = 0;
+    buckets[0].push_back(source.index);
+    size_t pending = 1;
+
+    for (uint32_t current = 0; pending > 0 && (complete || remaining > 0); ++current)
+    {
+        auto &bucket = buckets[current % bucket_count];
+        while (!bucket.empty())
+        {
+            size_t index = bucket.back();
+            bucket.pop_back();
+            pending--;
+            if (distances[index] != current)
+            {
+                continue;
+            }
+            if (target_stamps[index] == stamp)
+            {
+                target_stamps[index] = stamp - 1;
+                remaining--;
+            }
+
+            for (size_t k = 0; k < 8; ++k)
+            {
+                size_t neighbour = index + offsets[k];
+                if (!passable_[neighbour])
+                {
+                    continue;
+                }
+                // Diagonal moves may not cut the corner of an obstacle
+                if (k >= 4 && (!passable_[index + horizontal[k - 4]] || !passable_[index + vertical[k - 4]]))
+                {
+                    continue;
+                }
+                uint32_t distance = current + (k < 4 ? straight_cost : diagonal_cost);
+                if (distance < distances[neighbour])
+                {
+                    distances[neighbour] = distance;
+                    buckets[distance % bucket_count].push_back(neighbour);
+                    pending++;
+                }
+            }
+        }
+    }
+
+    for (size_t j = 0; j < targets.size(); ++j)
+    {
+        write_route(source, distances, targets[j], routes[j]);
+    }
+}
+
+void DistanceMatrix::write_route(const snapped_cell &source, const std::vector<uint32_t> &distances, const snapped_cell &target,
+                                 RouteCache::route &route) const
+{
+    route.length = std::numeric_limits<double>::infinity();
+    route.arrival = std::numeric_limits<double>::quiet_NaN();
+    route.has_waypoints = false;
+    route.waypoints.clear();
+    if (source.index != npos && target.index != npos && !distances.empty() && distances[target.index] != unreached)
+    {
+        route.length = source.offset + distances[target.index] * (grid_->resolution() / straight_cost) + target.offset;
+        trace(distances, target.index, route);
+    }
+}
+
+void DistanceMatrix::track(const std::vector<map_cell> &cells)
+{
+    for (const auto &cell : cells)
+    {
+        if (!grid_->in_bounds(cell.x, cell.y))
+        {
+            continue;
+        }
+        auto found = std::find_if(tracked_.begin(), tracked_.end(), [&](const tracked_cell &tracked)
+                                  { return tracked.cell.x == cell.x && tracked.cell.y == cell.y; });
+        tracked_cell entry = found != tracked_.end() ? std::move(*found) : tracked_cell{cell, snap(cell), {}};
+        if (found != tracked_.end())
+        {
+            tracked_.erase(found);
+        }
+        tracked_.push_back(std::move(entry));
+    }
+    if (tracked_.size() > tracked_limit_)
+    {
+        tracked_.erase(tracked_.begin(), tracked_.begin() + static_cast<long>(tracked_.size() - tracked_limit_));
+    }
+
+    // Search the new cells completely, the routes between two cells tracked before are already in the cache
+    const size_t size = tracked_.size();
+    std::vector<snapped_cell> targets(size);
+    std::vector<uint8_t> fresh(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        targets[i] = tracked_[i].snapped;
+        fresh[i] = tracked_[i].distances.empty() ? 1 : 0;
+    }
+    std::vector<RouteCache::route> routes(size * size);
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        std::vector<uint32_t> target_stamps(passable_.size(), 0);
+        uint32_t stamp = 0;
+        for (size_t i = next++; i < size; i = next++)
+        {
+            tracked_cell &source = tracked_[i];
+            if (fresh[i] && source.snapped.index != npos)
+            {
+                source.distances.resize(passable_.size());
+                search(source.snapped, targets, source.distances, target_stamps, ++stamp, &routes[i * size], true);
+                continue;
+            }
+            for (size_t j = 0; j < size; ++j)
+            {
+                write_route(source.snapped, source.distances, targets[j], routes[i * size + j]);
+            }
+        }
+    };
+    run_workers(std::min(threads_, size), worker);
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        for (size_t j = 0; j < size; ++j)
+        {
+            if (fresh[i] || fresh[j])
+            {
+                cache_->insert(map_hash_, static_cast<uint32_t>(cell_index(tracked_[i].cell)),
+                               static_cast<uint32_t>(cell_index(tracked_[j].cell)), routes[i * size + j]);
+            }
+        }
+    }
+}
+
+size_t DistanceMatrix::update(const std::vector<map_cell> &changed)
+{
+    std::vector<size_t> blocked;
+    std::vector<size_t> freed;
+    for (const auto &cell : changed)
+    {
+        if (!grid_->in_bounds(cell.x, cell.y))
+        {
+            continue;
+        }
+        size_t index = padded_index(cell);
+        uint8_t passable = grid_->is_free(cell.x, cell.y) ? 1 : 0;
+        if (passable_[index] != passable)
+        {
+            passable_[index] = passable;
+            (passable ? freed : blocked).push_back(index);
+        }
+    }
+    if (blocked.empty() && freed.empty())
+    {
+        return 0;
+    }
+    const uint64_t previous_hash = map_hash_;
+    map_hash_ = grid_->content_hash();
+
+    // A cell whose free cell changed is searched again from scratch
+    const size_t size = tracked_.size();
+    std::vector<snapped_cell> targets(size);
+    std::vector<uint8_t> moved(size, 0);
+    for (size_t i = 0; i < size; ++i)
+    {
+        snapped_cell snapped = snap(tracked_[i].cell);
+        if (snapped.index != tracked_[i].snapped.index)
+        {
+            moved[i] = 1;
+            tracked_[i].distances.clear();
+        }
+        tracked_[i].snapped = snapped;
+        targets[i] = snapped;
+    }
+
+    // The routes of the previous map are kept for the fields that do not change
+    std::vector<RouteCache::route> routes(size * size);
+    std::vector<uint8_t> cached(size * size, 0);
+    std::vector<double> previous(size * size, std::numeric_limits<double>::infinity());
+    for (size_t i = 0; i < size; ++i)
+    {
+        for (size_t j = 0; j < size; ++j)
+        {
+            RouteCache::route &route = routes[i * size + j];
+            if (cache_->find(previous_hash, static_cast<uint32_t>(cell_index(tracked_[i].cell)),
+                             static_cast<uint32_t>(cell_index(tracked_[j].cell)), route))
+            {
+                cached[i * size + j] = 1;
+                previous[i * size + j] = route.length;
+            }
+        }
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        std::vector<uint32_t> target_stamps(passable_.size(), 0);
+        uint32_t stamp = 0;
+        for (size_t i = next++; i < size; i = next++)
+        {
+            tracked_cell &source = tracked_[i];
+            if (source.snapped.index == npos)
+            {
+                source.distances.clear();
+            }
+            else if (source.distances.empty())
+            {
+                source.distances.resize(passable_.size());
+                search(source.snapped, targets, source.distances, target_stamps, ++stamp, &routes[i * size], true);
+                continue;
+            }
+            bool repaired = !source.distances.empty() && repair(source.snapped.index, blocked, freed, source.distances);
+            for (size_t j = 0; j < size; ++j)
+            {
+                if (repaired || moved[j] || !cached[i * size + j] || source.distances.empty())
+                {
+                    write_route(source.snapped, source.distances, targets[j], routes[i * size + j]);
+                }
+            }
+        }
+    };
+    run_workers(std::min(threads_, size), worker);
+
+    size_t changed_routes = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        for (size_t j = 0; j < size; ++j)
+        {
+            const RouteCache::route &route = routes[i * size + j];
+            cache_->insert(map_hash_, static_cast<uint32_t>(cell_index(tracked_[i].cell)),
+                           static_cast<uint32_t>(cell_index(tracked_[j].cell)), route);
+            if (i != j && route.length != previous[i * size + j])
+            {
+                changed_routes++;
+            }
+        }
+    }
+    return changed_routes;
+}
+
+bool DistanceMatrix::repair(size_t source, const std::vector<size_t> &blocked, const std::vector<size_t> &freed,
+                            std::vector<uint32_t> &distances) const
+{
+    const neighbourhood neighbours(static_cast<long>(stride_));
+    const auto &horizontal = neighbours.horizontal;
+    const auto &vertical = neighbours.vertical;
+    const auto &offsets = neighbours.offsets;
+
+    // Shortest distance of a cell through one of its neighbours, unreached when no neighbour has a distance
+    auto through_neighbours = [&](size_t index)
+    {
+        uint32_t best = unreached;
+        for (size_t k = 0; k < 8; ++k)
+        {
+            size_t neighbour = index - offsets[k];
+            if (distances[neighbour] == unreached || !passable_[neighbour])
+            {
+                continue;
+            }
+            if (k >= 4 && (!passable_[neighbour + horizontal[k - 4]] || !passable_[neighbour + vertical[k - 4]]))
+            {
+                continue;
+            }
+            best = std::min(best, distances[neighbour] + (k < 4 ? straight_cost : diagonal_cost));
+        }
+        return best;
+    };
+
+    // Reset the cells that no longer have a neighbour on a shortest path, starting from the blocked cells. A blocked cell is
+    // checked even without a distance since it can forbid the diagonal moves around its corners.
+    bool changed = false;
+    std::vector<size_t> reset(blocked);
+    for (size_t index : blocked)
+    {
+        changed |= distances[index] != unreached;
+        distances[index] = unreached;
+    }
+    for (size_t next = 0; next < reset.size(); ++next)
+    {
+        for (long offset : offsets)
+        {
+            size_t neighbour = reset[next] + offset;
+            if (neighbour == source || distances[neighbour] == unreached || !passable_[neighbour])
+            {
+                continue;
+            }
+            if (through_neighbours(neighbour) > distances[neighbour])
+            {
+                distances[neighbour] = unreached;
+                reset.push_back(neighbour);
+                changed = true;
+            }
+        }
+    }
+
+    // Search again from the reset cells and from the cells around the freed cells, which may get shorter paths
+    using entry = std::pair<uint32_t, size_t>;
+    std::priority_queue<entry, std::vector<entry>, std::greater<entry>> open;
+    auto seed = [&](size_t index)
+    {
+        if (index == source || !passable_[index])
+        {
+            return;
+        }
+        uint32_t distance = through_neighbours(index);
+        if (distance < distances[index])
+        {
+            distances[index] = distance;
+            open.emplace(distance, index);
+        }
+    };
+    for (size_t index : reset)
+    {
+        seed(index);
+    }
+    for (size_t index : freed)
+    {
+        seed(index);
+        for (long offset : offsets)
+        {
+            seed(index + offset);
+        }
+    }
+
+    while (!open.empty())
+    {
+        auto [distance, index] = open.top();
+        open.pop();
+        if (distance != distances[index])
+        {
+            continue;
+        }
+        changed = true;
+        for (size_t k = 0; k < 8; ++k)
+        {
+            size_t neighbour = index + offsets[k];
+            if (!passable_[neighbour])
+            {
+                continue;
+            }
+            if (k >= 4 && (!passable_[index + horizontal[k - 4]] || !passable_[index + vertical[k - 4]]))
+            {
+                continue;
+            }
+            uint32_t candidate = distance + (k < 4 ? straight_cost : diagonal_cost);
+            if (candidate < distances[neighbour])
+            {
+                distances[neighbour] = candidate;
+                open.emplace(candidate, neighbour);
+            }
+        }
+    }
+    return changed;
+}
+
+void DistanceMatrix::trace(const std::vector<uint32_t> &distances, size_t target, RouteCache::route &route) const
+{
+    const neighbourhood neighbours(static_cast<long>(stride_));
+    route.waypoints.assign(1, padded_cell(target));
+    size_t index = target;
+    size_t heading_from = target;
+    uint32_t walked = 0;
+    int direction = -1;
+
+    // Step to a neighbour on a shortest path, keeping the current direction when possible so the path has few turns
+    while (distances[index] > 0)
+    {
+        int step = -1;
+        for (int n = -1; n < 8 && step < 0; ++n)
+        {
+            int k = n < 0 ? direction : n;
+            if (k < 0)
+            {
+                continue;
+            }
+            size_t neighbour = index - neighbours.offsets[k];
+            uint32_t cost = k < 4 ? straight_cost : diagonal_cost;
+            if (k >= 4 && (!passable_[neighbour + neighbours.horizontal[k - 4]] || !passable_[neighbour + neighbours.vertical[k - 4]]))
+            {
+                continue;
+            }
+            if (distances[neighbour] != unreached && distances[neighbour] + cost == distances[index])
+            {
+                step = k;
+            }
+        }
+        if (step < 0)
+        {
+            break;
+        }
+        if (direction >= 0 && step != direction)
+        {
+            route.waypoints.push_back(padded_cell(index));
+        }
+        direction = step;
+        index -= neighbours.offsets[step];
+        if (walked < heading_lookback)
+        {
+            walked += step < 4 ? straight_cost : diagonal_cost;
+            heading_from = index;
+        }
+    }
+    if (index != target)
+    {
+        route.waypoints.push_back(padded_cell(index));
+    }
+    std::reverse(route.waypoints.begin(), route.waypoints.end());
+    route.has_waypoints = route.waypoints.size() <= RouteCache::max_waypoints;
+
+    if (heading_from == target)
+    {
+        route.arrival = std::numeric_limits<double>::quiet_NaN();
+        return;
+    }
+    long dx = static_cast<long>(target % stride_) - static_cast<long>(heading_from % stride_);
+    long dy = static_cast<long>(target / stride_) - static_cast<long>(heading_from / stride_);
+    route.arrival = std::atan2(static_cast<double>(dy), static_cast<double>(dx));
+}
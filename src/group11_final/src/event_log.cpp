@@ -0,0 +1,138 @@
+#include "event_log.hpp"
+#include <algorithm>
+
+namespace
+{
+    // How long the background thread sleeps when the ring buffer is empty
+    constexpr std::chrono::milliseconds poll_period(5);
+    constexpr std::chrono::seconds report_period(1);
+}
+
+EventLog::EventLog(size_t capacity, sink output)
+    : mask_(0),
+      head_(0),
+      tail_(0),
+      dropped_(0),
+      dropped_reported_(0),
+      output_(std::move(output)),
+      running_(false)
+{
+    size_t size = 1;
+    while (size < std::max<size_t>(capacity, 2))
+    {
+        size <<= 1;
+    }
+    ring_.resize(size);
+    mask_ = size - 1;
+}
+
+EventLog::~EventLog()
+{
+    if (running_.exchange(false))
+    {
+        thread_.join();
+    }
+}
+
+void EventLog::register_event(uint16_t event, const std::string &name, double max_rate, formatter format)
+{
+    if (event >= events_.size())
+    {
+        events_.resize(event + 1u);
+    }
+    event_info &info = events_[event];
+    info.name = name;
+    info.format = std::move(format);
+    info.max_rate = std::max(max_rate, 0.0);
+    info.tokens = info.max_rate;
+    info.refilled = std::chrono::steady_clock::now();
+}
+
+void EventLog::start()
+{
+    if (!running_.exchange(true))
+    {
+        thread_ = std::thread(&EventLog::run, this);
+    }
+}
+
+bool EventLog::push(const log_record &record)
+{
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) > mask_)
+    {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    ring_[head & mask_] = record;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+void EventLog::run()
+{
+    auto reported = std::chrono::steady_clock::now();
+    while (running_.load(std::memory_order_relaxed))
+    {
+        drain();
+        auto now = std::chrono::steady_clock::now();
+        if (now - reported >= report_period)
+        {
+            report();
+            reported = now;
+        }
+        std::this_thread::sleep_for(poll_period);
+    }
+    drain();
+    report();
+}
+
+void EventLog::drain()
+{
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t head = head_.load(std::memory_order_acquire);
+    for (; tail != head; ++tail)
+    {
+        log_record record = ring_[tail & mask_];
+        // The slot can be reused as soon as the record is copied
+        tail_.store(tail + 1, std::memory_order_release);
+        if (record.event >= events_.size() || !events_[record.event].format)
+        {
+            continue;
+        }
+
+        // Token bucket with a burst of one second of records
+        event_info &info = events_[record.event];
+        if (info.max_rate > 0.0)
+        {
+            auto now = std::chrono::steady_clock::now();
+            info.tokens = std::min(info.max_rate, info.tokens + info.max_rate * std::chrono::duration<double>(now - info.refilled).count());
+            info.refilled = now;
+            if (info.tokens < 1.0)
+            {
+                info.suppressed++;
+                continue;
+            }
+            info.tokens -= 1.0;
+        }
+        output_(info.format(record));
+    }
+}
+
+void EventLog::report()
+{
+    for (auto &info : events_)
+    {
+        if (info.suppressed > 0)
+        {
+            output_(std::to_string(info.suppressed) + " " + info.name + " messages suppressed by the rate limit");
+            info.suppressed = 0;
+        }
+    }
+    size_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != dropped_reported_)
+    {
+        output_(std::to_string(dropped - dropped_reported_) + " log messages dropped, the log buffer was full");
+        dropped_reported_ = dropped;
+    }
+}
@@ -0,0 +1,363 @@
+#include "grid_planner.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace
+{
+    // Directions counter clockwise from east, the even ones are straight and the odd ones diagonal
+    constexpr int direction_x[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+    constexpr int direction_y[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+    constexpr double diagonal = 1.4142135623730951;
+    // Jumps longer than this are split at an intermediate jump point so that they fit in the table
+    constexpr int max_jump = std::numeric_limits<int16_t>::max() - 1;
+
+    int sign(long value)
+    {
+        return (value > 0) - (value < 0);
+    }
+}
+
+inline int16_t GridPlanner::jump_entry(size_t index, int direction) const
+{
+    const long stride = static_cast<long>(stride_);
+    const size_t next = index + offsets_[direction];
+    if (!passable_[index] || !passable_[next])
+    {
+        return 0;
+    }
+    if (direction % 2 == 0)
+    {
+        // A cell is a jump point for a straight direction when it has a forced neighbour: a side cell that is free while the same
+        // side of the previous cell is blocked
+        const long side = -direction_y[direction] + direction_x[direction] * stride;
+        if ((passable_[next + side] && !passable_[index + side]) || (passable_[next - side] && !passable_[index - side]))
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        // Diagonal moves may not cut a corner, and they stop where one of their straight components has a jump point
+        if (!passable_[index + direction_x[direction]] || !passable_[index + direction_y[direction] * stride])
+        {
+            return 0;
+        }
+        if (jump_[next][(direction + 7) % 8] > 0 || jump_[next][(direction + 1) % 8] > 0)
+        {
+            return 1;
+        }
+    }
+    int steps = jump_[next][direction] > 0 ? jump_[next][direction] + 1 : jump_[next][direction] - 1;
+    // A jump that does not fit stops at the next cell, which then acts as a jump point
+    return static_cast<int16_t>(std::abs(steps) > max_jump ? 1 : steps);
+}
+
+GridPlanner::GridPlanner(std::shared_ptr<const OccupancyGrid> grid)
+    : grid_(std::move(grid)),
+      stamp_(0)
+{
+    rebuild();
+}
+
+void GridPlanner::rebuild()
+{
+    const int width = grid_->width();
+    const int height = grid_->height();
+    stride_ = static_cast<size_t>(width) + 2;
+    const size_t size = stride_ * (static_cast<size_t>(height) + 2);
+    const long stride = static_cast<long>(stride_);
+    for (int d = 0; d < 8; ++d)
+    {
+        offsets_[d] = direction_x[d] + direction_y[d] * stride;
+    }
+
+    passable_.assign(size, 0);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            passable_[padded_index(map_cell{x, y})] = grid_->is_free(x, y) ? 1 : 0;
+        }
+    }
+
+    jump_.assign(size, std::array<int16_t, 8>{});
+    // The straight directions come first because the diagonal jumps stop at the cells where one of their straight components has a
+    // jump point
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (int d = pass; d < 8; d += 2)
+        {
+            // Cells are visited so that the next cell in direction d is always done first
+            const int y_begin = direction_y[d] > 0 ? height - 1 : 0;
+            const int y_step = direction_y[d] > 0 ? -1 : 1;
+            const int x_begin = direction_x[d] > 0 ? width - 1 : 0;
+            const int x_step = direction_x[d] > 0 ? -1 : 1;
+            for (int y = y_begin; y >= 0 && y < height; y += y_step)
+            {
+                for (int x = x_begin; x >= 0 && x < width; x += x_step)
+                {
+                    const size_t index = padded_index(map_cell{x, y});
+                    if (passable_[index])
+                    {
+                        jump_[index][d] = jump_entry(index, d);
+                    }
+                }
+            }
+        }
+    }
+
+    stamps_.assign(size, 0);
+    costs_.assign(size, 0.0);
+    parents_.assign(size, 0);
+    directions_.assign(size, -1);
+    closed_.assign(size, 0);
+    stamp_ = 0;
+}
+
+void GridPlanner::update(int x0, int y0, int x1, int y1)
+{
+    const int width = grid_->width();
+    const int height = grid_->height();
+    x0 = std::max(0, x0);
+    y0 = std::max(0, y0);
+    x1 = std::min(width - 1, x1);
+    y1 = std::min(height - 1, y1);
+    if (x0 > x1 || y0 > y1)
+    {
+        return;
+    }
+    for (int y = y0; y <= y1; ++y)
+    {
+        for (int x = x0; x <= x1; ++x)
+        {
+            passable_[padded_index(map_cell{x, y})] = grid_->is_free(x, y) ? 1 : 0;
+        }
+    }
+
+    // The straight entries read the cells on both sides and the diagonal entries the straight entries of the next cell, so the rows
+    // and columns up to two cells around the box are recomputed. The entries outside them only change through the next cell in
+    // their direction, so the cells before a changed entry are walked back until their entry stays the same.
+    const int row_begin = std::max(0, y0 - 2);
+    const int row_end = std::min(height - 1, y1 + 2);
+    const int column_begin = std::max(0, x0 - 2);
+    const int column_end = std::min(width - 1, x1 + 2);
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (int d = pass; d < 8; d += 2)
+        {
+            const long offset = offsets_[d];
+            auto recompute = [this, d, offset](int x, int y)
+            {
+                size_t index = padded_index(map_cell{x, y});
+                int16_t entry = jump_entry(index, d);
+                while (entry != jump_[index][d])
+                {
+                    jump_[index][d] = entry;
+                    index -= offset;
+                    if (!passable_[index])
+                    {
+                        break;
+                    }
+                    entry = jump_entry(index, d);
+                }
+            };
+
+            // Same order as rebuild, so that the next cell in direction d is always done first
+            const int y_begin = direction_y[d] > 0 ? height - 1 : 0;
+            const int y_step = direction_y[d] > 0 ? -1 : 1;
+            const bool x_reverse = direction_x[d] > 0;
+            for (int y = y_begin; y >= 0 && y < height; y += y_step)
+            {
+                const bool full_row = y >= row_begin && y <= row_end;
+                const int begin = full_row ? 0 : column_begin;
+                const int end = full_row ? width - 1 : column_end;
+                for (int i = 0; i <= end - begin; ++i)
+                {
+                    recompute(x_reverse ? end - i : begin + i, y);
+                }
+            }
+        }
+    }
+}
+
+bool GridPlanner::begin_query(const map_cell &start, const map_cell &goal, result &query)
+{
+    query = result();
+    if (!grid_->is_free(start.x, start.y) || !grid_->is_free(goal.x, goal.y))
+    {
+        return false;
+    }
+    if (++stamp_ == 0)
+    {
+        std::fill(stamps_.begin(), stamps_.end(), 0);
+        stamp_ = 1;
+    }
+    open_.clear();
+    return true;
+}
+
+double GridPlanner::heuristic(size_t index, size_t goal) const
+{
+    double dx = std::abs(static_cast<long>(index % stride_) - static_cast<long>(goal % stride_));
+    double dy = std::abs(static_cast<long>(index / stride_) - static_cast<long>(goal / stride_));
+    return std::max(dx, dy) + (diagonal - 1.0) * std::min(dx, dy);
+}
+
+void GridPlanner::relax(size_t index, size_t parent, int direction, double cost, size_t goal)
+{
+    if (stamps_[index] == stamp_ && cost >= costs_[index])
+    {
+        return;
+    }
+    if (stamps_[index] != stamp_)
+    {
+        stamps_[index] = stamp_;
+        closed_[index] = 0;
+    }
+    costs_[index] = cost;
+    parents_[index] = parent;
+    directions_[index] = static_cast<int8_t>(direction);
+    open_.push_back(open_entry{cost + heuristic(index, goal), index});
+    std::push_heap(open_.begin(), open_.end(), std::greater<open_entry>());
+}
+
+GridPlanner::result GridPlanner::astar(const map_cell &start, const map_cell &goal)
+{
+    result query;
+    if (!begin_query(start, goal, query))
+    {
+        return query;
+    }
+
+    const size_t source = padded_index(start);
+    const size_t target = padded_index(goal);
+    relax(source, source, -1, 0.0, target);
+    while (!open_.empty())
+    {
+        std::pop_heap(open_.begin(), open_.end(), std::greater<open_entry>());
+        size_t index = open_.back().index;
+        open_.pop_back();
+        if (closed_[index])
+        {
+            continue;
+        }
+        closed_[index] = 1;
+        query.expansions++;
+        if (index == target)
+        {
+            build_path(source, target, query);
+            return query;
+        }
+
+        for (int d = 0; d < 8; ++d)
+        {
+            size_t next = index + offsets_[d];
+            if (!passable_[next] || (d % 2 == 1 && (!passable_[index + direction_x[d]] ||
+                                                   !passable_[index + (offsets_[d] - direction_x[d])])))
+            {
+                continue;
+            }
+            if (stamps_[next] == stamp_ && closed_[next])
+            {
+                continue;
+            }
+            relax(next, index, d, costs_[index] + (d % 2 == 0 ? 1.0 : diagonal), target);
+        }
+    }
+    return query;
+}
+
+GridPlanner::result GridPlanner::jps(const map_cell &start, const map_cell &goal)
+{
+    result query;
+    if (!begin_query(start, goal, query))
+    {
+        return query;
+    }
+
+    const size_t source = padded_index(start);
+    const size_t target = padded_index(goal);
+    const long goal_x = static_cast<long>(target % stride_);
+    const long goal_y = static_cast<long>(target / stride_);
+    relax(source, source, -1, 0.0, target);
+    while (!open_.empty())
+    {
+        std::pop_heap(open_.begin(), open_.end(), std::greater<open_entry>());
+        size_t index = open_.back().index;
+        open_.pop_back();
+        if (closed_[index])
+        {
+            continue;
+        }
+        closed_[index] = 1;
+        query.expansions++;
+        if (index == target)
+        {
+            build_path(source, target, query);
+            return query;
+        }
+
+        // The start explores all the directions, a straight arrival the 5 forward ones and a diagonal arrival the 3 forward ones
+        const int arrival = directions_[index];
+        const int spread = arrival < 0 ? 4 : (arrival % 2 == 0 ? 2 : 1);
+        const int first = arrival < 0 ? 0 : arrival - spread;
+        const int last = arrival < 0 ? 7 : arrival + spread;
+        const long delta_x = goal_x - static_cast<long>(index % stride_);
+        const long delta_y = goal_y - static_cast<long>(index / stride_);
+
+        for (int k = first; k <= last; ++k)
+        {
+            const int d = (k + 8) % 8;
+            const int jump = jump_[index][d];
+            const bool straight = d % 2 == 0;
+            const bool towards_goal = sign(delta_x) == direction_x[d] && sign(delta_y) == direction_y[d];
+
+            long steps = 0;
+            if (straight && towards_goal && std::max(std::abs(delta_x), std::abs(delta_y)) <= std::abs(jump))
+            {
+                // The goal is on the ray before the next jump point or the wall
+                steps = std::max(std::abs(delta_x), std::abs(delta_y));
+            }
+            else if (!straight && towards_goal && std::min(std::abs(delta_x), std::abs(delta_y)) <= std::abs(jump))
+            {
+                // Stop where the ray crosses the row or column of the goal, the straight jump from there can reach it
+                steps = std::min(std::abs(delta_x), std::abs(delta_y));
+            }
+            else if (jump > 0)
+            {
+                steps = jump;
+            }
+            else
+            {
+                continue;
+            }
+
+            const size_t next = index + steps * offsets_[d];
+            if (stamps_[next] == stamp_ && closed_[next])
+            {
+                continue;
+            }
+            relax(next, index, d, costs_[index] + steps * (straight ? 1.0 : diagonal), target);
+        }
+    }
+    return query;
+}
+
+void GridPlanner::build_path(size_t start, size_t goal, result &query) const
+{
+    query.found = true;
+    query.length = costs_[goal] * grid_->resolution();
+
+    for (size_t index = goal; index != start; index = parents_[index])
+    {
+        // Every cell from this node back to its parent, the parent is added by the next segment
+        const long offset = offsets_[directions_[index]];
+        for (size_t cell = index; cell != parents_[index]; cell -= offset)
+        {
+            query.path.push_back(map_cell{static_cast<int>(cell % stride_) - 1, static_cast<int>(cell / stride_) - 1});
+        }
+    }
+    query.path.push_back(map_cell{static_cast<int>(start % stride_) - 1, static_cast<int>(start / stride_) - 1});
+    std::reverse(query.path.begin(), query.path.end());
+}
@@ -0,0 +1,233 @@
+/**
+ * @file grid_planner_benchmark.cpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief Benchmark of the A*, JPS+ and HPA* planners on a Nav2 map and on a large map made of tiled copies of it.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * Usage: grid_planner_benchmark <map_yaml> [queries] [tiles] [seed]
+ */
+#include "grid_planner.hpp"
+#include "hierarchical_planner.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    /**
+     * @brief  struct to store the statistics of one planner
+     *
+     */
+    struct planner_statistics
+    {
+        std::vector<double> times;  // query times in milliseconds
+        double expansions = 0.0;
+        size_t found = 0;
+        double excess = 0.0;  // sum of the relative excess length over the shortest path
+    };
+
+    double elapsed_ms(const clock_type::time_point &start)
+    {
+        return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+    }
+
+    double percentile(std::vector<double> values, double fraction)
+    {
+        if (values.empty())
+        {
+            return 0.0;
+        }
+        size_t rank = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+        std::nth_element(values.begin(), values.begin() + rank, values.end());
+        return values[rank];
+    }
+
+    void print_statistics(const char *name, const planner_statistics &statistics, size_t queries)
+    {
+        double total = 0.0;
+        for (double time : statistics.times)
+        {
+            total += time;
+        }
+        std::printf("  %-5s mean %9.4f ms  p50 %9.4f ms  p95 %9.4f ms  expansions %10.1f  found %zu/%zu  excess %6.2f %%\n", name,
+                    total / std::max<size_t>(1, queries), percentile(statistics.times, 0.5), percentile(statistics.times, 0.95),
+                    statistics.expansions / std::max<size_t>(1, queries), statistics.found, queries,
+                    100.0 * statistics.excess / std::max<size_t>(1, statistics.found));
+    }
+
+    /**
+     * @brief Builds a map of tiles x tiles copies of a map. A corridor is cleared through the middle of every row and column of
+     * tiles so that the copies are connected.
+     *
+     */
+    std::shared_ptr<OccupancyGrid> tile_map(const OccupancyGrid &map, int tiles)
+    {
+        const int width = map.width() * tiles;
+        const int height = map.height() * tiles;
+        auto tiled = std::make_shared<OccupancyGrid>(width, height, map.resolution(), map.origin_x(), map.origin_y());
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                tiled->set_state(x, y, map.state(x % map.width(), y % map.height()));
+            }
+        }
+
+        const int corridor = 3;
+        for (int t = 0; t < tiles; ++t)
+        {
+            int row = t * map.height() + map.height() / 2;
+            int column = t * map.width() + map.width() / 2;
+            for (int k = -corridor; k <= corridor; ++k)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    tiled->set_state(x, row + k, cell_state::free);
+                }
+                for (int y = 0; y < height; ++y)
+                {
+                    tiled->set_state(column + k, y, cell_state::free);
+                }
+            }
+        }
+        return tiled;
+    }
+
+    /**
+     * @brief Runs the same random queries with all the planners and prints the statistics. Then times the update of the jump table
+     * and of the abstract graph after a block of cells is blocked and freed again.
+     *
+     */
+    void run(const std::string &name, std::shared_ptr<OccupancyGrid> map, size_t queries, std::mt19937 &rng)
+    {
+        std::vector<map_cell> free_cells;
+        for (int y = 0; y < map->height(); ++y)
+        {
+            for (int x = 0; x < map->width(); ++x)
+            {
+                if (map->is_free(x, y))
+                {
+                    free_cells.push_back(map_cell{x, y});
+                }
+            }
+        }
+        std::printf("%s: %d x %d cells, %zu free\n", name.c_str(), map->width(), map->height(), free_cells.size());
+        if (free_cells.empty())
+        {
+            return;
+        }
+
+        auto start = clock_type::now();
+        GridPlanner planner(map);
+        std::printf("  jump table: %.2f ms, %.2f MB\n", elapsed_ms(start), planner.jump_table_size() / 1048576.0);
+        start = clock_type::now();
+        HierarchicalPlanner hierarchy(map);
+        std::printf("  abstract graph: %.2f ms, %zu nodes\n", elapsed_ms(start), hierarchy.node_count());
+
+        std::uniform_int_distribution<size_t> pick(0, free_cells.size() - 1);
+        planner_statistics astar, jps, hpa;
+        size_t mismatches = 0;
+        for (size_t q = 0; q < queries; ++q)
+        {
+            map_cell from = free_cells[pick(rng)];
+            map_cell to = free_cells[pick(rng)];
+
+            start = clock_type::now();
+            GridPlanner::result reference = planner.astar(from, to);
+            astar.times.push_back(elapsed_ms(start));
+            astar.expansions += reference.expansions;
+            astar.found += reference.found;
+
+            start = clock_type::now();
+            GridPlanner::result jump = planner.jps(from, to);
+            jps.times.push_back(elapsed_ms(start));
+            jps.expansions += jump.expansions;
+            jps.found += jump.found;
+
+            if (reference.found != jump.found || (reference.found && std::abs(reference.length - jump.length) > 1e-6))
+            {
+                mismatches++;
+            }
+
+            start = clock_type::now();
+            HierarchicalPlanner::result route = hierarchy.route(from, to);
+            hpa.times.push_back(elapsed_ms(start));
+            hpa.expansions += route.expansions;
+            hpa.found += route.found;
+            if (route.found && reference.found && reference.length > 0.0)
+            {
+                hpa.excess += route.length / reference.length - 1.0;
+            }
+        }
+
+        print_statistics("A*", astar, queries);
+        print_statistics("JPS+", jps, queries);
+        print_statistics("HPA*", hpa, queries);
+        std::printf("  JPS+ path length mismatches: %zu\n", mismatches);
+
+        // Block a 10 x 10 cells region around a free cell, then free it again
+        map_cell center = free_cells[pick(rng)];
+        std::vector<cell_state> saved;
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            for (int y = center.y - 5; y < center.y + 5; ++y)
+            {
+                for (int x = center.x - 5; x < center.x + 5; ++x)
+                {
+                    if (pass == 0)
+                    {
+                        saved.push_back(map->state(x, y));
+                        map->set_state(x, y, cell_state::occupied);
+                    }
+                    else
+                    {
+                        map->set_state(x, y, saved[static_cast<size_t>(y - center.y + 5) * 10 + (x - center.x + 5)]);
+                    }
+                }
+            }
+            start = clock_type::now();
+            planner.update(center.x - 5, center.y - 5, center.x + 4, center.y + 4);
+            std::printf("  jump table update (%s 10 x 10 cells): %.3f ms\n", pass == 0 ? "block" : "free", elapsed_ms(start));
+            start = clock_type::now();
+            hierarchy.update(center.x - 5, center.y - 5, center.x + 4, center.y + 4);
+            std::printf("  abstract graph update (%s 10 x 10 cells): %.3f ms\n", pass == 0 ? "block" : "free", elapsed_ms(start));
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "Usage: %s <map_yaml> [queries] [tiles] [seed]\n", argv[0]);
+        return 1;
+    }
+    size_t queries = argc > 2 ? std::stoul(argv[2]) : 1000;
+    int tiles = argc > 3 ? std::stoi(argv[3]) : 8;
+    std::mt19937 rng(argc > 4 ? static_cast<unsigned>(std::stoul(argv[4])) : 1u);
+
+    try
+    {
+        auto map = std::make_shared<OccupancyGrid>(OccupancyGrid::load(argv[1]));
+        run(argv[1], map, queries, rng);
+        if (tiles > 1)
+        {
+            run(std::to_string(tiles) + " x " + std::to_string(tiles) + " tiles", tile_map(*map, tiles), queries, rng);
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        std::fprintf(stderr, "%s\n", ex.what());
+        return 1;
+    }
+    return 0;
+}
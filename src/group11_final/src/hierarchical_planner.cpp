@@ -0,0 +1,546 @@
+#include "hierarchical_planner.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <tuple>
+
+namespace
+{
+    constexpr int direction_x[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+    constexpr int direction_y[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+    constexpr double diagonal = 1.4142135623730951;
+    // Entrances at least this long get a transition at each end instead of one in the middle
+    constexpr int long_entrance = 6;
+
+    double octile(const map_cell &from, const map_cell &to)
+    {
+        double dx = std::abs(from.x - to.x);
+        double dy = std::abs(from.y - to.y);
+        return std::max(dx, dy) + (diagonal - 1.0) * std::min(dx, dy);
+    }
+
+    template <typename Edges>
+    void erase_edges_to(Edges &edges, size_t target)
+    {
+        edges.erase(std::remove_if(edges.begin(), edges.end(), [target](const auto &edge)
+                                   { return edge.target == target; }),
+                    edges.end());
+    }
+}
+
+HierarchicalPlanner::HierarchicalPlanner(std::shared_ptr<const OccupancyGrid> grid, int cluster_size)
+    : grid_(std::move(grid)),
+      cluster_size_(std::max(2, cluster_size)),
+      loaded_cluster_(std::numeric_limits<size_t>::max()),
+      cluster_stamp_(0),
+      stamp_(0)
+{
+    clusters_x_ = static_cast<size_t>((grid_->width() + cluster_size_ - 1) / cluster_size_);
+    clusters_y_ = static_cast<size_t>((grid_->height() + cluster_size_ - 1) / cluster_size_);
+    cluster_nodes_.resize(clusters_x_ * clusters_y_);
+    border_transitions_.resize(2 * clusters_x_ * clusters_y_);
+
+    const size_t cluster_cells = static_cast<size_t>(cluster_size_ + 2) * (cluster_size_ + 2);
+    cluster_free_.resize(cluster_cells);
+    cluster_costs_.resize(cluster_cells);
+    cluster_parents_.resize(cluster_cells);
+    cluster_targets_.resize(cluster_cells, 0);
+
+    update(0, 0, grid_->width() - 1, grid_->height() - 1);
+}
+
+bool HierarchicalPlanner::update(int x0, int y0, int x1, int y1)
+{
+    if (clusters_x_ == 0 || clusters_y_ == 0)
+    {
+        return false;
+    }
+
+    // A changed cell next to a border changes the entrances of the clusters on both sides
+    const int cx0 = std::max(0, std::min(x0, x1) - 1) / cluster_size_;
+    const int cy0 = std::max(0, std::min(y0, y1) - 1) / cluster_size_;
+    const int cx1 = std::min(static_cast<int>(clusters_x_) - 1, (std::max(x0, x1) + 1) / cluster_size_);
+    const int cy1 = std::min(static_cast<int>(clusters_y_) - 1, (std::max(y0, y1) + 1) / cluster_size_);
+    if (cx0 > cx1 || cy0 > cy1)
+    {
+        return false;
+    }
+    loaded_cluster_ = std::numeric_limits<size_t>::max();
+
+    // The borders of the changed clusters, then every cluster next to one of these borders
+    std::vector<uint8_t> borders(border_transitions_.size(), 0);
+    std::vector<uint8_t> clusters(cluster_nodes_.size(), 0);
+    for (int cy = cy0; cy <= cy1; ++cy)
+    {
+        for (int cx = cx0; cx <= cx1; ++cx)
+        {
+            size_t cluster = static_cast<size_t>(cy) * clusters_x_ + cx;
+            borders[2 * cluster] = borders[2 * cluster + 1] = 1;
+            clusters[cluster] = 1;
+            if (cx > 0)
+            {
+                borders[2 * (cluster - 1)] = 1;
+                clusters[cluster - 1] = 1;
+            }
+            if (cy > 0)
+            {
+                borders[2 * (cluster - clusters_x_) + 1] = 1;
+                clusters[cluster - clusters_x_] = 1;
+            }
+            if (static_cast<size_t>(cx) + 1 < clusters_x_)
+            {
+                clusters[cluster + 1] = 1;
+            }
+            if (static_cast<size_t>(cy) + 1 < clusters_y_)
+            {
+                clusters[cluster + clusters_x_] = 1;
+            }
+        }
+    }
+
+    // The transitions of the borders and the edges inside the clusters by cell, node indices are reused when nodes are released
+    auto graph_edges = [&]()
+    {
+        std::vector<std::tuple<size_t, size_t, double>> edges;
+        for (size_t border = 0; border < borders.size(); ++border)
+        {
+            if (!borders[border])
+            {
+                continue;
+            }
+            for (const auto &transition : border_transitions_[border])
+            {
+                edges.emplace_back(cell_index(nodes_[transition.first].cell), cell_index(nodes_[transition.second].cell), 1.0);
+            }
+        }
+        for (size_t cluster = 0; cluster < clusters.size(); ++cluster)
+        {
+            if (!clusters[cluster])
+            {
+                continue;
+            }
+            for (size_t node : cluster_nodes_[cluster])
+            {
+                for (const auto &edge : nodes_[node].edges)
+                {
+                    if (nodes_[edge.target].cluster == cluster)
+                    {
+                        edges.emplace_back(cell_index(nodes_[node].cell), cell_index(nodes_[edge.target].cell), edge.cost);
+                    }
+                }
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        return edges;
+    };
+    const auto previous = graph_edges();
+
+    for (size_t border = 0; border < borders.size(); ++border)
+    {
+        if (borders[border])
+        {
+            build_border(border);
+        }
+    }
+    for (size_t cluster = 0; cluster < clusters.size(); ++cluster)
+    {
+        if (clusters[cluster])
+        {
+            build_cluster(cluster);
+        }
+    }
+    return graph_edges() != previous;
+}
+
+void HierarchicalPlanner::build_border(size_t border)
+{
+    for (const auto &transition : border_transitions_[border])
+    {
+        erase_edges_to(nodes_[transition.first].edges, transition.second);
+        erase_edges_to(nodes_[transition.second].edges, transition.first);
+        release_node(transition.first);
+        release_node(transition.second);
+    }
+    border_transitions_[border].clear();
+
+    const size_t cluster = border / 2;
+    const bool east = border % 2 == 0;
+    const int cx = static_cast<int>(cluster % clusters_x_);
+    const int cy = static_cast<int>(cluster / clusters_x_);
+    if ((east && static_cast<size_t>(cx) + 1 >= clusters_x_) || (!east && static_cast<size_t>(cy) + 1 >= clusters_y_))
+    {
+        return;
+    }
+
+    // Cells of the cluster along the border and the step to the facing cell of the neighbour cluster
+    const int along_x = east ? 0 : 1;
+    const int along_y = east ? 1 : 0;
+    const map_cell first = east ? map_cell{(cx + 1) * cluster_size_ - 1, cy * cluster_size_}
+                                : map_cell{cx * cluster_size_, (cy + 1) * cluster_size_ - 1};
+    const int length = east ? std::min(cluster_size_, grid_->height() - first.y) : std::min(cluster_size_, grid_->width() - first.x);
+    const map_cell across = east ? map_cell{1, 0} : map_cell{0, 1};
+
+    auto open = [&](int k)
+    {
+        int x = first.x + k * along_x;
+        int y = first.y + k * along_y;
+        return grid_->is_free(x, y) && grid_->is_free(x + across.x, y + across.y);
+    };
+    auto place = [&](int k)
+    {
+        map_cell inside{first.x + k * along_x, first.y + k * along_y};
+        map_cell outside{inside.x + across.x, inside.y + across.y};
+        size_t a = acquire_node(inside);
+        size_t b = acquire_node(outside);
+        nodes_[a].edges.push_back(abstract_edge{b, 1.0});
+        nodes_[b].edges.push_back(abstract_edge{a, 1.0});
+        border_transitions_[border].emplace_back(a, b);
+    };
+
+    for (int k = 0; k < length;)
+    {
+        if (!open(k))
+        {
+            k++;
+            continue;
+        }
+        int end = k;
+        while (end + 1 < length && open(end + 1))
+        {
+            end++;
+        }
+        if (end - k + 1 < long_entrance)
+        {
+            place((k + end) / 2);
+        }
+        else
+        {
+            place(k);
+            place(end);
+        }
+        k = end + 1;
+    }
+}
+
+void HierarchicalPlanner::build_cluster(size_t cluster)
+{
+    const auto &members = cluster_nodes_[cluster];
+    for (size_t node : members)
+    {
+        auto &edges = nodes_[node].edges;
+        edges.erase(std::remove_if(edges.begin(), edges.end(), [&](const abstract_edge &edge)
+                                   { return nodes_[edge.target].cluster == cluster; }),
+                    edges.end());
+    }
+
+    for (size_t i = 0; i < members.size(); ++i)
+    {
+        search_cluster(cluster, nodes_[members[i]].cell);
+        for (size_t j = i + 1; j < members.size(); ++j)
+        {
+            double cost = cluster_cost(nodes_[members[j]].cell);
+            if (std::isfinite(cost))
+            {
+                nodes_[members[i]].edges.push_back(abstract_edge{members[j], cost});
+                nodes_[members[j]].edges.push_back(abstract_edge{members[i], cost});
+            }
+        }
+    }
+}
+
+size_t HierarchicalPlanner::acquire_node(const map_cell &cell)
+{
+    auto existing = node_at_.find(cell_index(cell));
+    if (existing != node_at_.end())
+    {
+        nodes_[existing->second].references++;
+        return existing->second;
+    }
+
+    size_t node;
+    if (!free_nodes_.empty())
+    {
+        node = free_nodes_.back();
+        free_nodes_.pop_back();
+    }
+    else
+    {
+        node = nodes_.size();
+        nodes_.emplace_back();
+    }
+    nodes_[node].cell = cell;
+    nodes_[node].cluster = cluster_of(cell);
+    nodes_[node].references = 1;
+    nodes_[node].edges.clear();
+    cluster_nodes_[nodes_[node].cluster].push_back(node);
+    node_at_[cell_index(cell)] = node;
+    return node;
+}
+
+void HierarchicalPlanner::release_node(size_t node)
+{
+    auto &released = nodes_[node];
+    if (--released.references > 0)
+    {
+        return;
+    }
+    for (const auto &edge : released.edges)
+    {
+        erase_edges_to(nodes_[edge.target].edges, node);
+    }
+    released.edges.clear();
+    auto &members = cluster_nodes_[released.cluster];
+    members.erase(std::find(members.begin(), members.end(), node));
+    node_at_.erase(cell_index(released.cell));
+    free_nodes_.push_back(node);
+}
+
+void HierarchicalPlanner::search_cluster(size_t cluster, const map_cell &source, const map_cell *extra)
+{
+    if (cluster != loaded_cluster_)
+    {
+        loaded_cluster_ = cluster;
+        cluster_origin_ = map_cell{static_cast<int>(cluster % clusters_x_) * cluster_size_,
+                                   static_cast<int>(cluster / clusters_x_) * cluster_size_};
+        cluster_width_ = std::min(cluster_size_, grid_->width() - cluster_origin_.x);
+        cluster_height_ = std::min(cluster_size_, grid_->height() - cluster_origin_.y);
+        std::fill(cluster_free_.begin(), cluster_free_.end(), 0);
+        for (int y = 0; y < cluster_height_; ++y)
+        {
+            for (int x = 0; x < cluster_width_; ++x)
+            {
+                map_cell cell{cluster_origin_.x + x, cluster_origin_.y + y};
+                cluster_free_[local_index(cell)] = grid_->is_free(cell.x, cell.y) ? 1 : 0;
+            }
+        }
+    }
+    const int stride = cluster_width_ + 2;
+    const int cells = stride * (cluster_height_ + 2);
+    const int offsets[8] = {1, stride + 1, stride, stride - 1, -1, -stride - 1, -stride, -stride + 1};
+    std::fill(cluster_costs_.begin(), cluster_costs_.begin() + cells, std::numeric_limits<double>::infinity());
+    std::fill(cluster_parents_.begin(), cluster_parents_.begin() + cells, -1);
+
+    if (++cluster_stamp_ == 0)
+    {
+        std::fill(cluster_targets_.begin(), cluster_targets_.end(), 0);
+        cluster_stamp_ = 1;
+    }
+    size_t remaining = 0;
+    auto mark = [&](const map_cell &cell)
+    {
+        uint32_t &target = cluster_targets_[local_index(cell)];
+        if (target != cluster_stamp_)
+        {
+            target = cluster_stamp_;
+            remaining++;
+        }
+    };
+    for (size_t node : cluster_nodes_[cluster])
+    {
+        mark(nodes_[node].cell);
+    }
+    if (extra && cluster_of(*extra) == cluster)
+    {
+        mark(*extra);
+    }
+
+    const int start = local_index(source);
+    cluster_costs_[start] = 0.0;
+    cluster_open_.clear();
+    cluster_open_.push_back(open_entry{0.0, static_cast<size_t>(start)});
+    while (!cluster_open_.empty())
+    {
+        std::pop_heap(cluster_open_.begin(), cluster_open_.end(), std::greater<open_entry>());
+        open_entry entry = cluster_open_.back();
+        cluster_open_.pop_back();
+        const int index = static_cast<int>(entry.index);
+        if (entry.f > cluster_costs_[index])
+        {
+            continue;
+        }
+        if (cluster_targets_[index] == cluster_stamp_)
+        {
+            cluster_targets_[index] = 0;
+            if (--remaining == 0)
+            {
+                break;
+            }
+        }
+
+        for (int d = 0; d < 8; ++d)
+        {
+            const int neighbour = index + offsets[d];
+            // Diagonal moves may not cut the corner of an obstacle
+            if (!cluster_free_[neighbour] ||
+                (d % 2 == 1 && (!cluster_free_[index + direction_x[d]] || !cluster_free_[index + direction_y[d] * stride])))
+            {
+                continue;
+            }
+            const double cost = entry.f + (d % 2 == 0 ? 1.0 : diagonal);
+            if (cost < cluster_costs_[neighbour])
+            {
+                cluster_costs_[neighbour] = cost;
+                cluster_parents_[neighbour] = index;
+                cluster_open_.push_back(open_entry{cost, static_cast<size_t>(neighbour)});
+                std::push_heap(cluster_open_.begin(), cluster_open_.end(), std::greater<open_entry>());
+            }
+        }
+    }
+}
+
+double HierarchicalPlanner::cluster_cost(const map_cell &cell) const
+{
+    return cluster_costs_[local_index(cell)];
+}
+
+void HierarchicalPlanner::append_cluster_path(const map_cell &cell, std::vector<map_cell> &path) const
+{
+    const size_t begin = path.size();
+    const int stride = cluster_width_ + 2;
+    for (int index = local_index(cell); cluster_parents_[index] >= 0; index = cluster_parents_[index])
+    {
+        path.push_back(map_cell{cluster_origin_.x + index % stride - 1, cluster_origin_.y + index / stride - 1});
+    }
+    std::reverse(path.begin() + begin, path.end());
+}
+
+HierarchicalPlanner::result HierarchicalPlanner::route(const map_cell &start, const map_cell &goal, bool refine)
+{
+    result query;
+    if (!grid_->is_free(start.x, start.y) || !grid_->is_free(goal.x, goal.y))
+    {
+        return query;
+    }
+
+    const size_t source = nodes_.size();
+    const size_t target = nodes_.size() + 1;
+    if (stamps_.size() < nodes_.size() + 2)
+    {
+        stamps_.resize(nodes_.size() + 2, 0);
+        costs_.resize(nodes_.size() + 2);
+        parents_.resize(nodes_.size() + 2);
+        closed_.resize(nodes_.size() + 2);
+    }
+    if (++stamp_ == 0)
+    {
+        std::fill(stamps_.begin(), stamps_.end(), 0);
+        stamp_ = 1;
+    }
+    open_.clear();
+
+    auto cell_of = [&](size_t node)
+    {
+        return node == source ? start : (node == target ? goal : nodes_[node].cell);
+    };
+    auto relax = [&](size_t node, size_t parent, double cost)
+    {
+        if (stamps_[node] == stamp_ && (closed_[node] || cost >= costs_[node]))
+        {
+            return;
+        }
+        stamps_[node] = stamp_;
+        closed_[node] = 0;
+        costs_[node] = cost;
+        parents_[node] = parent;
+        open_.push_back(open_entry{cost + octile(cell_of(node), goal), node});
+        std::push_heap(open_.begin(), open_.end(), std::greater<open_entry>());
+    };
+
+    // Connect the goal to the nodes of its cluster, then the start (and the goal directly when they share a cluster)
+    const size_t start_cluster = cluster_of(start);
+    const size_t goal_cluster = cluster_of(goal);
+    std::vector<std::pair<size_t, double>> goal_links;
+    search_cluster(goal_cluster, goal);
+    for (size_t node : cluster_nodes_[goal_cluster])
+    {
+        double cost = cluster_cost(nodes_[node].cell);
+        if (std::isfinite(cost))
+        {
+            goal_links.emplace_back(node, cost);
+        }
+    }
+
+    stamps_[source] = stamp_;
+    closed_[source] = 1;
+    costs_[source] = 0.0;
+    search_cluster(start_cluster, start, &goal);
+    if (start_cluster == goal_cluster && std::isfinite(cluster_cost(goal)))
+    {
+        relax(target, source, cluster_cost(goal));
+    }
+    for (size_t node : cluster_nodes_[start_cluster])
+    {
+        double cost = cluster_cost(nodes_[node].cell);
+        if (std::isfinite(cost))
+        {
+            relax(node, source, cost);
+        }
+    }
+
+    while (!open_.empty())
+    {
+        std::pop_heap(open_.begin(), open_.end(), std::greater<open_entry>());
+        size_t node = open_.back().index;
+        open_.pop_back();
+        if (closed_[node])
+        {
+            continue;
+        }
+        closed_[node] = 1;
+        query.expansions++;
+        if (node == target)
+        {
+            break;
+        }
+
+        for (const auto &edge : nodes_[node].edges)
+        {
+            relax(edge.target, node, costs_[node] + edge.cost);
+        }
+        if (nodes_[node].cluster == goal_cluster)
+        {
+            for (const auto &link : goal_links)
+            {
+                if (link.first == node)
+                {
+                    relax(target, node, costs_[node] + link.second);
+                }
+            }
+        }
+    }
+
+    if (stamps_[target] != stamp_ || !closed_[target])
+    {
+        return query;
+    }
+    query.found = true;
+    query.length = costs_[target] * grid_->resolution();
+    if (!refine)
+    {
+        return query;
+    }
+
+    std::vector<size_t> chain;
+    for (size_t node = target; node != source; node = parents_[node])
+    {
+        chain.push_back(node);
+    }
+    chain.push_back(source);
+    std::reverse(chain.begin(), chain.end());
+
+    // Steps across a border join neighbouring cells, the other steps are paths inside one cluster
+    query.path.push_back(start);
+    for (size_t k = 1; k < chain.size(); ++k)
+    {
+        map_cell from = cell_of(chain[k - 1]);
+        map_cell to = cell_of(chain[k]);
+        if (cluster_of(from) != cluster_of(to))
+        {
+            query.path.push_back(to);
+            continue;
+        }
+        search_cluster(cluster_of(from), from, &to);
+        append_cluster_path(to, query.path);
+    }
+    return query;
+}
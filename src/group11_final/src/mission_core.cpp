@@ -0,0 +1,89 @@
+#include "mission_core.hpp"
+
+bool classify_part(int color_code, int type_code, part_color &color, part_type &type)
+{
+    switch (color_code)
+    {
+    case part_codes::blue:
+        color = part_color::blue;
+        break;
+    case part_codes::green:
+        color = part_color::green;
+        break;
+    case part_codes::orange:
+        color = part_color::orange;
+        break;
+    case part_codes::red:
+        color = part_color::red;
+        break;
+    case part_codes::purple:
+        color = part_color::purple;
+        break;
+    default:
+        return false;
+    }
+
+    switch (type_code)
+    {
+    case part_codes::battery:
+        type = part_type::battery;
+        break;
+    case part_codes::pump:
+        type = part_type::pump;
+        break;
+    case part_codes::sensor:
+        type = part_type::sensor;
+        break;
+    case part_codes::regulator:
+        type = part_type::regulator;
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+pose3 transform_pose(const rigid_transform &transform, const pose3 &pose)
+{
+    const quaternion &q = transform.rotation;
+    const point3 &p = pose.position;
+
+    // Rotation of the position, p + 2 w (q x p) + 2 q x (q x p)
+    double tx = 2.0 * (q.y * p.z - q.z * p.y);
+    double ty = 2.0 * (q.z * p.x - q.x * p.z);
+    double tz = 2.0 * (q.x * p.y - q.y * p.x);
+    pose3 result;
+    result.position.x = p.x + q.w * tx + (q.y * tz - q.z * ty) + transform.translation.x;
+    result.position.y = p.y + q.w * ty + (q.z * tx - q.x * tz) + transform.translation.y;
+    result.position.z = p.z + q.w * tz + (q.x * ty - q.y * tx) + transform.translation.z;
+
+    // Orientation, q * o
+    const quaternion &o = pose.orientation;
+    result.orientation.w = q.w * o.w - q.x * o.x - q.y * o.y - q.z * o.z;
+    result.orientation.x = q.w * o.x + q.x * o.w + q.y * o.z - q.z * o.y;
+    result.orientation.y = q.w * o.y - q.x * o.z + q.y * o.w + q.z * o.x;
+    result.orientation.z = q.w * o.z + q.x * o.y - q.y * o.x + q.z * o.w;
+    return result;
+}
+
+std::vector<marker_mission> new_marker_missions(const std::vector<int64_t> &marker_ids, const MissionTable &missions,
+                                                std::unordered_set<long> &seen, std::vector<long> &unknown)
+{
+    std::vector<marker_mission> queued;
+    for (size_t k = 0; k < marker_ids.size(); ++k)
+    {
+        long marker_id = static_cast<long>(marker_ids[k]);
+        if (!seen.insert(marker_id).second)
+        {
+            continue;
+        }
+        mission steps = missions.find(marker_id);
+        if (steps.size == 0)
+        {
+            unknown.push_back(marker_id);
+            continue;
+        }
+        queued.push_back(marker_mission{k, marker_id, steps});
+    }
+    return queued;
+}
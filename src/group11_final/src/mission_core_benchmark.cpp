@@ -0,0 +1,183 @@
+/**
+ * @file mission_core_benchmark.cpp
+ * @author Nitish Ravisanakar Raveendran - rrnitish@umd.edu,Varun Lakshmanan - varunl11@umd.edu,Sai Jagadeesh Muralikrishnan - jagkrish@umd.edu
+ * @brief Benchmark of the core logic of the PartPoseListener node (classification, pose transforms, matching and queueing of the
+ * missions) on synthetic parts, without ROS.
+ * @version 0.1
+ * @date 2023-12-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * Usage: mission_core_benchmark [max_parts] [seed]
+ */
+#include "mission_core.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <utility>
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    // Largest size matched with the reference scan, which is quadratic
+    constexpr size_t reference_limit = 20000;
+
+    /**
+     * @brief  struct to store a synthetic detected part
+     *
+     */
+    struct synthetic_part
+    {
+        part_type type;
+        part_color color;
+        pose3 pose;
+    };
+
+    /**
+     * @brief  struct to store a synthetic waypoint
+     *
+     */
+    struct synthetic_waypoint
+    {
+        part_type type;
+        part_color color;
+        bool pose_assigned = false;
+    };
+
+    double elapsed_ms(const clock_type::time_point &start)
+    {
+        return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+    }
+
+    /**
+     * @brief The matching of the node before the core, a scan of the waypoints for every part.
+     *
+     */
+    std::vector<part_match> reference_match(const std::vector<synthetic_part> &parts, std::vector<synthetic_waypoint> waypoints)
+    {
+        std::vector<part_match> matches;
+        for (size_t part = 0; part < parts.size(); ++part)
+        {
+            for (size_t i = 0; i < waypoints.size(); ++i)
+            {
+                if (waypoints[i].type == parts[part].type && waypoints[i].color == parts[part].color && !waypoints[i].pose_assigned)
+                {
+                    waypoints[i].pose_assigned = true;
+                    matches.push_back(part_match{part, i});
+                    break;
+                }
+            }
+        }
+        return matches;
+    }
+
+    void run(size_t size, std::mt19937 &rng)
+    {
+        std::uniform_int_distribution<int> color_code(part_codes::red, part_codes::purple);
+        std::uniform_int_distribution<int> type_code(part_codes::battery, part_codes::regulator);
+        std::uniform_real_distribution<double> coordinate(-10.0, 10.0);
+        std::printf("%zu parts\n", size);
+
+        // Classification of the codes of the logical camera messages, a few of them unknown
+        std::vector<std::pair<int, int>> codes(size);
+        for (auto &code : codes)
+        {
+            code = {color_code(rng), type_code(rng) + (rng() % 16 == 0 ? 10 : 0)};
+        }
+        std::vector<synthetic_part> parts;
+        parts.reserve(size);
+        auto start = clock_type::now();
+        for (const auto &code : codes)
+        {
+            synthetic_part part;
+            if (classify_part(code.first, code.second, part.color, part.type))
+            {
+                parts.push_back(part);
+            }
+        }
+        std::printf("  classify     %10.4f ms  %zu known\n", elapsed_ms(start), parts.size());
+
+        // Transform from a camera frame to the map frame
+        double yaw = coordinate(rng);
+        rigid_transform transform{point3{coordinate(rng), coordinate(rng), 1.5},
+                                  quaternion{0.0, 0.0, std::sin(yaw / 2.0), std::cos(yaw / 2.0)}};
+        for (auto &part : parts)
+        {
+            part.pose.position = point3{coordinate(rng), coordinate(rng), coordinate(rng)};
+        }
+        double checksum = 0.0;
+        start = clock_type::now();
+        for (auto &part : parts)
+        {
+            part.pose = transform_pose(transform, part.pose);
+            checksum += part.pose.position.x;
+        }
+        std::printf("  transform    %10.4f ms  checksum %.3f\n", elapsed_ms(start), checksum);
+
+        // Matching with a mission of as many waypoints as parts
+        std::vector<synthetic_waypoint> waypoints(parts.size());
+        for (auto &waypoint : waypoints)
+        {
+            classify_part(color_code(rng), type_code(rng), waypoint.color, waypoint.type);
+        }
+        start = clock_type::now();
+        std::vector<part_match> matches = match_parts(parts, waypoints);
+        std::printf("  match        %10.4f ms  %zu matched\n", elapsed_ms(start), matches.size());
+        if (parts.size() <= reference_limit)
+        {
+            start = clock_type::now();
+            std::vector<part_match> reference = reference_match(parts, waypoints);
+            double reference_time = elapsed_ms(start);
+            bool same = reference.size() == matches.size() &&
+                        std::equal(reference.begin(), reference.end(), matches.begin(), [](const part_match &a, const part_match &b)
+                                   { return a.part == b.part && a.waypoint == b.waypoint; });
+            std::printf("  match scan   %10.4f ms  %s\n", reference_time, same ? "same bindings" : "DIFFERENT BINDINGS");
+        }
+
+        // Queueing of the missions of markers in view, one waypoint per part split in missions of 5
+        std::vector<std::pair<std::string, std::string>> parameters;
+        size_t markers = std::min<size_t>((parts.size() + 4) / 5, static_cast<size_t>(MissionTable::max_marker_id) + 1);
+        for (size_t i = 0; i < markers * 5 && i < waypoints.size(); ++i)
+        {
+            std::string prefix = "aruco_" + std::to_string(i / 5) + ".wp" + std::to_string(i % 5 + 1);
+            parameters.emplace_back(prefix + ".type", MissionTable::to_string(waypoints[i].type));
+            parameters.emplace_back(prefix + ".color", MissionTable::to_string(waypoints[i].color));
+        }
+        MissionTable missions = MissionTable::parse(parameters);
+        std::vector<int64_t> in_view(markers * 2);
+        for (auto &marker : in_view)
+        {
+            marker = static_cast<int64_t>(rng() % (markers + markers / 4 + 1));
+        }
+        std::unordered_set<long> seen;
+        std::vector<long> unknown;
+        start = clock_type::now();
+        std::vector<marker_mission> queued = new_marker_missions(in_view, missions, seen, unknown);
+        std::printf("  queue        %10.4f ms  %zu missions queued, %zu unknown markers\n", elapsed_ms(start), queued.size(),
+                    unknown.size());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t max_parts = argc > 1 ? std::stoul(argv[1]) : 100000;
+    std::mt19937 rng(argc > 2 ? static_cast<unsigned>(std::stoul(argv[2])) : 1u);
+
+    try
+    {
+        for (size_t size = 10; size <= max_parts; size *= 10)
+        {
+            run(size, rng);
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        std::fprintf(stderr, "%s\n", ex.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include "mission_metrics.hpp"
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+namespace
+{
+    const double not_reached = std::numeric_limits<double>::quiet_NaN();
+
+    /**
+     * @brief Formats a CSV number, empty for NaN.
+     *
+     */
+    std::string csv_number(double value)
+    {
+        if (std::isnan(value))
+        {
+            return "";
+        }
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.4f", value);
+        return text;
+    }
+}
+
+MissionMetrics::MissionMetrics(double start_time)
+    : start_time_(start_time),
+      first_detection_(not_reached),
+      all_detected_(not_reached),
+      marker_id_(-1),
+      mission_start_(start_time),
+      distance_(0.0),
+      waypoints_reached_(0),
+      aborts_(0),
+      dispatch_to_accept_sum_(0.0),
+      accepted_count_(0),
+      accept_to_succeed_sum_(0.0),
+      timed_count_(0)
+{
+}
+
+void MissionMetrics::part_detected(double time)
+{
+    if (std::isnan(first_detection_))
+    {
+        first_detection_ = time - start_time_;
+    }
+}
+
+void MissionMetrics::all_parts_detected(double time)
+{
+    if (std::isnan(all_detected_))
+    {
+        all_detected_ = time - start_time_;
+    }
+}
+
+void MissionMetrics::mission_started(long marker_id, double time)
+{
+    marker_id_ = marker_id;
+    mission_start_ = time;
+    distance_ = 0.0;
+    waypoints_reached_ = 0;
+    aborts_ = 0;
+    dispatch_to_accept_sum_ = 0.0;
+    accepted_count_ = 0;
+    accept_to_succeed_sum_ = 0.0;
+    timed_count_ = 0;
+    goals_.clear();
+}
+
+void MissionMetrics::goal_dispatched(size_t waypoint, double time)
+{
+    goals_[waypoint] = goal_times{time, not_reached};
+}
+
+void MissionMetrics::goal_accepted(size_t waypoint, double time)
+{
+    auto goal = goals_.find(waypoint);
+    if (goal == goals_.end() || !std::isnan(goal->second.accepted))
+    {
+        return;
+    }
+    goal->second.accepted = time;
+    dispatch_to_accept_sum_ += time - goal->second.dispatched;
+    accepted_count_++;
+}
+
+waypoint_metrics MissionMetrics::goal_succeeded(size_t waypoint, double time)
+{
+    waypoint_metrics metrics{marker_id_, waypoint, not_reached, not_reached};
+    waypoints_reached_++;
+    auto goal = goals_.find(waypoint);
+    if (goal == goals_.end())
+    {
+        return metrics;
+    }
+    metrics.dispatch_to_accept = goal->second.accepted - goal->second.dispatched;
+    metrics.accept_to_succeed = time - goal->second.accepted;
+    if (!std::isnan(metrics.accept_to_succeed))
+    {
+        accept_to_succeed_sum_ += metrics.accept_to_succeed;
+        timed_count_++;
+    }
+    goals_.erase(goal);
+    return metrics;
+}
+
+void MissionMetrics::goal_aborted(size_t waypoint)
+{
+    aborts_++;
+    goals_.erase(waypoint);
+}
+
+void MissionMetrics::odometry(size_t robot, double x, double y)
+{
+    if (robot >= positions_.size())
+    {
+        positions_.resize(robot + 1);
+        position_known_.resize(robot + 1, false);
+    }
+    if (position_known_[robot])
+    {
+        distance_ += std::hypot(x - positions_[robot].first, y - positions_[robot].second);
+    }
+    positions_[robot] = {x, y};
+    position_known_[robot] = true;
+}
+
+mission_metrics MissionMetrics::current(double time) const
+{
+    mission_metrics metrics;
+    metrics.marker_id = marker_id_;
+    metrics.first_detection = first_detection_;
+    metrics.all_detected = all_detected_;
+    metrics.duration = marker_id_ < 0 ? not_reached : time - mission_start_;
+    metrics.distance = distance_;
+    metrics.waypoints_reached = waypoints_reached_;
+    metrics.aborts = aborts_;
+    metrics.mean_dispatch_to_accept = accepted_count_ > 0 ? dispatch_to_accept_sum_ / static_cast<double>(accepted_count_) : not_reached;
+    metrics.mean_accept_to_succeed =
+        timed_count_ > 0 ? accept_to_succeed_sum_ / static_cast<double>(timed_count_) : not_reached;
+    return metrics;
+}
+
+mission_metrics MissionMetrics::mission_finished(double time)
+{
+    mission_metrics metrics = current(time);
+    goals_.clear();
+    return metrics;
+}
+
+std::string MissionMetrics::csv_header()
+{
+    return "record,marker_id,waypoint,dispatch_to_accept,accept_to_succeed,first_detection,all_detected,duration,distance,"
+           "waypoints_reached,aborts";
+}
+
+std::string MissionMetrics::csv_row(const waypoint_metrics &metrics)
+{
+    return "waypoint," + std::to_string(metrics.marker_id) + "," + std::to_string(metrics.waypoint) + "," +
+           csv_number(metrics.dispatch_to_accept) + "," + csv_number(metrics.accept_to_succeed) + ",,,,,,";
+}
+
+std::string MissionMetrics::csv_row(const mission_metrics &metrics)
+{
+    return "mission," + std::to_string(metrics.marker_id) + ",," + csv_number(metrics.mean_dispatch_to_accept) + "," +
+           csv_number(metrics.mean_accept_to_succeed) + "," + csv_number(metrics.first_detection) + "," +
+           csv_number(metrics.all_detected) + "," + csv_number(metrics.duration) + "," + csv_number(metrics.distance) + "," +
+           std::to_string(metrics.waypoints_reached) + "," + std::to_string(metrics.aborts);
+}
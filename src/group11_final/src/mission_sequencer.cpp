@@ -0,0 +1,973 @@
+#include "mission_sequencer.hpp"
+#include "assignment_solver.hpp"
+#include "tour_optimizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <utility>
+
+MissionSequencer::MissionSequencer(options opts, hooks callbacks)
+    : options_(std::move(opts)), hooks_(std::move(callbacks)), marker_id_(-1), current_waypoint_(0), resolved_waypoints_(0),
+      reached_waypoints_(0), first_open_waypoint_(0), goal_state_(goal_state::idle), goal_sequence_(0), batch_start_(0),
+      batch_size_(0), order_optimized_(false), server_ready_(false), goal_retries_(0), goal_retry_waypoint_(0)
+{
+    bindings_.fill(no_waypoint);
+    for (const auto &name : options_.robots)
+    {
+        robot_state robot;
+        robot.name = name;
+        robots_.push_back(robot);
+    }
+}
+
+void MissionSequencer::queue_mission(queued_mission next)
+{
+    queue_.push_back(std::move(next));
+}
+
+void MissionSequencer::reload_queue(const MissionTable &missions, std::vector<long> &dropped)
+{
+    // The queued missions have not started, they are built again from the new table
+    std::deque<queued_mission> queue;
+    for (auto &queued : queue_)
+    {
+        mission steps = missions.find(queued.marker_id);
+        if (steps.size == 0)
+        {
+            dropped.push_back(queued.marker_id);
+            continue;
+        }
+        queued.waypoints.clear();
+        for (const auto &step : steps)
+        {
+            waypoint waypoint;
+            waypoint.type = step.type;
+            waypoint.color = step.color;
+            queued.waypoints.push_back(waypoint);
+        }
+        queued.planned = false;
+        queue.push_back(std::move(queued));
+    }
+    queue_ = std::move(queue);
+}
+
+bool MissionSequencer::start_next_mission()
+{
+    if (queue_.empty())
+    {
+        return false;
+    }
+
+    // The next mission starts where the single robot finished the last one, the last waypoint may have been skipped
+    if (robots_.empty())
+    {
+        mission_start_ = last_reached_;
+    }
+
+    queued_mission next = std::move(queue_.front());
+    queue_.pop_front();
+    marker_id_ = next.marker_id;
+    waypoints_ = std::move(next.waypoints);
+    current_waypoint_ = 0;
+    batch_start_ = 0;
+    batch_size_ = 0;
+    goal_retries_ = 0;
+    order_optimized_ = false;
+    first_open_waypoint_ = 0;
+    for (auto &robot : robots_)
+    {
+        robot.failed.clear();
+    }
+
+    // The waypoints resolved ahead keep their part binding
+    count_waypoints();
+    return true;
+}
+
+bool MissionSequencer::mission_finished() const
+{
+    if (marker_id_ < 0)
+    {
+        return true;
+    }
+    return robots_.empty() ? current_waypoint_ >= waypoints_.size() : reached_waypoints_ == waypoints_.size();
+}
+
+size_t MissionSequencer::replace_mission(const mission &steps)
+{
+    // A waypoint is kept as reached when it comes before the current waypoint, or in fleet mode when a robot reached it
+    auto is_reached = [this](size_t i)
+    {
+        return robots_.empty() ? i < current_waypoint_ : waypoints_[i].reached;
+    };
+
+    std::vector<waypoint> updated;
+    std::vector<long> new_index(waypoints_.size(), -1);
+    std::vector<uint8_t> step_done(steps.size, 0);
+    for (size_t i = 0; i < waypoints_.size(); ++i)
+    {
+        if (!is_reached(i))
+        {
+            continue;
+        }
+        new_index[i] = static_cast<long>(updated.size());
+        updated.push_back(waypoints_[i]);
+        // A reached waypoint counts for one step of the new mission with the same part
+        for (size_t k = 0; k < steps.size; ++k)
+        {
+            if (!step_done[k] && steps.waypoints[k].type == waypoints_[i].type && steps.waypoints[k].color == waypoints_[i].color)
+            {
+                step_done[k] = 1;
+                break;
+            }
+        }
+    }
+    const size_t first_open = updated.size();
+
+    for (size_t k = 0; k < steps.size; ++k)
+    {
+        if (step_done[k])
+        {
+            continue;
+        }
+        waypoint next;
+        next.type = steps.waypoints[k].type;
+        next.color = steps.waypoints[k].color;
+        for (size_t i = 0; i < waypoints_.size(); ++i)
+        {
+            if (new_index[i] < 0 && !is_reached(i) && waypoints_[i].type == next.type && waypoints_[i].color == next.color)
+            {
+                next = waypoints_[i];
+                new_index[i] = static_cast<long>(updated.size());
+                break;
+            }
+        }
+        updated.push_back(next);
+    }
+
+    // Goals to waypoints that moved or were removed are canceled
+    if (robots_.empty())
+    {
+        bool moved = false;
+        for (size_t i = current_waypoint_; goal_state_ != goal_state::idle && i < batch_start_ + batch_size_; ++i)
+        {
+            moved |= i >= waypoints_.size() || new_index[i] != static_cast<long>(i);
+        }
+        if (moved)
+        {
+            log(log_level::info, "The mission changed, canceling the current goal");
+            if (hooks_.cancel_goal)
+            {
+                hooks_.cancel_goal(-1);
+            }
+            ++goal_sequence_;
+            goal_state_ = goal_state::idle;
+        }
+        current_waypoint_ = first_open;
+        goal_retries_ = 0;
+        order_optimized_ = false;
+    }
+    for (size_t r = 0; r < robots_.size(); ++r)
+    {
+        robot_state &robot = robots_[r];
+        if (robot.waypoint < 0)
+        {
+            continue;
+        }
+        robot.waypoint = new_index[static_cast<size_t>(robot.waypoint)];
+        if (robot.waypoint < 0)
+        {
+            log(log_level::info, "The mission changed, canceling the goal of robot %s", robot.name.c_str());
+            if (hooks_.cancel_goal)
+            {
+                hooks_.cancel_goal(static_cast<long>(r));
+            }
+            ++robot.sequence;
+            robot.state = goal_state::idle;
+        }
+    }
+    for (auto &robot : robots_)
+    {
+        std::vector<size_t> remapped;
+        for (size_t i : robot.failed)
+        {
+            if (new_index[i] >= 0)
+            {
+                remapped.push_back(static_cast<size_t>(new_index[i]));
+            }
+        }
+        robot.failed = std::move(remapped);
+    }
+
+    // The parts keep the waypoint they were bound to wherever it moved, the parts of removed waypoints lose their binding
+    for (size_t &binding : bindings_)
+    {
+        if (binding != no_waypoint)
+        {
+            long index = new_index[binding];
+            binding = index < 0 ? no_waypoint : static_cast<size_t>(index);
+        }
+    }
+    waypoints_ = std::move(updated);
+    resolved_waypoints_ = static_cast<size_t>(std::count_if(waypoints_.begin(), waypoints_.end(), [](const waypoint &waypoint)
+                                                            { return waypoint.pose_assigned; }));
+    reached_waypoints_ = static_cast<size_t>(std::count_if(waypoints_.begin(), waypoints_.end(), [](const waypoint &waypoint)
+                                                           { return waypoint.reached; }));
+    first_open_waypoint_ = 0;
+    return first_open;
+}
+
+void MissionSequencer::restore(long marker_id, std::vector<waypoint> waypoints, size_t current_waypoint)
+{
+    marker_id_ = marker_id;
+    waypoints_ = std::move(waypoints);
+    current_waypoint_ = std::min(current_waypoint, waypoints_.size());
+    count_waypoints();
+}
+
+void MissionSequencer::count_waypoints()
+{
+    resolved_waypoints_ = 0;
+    reached_waypoints_ = 0;
+    bindings_.fill(no_waypoint);
+    for (size_t i = 0; i < waypoints_.size(); ++i)
+    {
+        if (waypoints_[i].pose_assigned)
+        {
+            resolved_waypoints_++;
+            size_t &binding = bindings_[part_key_index(waypoints_[i].type, waypoints_[i].color)];
+            if (binding == no_waypoint)
+            {
+                binding = i;
+            }
+        }
+        reached_waypoints_ += waypoints_[i].reached ? 1 : 0;
+    }
+}
+
+void MissionSequencer::resolve_waypoint(size_t index, const pose3 &pose, uint64_t trace_id)
+{
+    waypoint &waypoint = waypoints_[index];
+    waypoint.pose = pose;
+    waypoint.trace_id = trace_id;
+    if (!waypoint.pose_assigned)
+    {
+        waypoint.pose_assigned = true;
+        resolved_waypoints_++;
+    }
+    bindings_[part_key_index(waypoint.type, waypoint.color)] = index;
+}
+
+void MissionSequencer::move_waypoint(size_t index, const pose3 &pose)
+{
+    waypoint &waypoint = waypoints_[index];
+    waypoint.pose = pose;
+
+    if (!robots_.empty())
+    {
+        if (waypoint.robot >= 0 && !waypoint.reached)
+        {
+            log(log_level::info, "Waypoint %zu moved, updating the goal of robot %s", index,
+                robots_[static_cast<size_t>(waypoint.robot)].name.c_str());
+            send_fleet_goal(static_cast<size_t>(waypoint.robot));
+        }
+        return;
+    }
+
+    // Only the goal the robot is currently driving to has to be replaced, the other waypoints are read when they are sent.
+    if (goal_state_ == goal_state::idle || goal_state_ == goal_state::retrying || index < current_waypoint_ ||
+        index >= batch_start_ + batch_size_)
+    {
+        return;
+    }
+    log(log_level::info, "Waypoint %zu moved, updating the current goal", index);
+    send_goal(current_waypoint_, batch_size_ > 1 ? waypoints_.size() - current_waypoint_ : 1);
+}
+
+void MissionSequencer::set_heading(size_t index, double heading)
+{
+    quaternion &orientation = waypoints_[index].pose.orientation;
+    orientation.x = 0.0;
+    orientation.y = 0.0;
+    orientation.z = std::sin(heading / 2.0);
+    orientation.w = std::cos(heading / 2.0);
+}
+
+void MissionSequencer::navigate()
+{
+    if (!robots_.empty())
+    {
+        dispatch_fleet();
+        return;
+    }
+    if (!server_ready_ || goal_state_ != goal_state::idle)
+    {
+        return;
+    }
+
+    size_t last = waypoints_.size();
+    if (current_waypoint_ >= last || !waypoints_[current_waypoint_].pose_assigned)
+    {
+        return;
+    }
+
+    if (options_.optimize_order && !order_optimized_)
+    {
+        if (!all_waypoints_resolved())
+        {
+            return;
+        }
+        optimize_waypoint_order(false);
+    }
+
+    if (options_.mode == navigation_mode::through_poses && last - current_waypoint_ > 1 && all_waypoints_resolved())
+    {
+        send_goal(current_waypoint_, last - current_waypoint_);
+        return;
+    }
+    send_goal(current_waypoint_, 1);
+}
+
+void MissionSequencer::send_goal(size_t first, size_t count)
+{
+    assign_approach_headings(first, first + count);
+    size_t sequence = ++goal_sequence_;
+    goal_state_ = goal_state::sending;
+    batch_start_ = first;
+    batch_size_ = count;
+    if (count > 1)
+    {
+        log(log_level::info, "Sending waypoints %zu to %zu as one goal", first, first + count - 1);
+    }
+    if (hooks_.send_goal && !hooks_.send_goal(first, count, sequence))
+    {
+        goal_state_ = goal_state::idle;
+    }
+}
+
+void MissionSequencer::server_available()
+{
+    server_ready_ = true;
+    navigate();
+}
+
+void MissionSequencer::server_lost()
+{
+    server_ready_ = false;
+    goal_state_ = goal_state::idle;
+    // A late response or result of the goal sent to the lost server must not be taken for the goal sent once it is back
+    ++goal_sequence_;
+}
+
+bool MissionSequencer::goal_response(size_t sequence, bool accepted)
+{
+    if (sequence != goal_sequence_)
+    {
+        return false;
+    }
+    if (accepted)
+    {
+        goal_state_ = goal_state::active;
+        return true;
+    }
+    if (batch_size_ > 1)
+    {
+        log(log_level::error, "Goal for waypoints %zu to %zu was rejected by server", batch_start_, batch_start_ + batch_size_ - 1);
+    }
+    else
+    {
+        log(log_level::error, "Goal for waypoint %zu was rejected by server", current_waypoint_);
+    }
+    goal_failed();
+    return true;
+}
+
+void MissionSequencer::goal_finished(size_t sequence, goal_result result)
+{
+    if (sequence != goal_sequence_)
+    {
+        return;
+    }
+    goal_state_ = goal_state::idle;
+
+    switch (result)
+    {
+    case goal_result::succeeded:
+        while (current_waypoint_ < batch_start_ + batch_size_)
+        {
+            log(log_level::info, "Reached waypoint %zu successfully", current_waypoint_);
+            reach_waypoint(current_waypoint_);
+            current_waypoint_++;
+        }
+        if (current_waypoint_ < waypoints_.size())
+        {
+            navigate();
+        }
+        else
+        {
+            log(log_level::info, "All waypoints of the mission have been reached");
+            if (hooks_.mission_done)
+            {
+                hooks_.mission_done();
+            }
+        }
+        break;
+    case goal_result::aborted:
+        if (batch_size_ > 1)
+        {
+            log(log_level::error, "Goal for waypoints %zu to %zu was aborted", current_waypoint_, batch_start_ + batch_size_ - 1);
+        }
+        else
+        {
+            log(log_level::error, "Goal for waypoint %zu was aborted", current_waypoint_);
+        }
+        if (hooks_.goal_aborted)
+        {
+            hooks_.goal_aborted(current_waypoint_);
+        }
+        goal_failed();
+        break;
+    case goal_result::canceled:
+        log(log_level::info, "Goal was canceled");
+        break;
+    default:
+        log(log_level::error, "Unknown result code");
+        break;
+    }
+}
+
+void MissionSequencer::goal_feedback(size_t sequence, const point3 &robot)
+{
+    size_t next = current_waypoint_ + 1;
+    if (sequence != goal_sequence_ || options_.handoff_radius <= 0.0 || goal_state_ != goal_state::active ||
+        next >= waypoints_.size() || !waypoints_[next].pose_assigned)
+    {
+        return;
+    }
+
+    const point3 &target = waypoints_[current_waypoint_].pose.position;
+    double dx = target.x - robot.x;
+    double dy = target.y - robot.y;
+    if (dx * dx + dy * dy > options_.handoff_radius * options_.handoff_radius)
+    {
+        return;
+    }
+
+    // The next goal preempts the current one, its result is ignored because the sequence number changes
+    log(log_level::info, "Reached waypoint %zu successfully, handing off to the next waypoint", current_waypoint_);
+    reach_waypoint(current_waypoint_);
+    current_waypoint_ = next;
+    send_goal(next, 1);
+}
+
+void MissionSequencer::poses_remaining(size_t sequence, size_t remaining)
+{
+    if (sequence != goal_sequence_)
+    {
+        return;
+    }
+    remaining = std::min(remaining, batch_size_);
+    size_t passed = batch_start_ + batch_size_ - remaining;
+    // The last pose is only reached when the goal succeeds
+    passed = std::min(passed, batch_start_ + batch_size_ - 1);
+    while (current_waypoint_ < passed)
+    {
+        log(log_level::info, "Reached waypoint %zu successfully", current_waypoint_);
+        reach_waypoint(current_waypoint_);
+        current_waypoint_++;
+    }
+}
+
+void MissionSequencer::reach_waypoint(size_t index)
+{
+    last_reached_ = waypoints_[index].pose;
+    if (hooks_.waypoint_reached)
+    {
+        hooks_.waypoint_reached(index);
+    }
+}
+
+double MissionSequencer::retry_backoff(int retry) const
+{
+    return std::ldexp(options_.retry_delay, std::min(retry, 16) - 1);
+}
+
+void MissionSequencer::goal_failed()
+{
+    // The goal of a through_poses batch is retried from the first waypoint that was not passed
+    if (goal_retry_waypoint_ != current_waypoint_)
+    {
+        goal_retry_waypoint_ = current_waypoint_;
+        goal_retries_ = 0;
+    }
+    // A late response or result of the failed goal must not be taken for the retry
+    size_t sequence = ++goal_sequence_;
+
+    if (goal_retries_ < options_.retry_limit)
+    {
+        goal_retries_++;
+        double backoff = retry_backoff(goal_retries_);
+        log(log_level::warn, "Retrying waypoint %zu in %.1f s, retry %d of %d", current_waypoint_, backoff, goal_retries_,
+            options_.retry_limit);
+        goal_state_ = goal_state::retrying;
+        if (hooks_.schedule_retry)
+        {
+            hooks_.schedule_retry(-1, backoff, sequence);
+        }
+        return;
+    }
+
+    log(log_level::error, "Skipping waypoint %zu after %d failed goals", current_waypoint_, goal_retries_ + 1);
+    goal_state_ = goal_state::idle;
+    goal_retries_ = 0;
+    current_waypoint_++;
+    if (current_waypoint_ < waypoints_.size())
+    {
+        navigate();
+    }
+    else
+    {
+        log(log_level::info, "All waypoints of the mission have been reached or skipped");
+        if (hooks_.mission_done)
+        {
+            hooks_.mission_done();
+        }
+    }
+}
+
+void MissionSequencer::retry_elapsed(long robot, size_t sequence)
+{
+    // The mission may have changed or the action server may have been lost during the backoff
+    if (robot < 0)
+    {
+        if (sequence != goal_sequence_ || goal_state_ != goal_state::retrying)
+        {
+            return;
+        }
+        goal_state_ = goal_state::idle;
+    }
+    else
+    {
+        robot_state &state = robots_[static_cast<size_t>(robot)];
+        if (sequence != state.sequence || state.state != goal_state::retrying)
+        {
+            return;
+        }
+        state.state = goal_state::idle;
+    }
+    navigate();
+}
+
+void MissionSequencer::routes_changed()
+{
+    if (options_.optimize_order && order_optimized_)
+    {
+        optimize_waypoint_order(true);
+    }
+}
+
+bool MissionSequencer::update_robot_pose(size_t index, const pose3 &pose)
+{
+    robot_state &robot = robots_[index];
+    robot.pose = pose;
+    robot.pose.position.z = 0.0;
+    if (robot.pose_known)
+    {
+        return false;
+    }
+    robot.pose_known = true;
+    return true;
+}
+
+void MissionSequencer::dispatch_fleet()
+{
+    if (!server_ready_)
+    {
+        return;
+    }
+
+    std::vector<size_t> idle;
+    for (size_t r = 0; r < robots_.size(); ++r)
+    {
+        if (robots_[r].state == goal_state::idle && robots_[r].pose_known && (!hooks_.robot_ready || hooks_.robot_ready(r)))
+        {
+            idle.push_back(r);
+        }
+    }
+    // Only the first open waypoints are offered to the idle robots, so that the cost of an assignment does not grow with the
+    // length of the mission. The waypoints before first_open_waypoint_ are all reached.
+    while (first_open_waypoint_ < waypoints_.size() && waypoints_[first_open_waypoint_].reached)
+    {
+        first_open_waypoint_++;
+    }
+    const size_t window = idle.size() * fleet_lookahead;
+    std::vector<size_t> open;
+    open.reserve(window);
+    for (size_t i = first_open_waypoint_; i < waypoints_.size() && open.size() < window; ++i)
+    {
+        if (waypoints_[i].pose_assigned && !waypoints_[i].reached && waypoints_[i].robot < 0)
+        {
+            open.push_back(i);
+        }
+    }
+    if (idle.empty() || open.empty())
+    {
+        return;
+    }
+
+    // Node k is the idle robot k for k < idle.size(), the open waypoints follow
+    std::vector<point3> points;
+    points.reserve(idle.size() + open.size());
+    for (size_t r : idle)
+    {
+        points.push_back(robots_[r].pose.position);
+    }
+    for (size_t i : open)
+    {
+        points.push_back(waypoints_[i].pose.position);
+    }
+    std::vector<double> matrix = costs(points, nullptr, idle.size());
+    const size_t size = points.size();
+    std::vector<double> assignment_costs(idle.size() * open.size());
+    for (size_t a = 0; a < idle.size(); ++a)
+    {
+        const auto &failed = robots_[idle[a]].failed;
+        for (size_t b = 0; b < open.size(); ++b)
+        {
+            bool excluded = std::find(failed.begin(), failed.end(), open[b]) != failed.end();
+            assignment_costs[a * open.size() + b] =
+                excluded ? std::numeric_limits<double>::infinity() : matrix[a * size + idle.size() + b];
+        }
+    }
+
+    bool whole_fleet = idle.size() == robots_.size();
+    std::vector<long> assignment = whole_fleet ? AssignmentSolver::hungarian(assignment_costs, idle.size(), open.size())
+                                               : AssignmentSolver::auction(assignment_costs, idle.size(), open.size());
+    log(log_level::info, "Assigned %zu idle robots to %zu open waypoints with the %s solver, cost %f", idle.size(), open.size(),
+        whole_fleet ? "Hungarian" : "auction", AssignmentSolver::assignment_cost(assignment_costs, open.size(), assignment));
+
+    for (size_t a = 0; a < idle.size(); ++a)
+    {
+        if (assignment[a] < 0)
+        {
+            continue;
+        }
+        size_t r = idle[a];
+        size_t i = open[static_cast<size_t>(assignment[a])];
+        robots_[r].waypoint = static_cast<long>(i);
+        waypoints_[i].robot = static_cast<long>(r);
+        send_fleet_goal(r);
+    }
+}
+
+void MissionSequencer::send_fleet_goal(size_t index)
+{
+    robot_state &robot = robots_[index];
+    size_t sequence = ++robot.sequence;
+    robot.state = goal_state::sending;
+    log(log_level::info, "Sending robot %s to waypoint %ld", robot.name.c_str(), robot.waypoint);
+    if (hooks_.send_fleet_goal)
+    {
+        hooks_.send_fleet_goal(index, sequence);
+    }
+}
+
+bool MissionSequencer::fleet_goal_response(size_t index, size_t sequence, bool accepted)
+{
+    robot_state &robot = robots_[index];
+    if (sequence != robot.sequence)
+    {
+        return false;
+    }
+    if (accepted)
+    {
+        robot.state = goal_state::active;
+        return true;
+    }
+    log(log_level::error, "Goal of robot %s for waypoint %ld was rejected by server", robot.name.c_str(), robot.waypoint);
+    fleet_goal_failed(index);
+    continue_fleet();
+    return true;
+}
+
+void MissionSequencer::fleet_goal_finished(size_t index, size_t sequence, goal_result result)
+{
+    robot_state &robot = robots_[index];
+    if (sequence != robot.sequence)
+    {
+        return;
+    }
+    robot.state = goal_state::idle;
+    if (robot.waypoint < 0)
+    {
+        return;
+    }
+    waypoint &target = waypoints_[static_cast<size_t>(robot.waypoint)];
+
+    switch (result)
+    {
+    case goal_result::succeeded:
+        log(log_level::info, "Robot %s reached waypoint %ld successfully", robot.name.c_str(), robot.waypoint);
+        target.reached = true;
+        reached_waypoints_++;
+        if (hooks_.waypoint_reached)
+        {
+            hooks_.waypoint_reached(static_cast<size_t>(robot.waypoint));
+        }
+        break;
+    case goal_result::aborted:
+        log(log_level::error, "Goal of robot %s for waypoint %ld was aborted, releasing the waypoint", robot.name.c_str(),
+            robot.waypoint);
+        if (hooks_.goal_aborted)
+        {
+            hooks_.goal_aborted(static_cast<size_t>(robot.waypoint));
+        }
+        fleet_goal_failed(index);
+        break;
+    case goal_result::canceled:
+        log(log_level::info, "Goal of robot %s was canceled", robot.name.c_str());
+        target.robot = -1;
+        break;
+    default:
+        log(log_level::error, "Unknown result code");
+        target.robot = -1;
+        break;
+    }
+    robot.waypoint = -1;
+    continue_fleet();
+}
+
+void MissionSequencer::fleet_goal_failed(size_t index)
+{
+    robot_state &robot = robots_[index];
+    size_t failed = static_cast<size_t>(robot.waypoint);
+    waypoint &target = waypoints_[failed];
+    target.robot = -1;
+    robot.waypoint = -1;
+
+    if (++target.failures > options_.retry_limit)
+    {
+        // A skipped waypoint counts as reached, so that the mission can finish
+        log(log_level::error, "Skipping waypoint %zu after %d failed goals", failed, target.failures);
+        target.reached = true;
+        reached_waypoints_++;
+    }
+    else
+    {
+        robot.failed.push_back(failed);
+        // Once every robot failed the waypoint they can all try it again, the retries are bounded by the failures of the waypoint
+        bool all_failed = std::all_of(robots_.begin(), robots_.end(), [failed](const robot_state &other)
+                                      { return std::find(other.failed.begin(), other.failed.end(), failed) != other.failed.end(); });
+        if (all_failed)
+        {
+            for (auto &other : robots_)
+            {
+                other.failed.erase(std::remove(other.failed.begin(), other.failed.end(), failed), other.failed.end());
+            }
+        }
+    }
+
+    // The robot waits for the backoff before it is assigned again, a late response or result of the failed goal is ignored
+    size_t sequence = ++robot.sequence;
+    robot.state = goal_state::retrying;
+    if (hooks_.schedule_retry)
+    {
+        hooks_.schedule_retry(static_cast<long>(index), retry_backoff(target.failures), sequence);
+    }
+}
+
+void MissionSequencer::continue_fleet()
+{
+    if (!waypoints_.empty() && reached_waypoints_ == waypoints_.size())
+    {
+        log(log_level::info, "All waypoints have been reached by the fleet");
+        if (hooks_.mission_done)
+        {
+            hooks_.mission_done();
+        }
+        return;
+    }
+    navigate();
+}
+
+void MissionSequencer::assign_approach_headings(size_t first, size_t last)
+{
+    if (!options_.approach_heading || first >= last)
+    {
+        return;
+    }
+
+    // Node 0 is where the robot comes from, node k is the waypoint first + k - 1, the last node is the next resolved waypoint if any
+    std::vector<point3> points;
+    points.reserve(last - first + 2);
+    points.push_back(first > 0 ? waypoints_[first - 1].pose.position : mission_start_.position);
+    for (size_t i = first; i < last; ++i)
+    {
+        points.push_back(waypoints_[i].pose.position);
+    }
+    if (last < waypoints_.size() && waypoints_[last].pose_assigned)
+    {
+        points.push_back(waypoints_[last].pose.position);
+    }
+
+    std::vector<double> arrivals;
+    costs(points, &arrivals, first > 0 ? 0 : 1);
+    const size_t size = points.size();
+
+    // Heading of the path from node i to node j when it arrives at j (arrival) or leaves i (the reverse arrival turned by pi)
+    auto bearing = [&](size_t i, size_t j, bool arrival, double &heading)
+    {
+        double path = arrival ? arrivals[i * size + j] : arrivals[j * size + i] + M_PI;
+        double dx = points[j].x - points[i].x;
+        double dy = points[j].y - points[i].y;
+        if (!std::isnan(path))
+        {
+            heading = path;
+            return true;
+        }
+        if (dx * dx + dy * dy > 1e-6)
+        {
+            heading = std::atan2(dy, dx);
+            return true;
+        }
+        return false;
+    };
+
+    for (size_t k = 1; k <= last - first; ++k)
+    {
+        double incoming = 0.0;
+        double outgoing = 0.0;
+        bool has_incoming = bearing(k - 1, k, true, incoming);
+        bool has_outgoing = k + 1 < size && bearing(k, k + 1, false, outgoing);
+        if (!has_incoming && !has_outgoing)
+        {
+            continue;
+        }
+
+        double heading = has_incoming ? incoming : outgoing;
+        if (has_incoming && has_outgoing)
+        {
+            double x = std::cos(incoming) + std::cos(outgoing);
+            double y = std::sin(incoming) + std::sin(outgoing);
+            // A U-turn has no mean, the robot keeps the heading it arrives in
+            if (x * x + y * y > 1e-6)
+            {
+                heading = std::atan2(y, x);
+            }
+        }
+        set_heading(first + k - 1, heading);
+    }
+}
+
+void MissionSequencer::optimize_waypoint_order(bool improve_only)
+{
+    order_optimized_ = true;
+
+    size_t first = current_waypoint_;
+    size_t last = waypoints_.size();
+    if (improve_only)
+    {
+        if (goal_state_ != goal_state::idle)
+        {
+            first = std::max(first, batch_start_ + batch_size_);
+        }
+        if (first + 1 >= last || !all_waypoints_resolved())
+        {
+            return;
+        }
+    }
+
+    // Node 0 is where the robot starts from, node k is the waypoint first + k - 1
+    std::vector<point3> points;
+    points.reserve(last - first + 1);
+    points.push_back(first > 0 ? waypoints_[first - 1].pose.position : mission_start_.position);
+    for (size_t i = first; i < last; ++i)
+    {
+        points.push_back(waypoints_[i].pose.position);
+    }
+
+    std::vector<double> matrix = costs(points, nullptr, first > 0 ? 0 : 1);
+    TourOptimizer::options opts;
+    opts.fixed_first = true;
+    opts.fixed_last = options_.fixed_last_waypoint;
+    std::vector<size_t> identity(points.size());
+    for (size_t k = 0; k < identity.size(); ++k)
+    {
+        identity[k] = k;
+    }
+    std::vector<size_t> order = identity;
+    if (improve_only)
+    {
+        TourOptimizer::improve(matrix, points.size(), opts, order);
+    }
+    else
+    {
+        order = TourOptimizer::optimize(matrix, points.size(), opts);
+    }
+    if (order == identity && improve_only)
+    {
+        return;
+    }
+    log(log_level::info, "Optimized waypoint order: cost %f -> %f", TourOptimizer::path_cost(matrix, points.size(), identity),
+        TourOptimizer::path_cost(matrix, points.size(), order));
+
+    std::vector<waypoint> reordered;
+    std::vector<size_t> new_index(last - first);
+    reordered.reserve(last - first);
+    for (size_t k = 1; k < order.size(); ++k)
+    {
+        new_index[order[k] - 1] = first + reordered.size();
+        reordered.push_back(waypoints_[first + order[k] - 1]);
+    }
+    std::copy(reordered.begin(), reordered.end(), waypoints_.begin() + static_cast<std::ptrdiff_t>(first));
+
+    for (size_t &binding : bindings_)
+    {
+        if (binding != no_waypoint && binding >= first && binding < last)
+        {
+            binding = new_index[binding - first];
+        }
+    }
+    if (hooks_.waypoints_reordered)
+    {
+        hooks_.waypoints_reordered();
+    }
+}
+
+std::vector<double> MissionSequencer::costs(const std::vector<point3> &points, std::vector<double> *arrivals,
+                                            size_t first_waypoint) const
+{
+    if (hooks_.costs)
+    {
+        return hooks_.costs(points, arrivals, first_waypoint);
+    }
+    const size_t size = points.size();
+    std::vector<double> matrix(size * size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        for (size_t j = 0; j < size; ++j)
+        {
+            matrix[i * size + j] = std::hypot(points[j].x - points[i].x, points[j].y - points[i].y);
+        }
+    }
+    if (arrivals)
+    {
+        arrivals->assign(size * size, std::numeric_limits<double>::quiet_NaN());
+    }
+    return matrix;
+}
+
+void MissionSequencer::log(log_level level, const char *format, ...) const
+{
+    if (!hooks_.log)
+    {
+        return;
+    }
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    std::vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    hooks_.log(level, line);
+}
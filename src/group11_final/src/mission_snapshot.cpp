@@ -0,0 +1,315 @@
+#include "mission_snapshot.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr uint64_t snapshot_magic = 0x31504e5350414e53ull;  // "SNAPSNP1"
+    constexpr uint32_t snapshot_version = 1;
+
+    /**
+     * @brief  header of a snapshot file
+     *
+     */
+    struct file_header
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t part_count;
+        uint32_t waypoint_count;
+        uint32_t reserved;
+        int64_t marker_id;
+        uint64_t current_waypoint_index;
+        uint64_t checksum;  // FNV-1a of the records
+    };
+
+    /**
+     * @brief  record of a part in a snapshot file
+     *
+     */
+    struct part_record
+    {
+        uint8_t color;
+        uint8_t type;
+        uint8_t reserved[6];
+        double pose[7];
+        double weight;
+        double best_weight;
+    };
+
+    /**
+     * @brief  record of a waypoint in a snapshot file
+     *
+     */
+    struct waypoint_record
+    {
+        uint8_t type;
+        uint8_t color;
+        uint8_t pose_assigned;
+        uint8_t reached;
+        uint8_t reserved[4];
+        double pose[7];
+    };
+
+    static_assert(sizeof(file_header) == 48 && sizeof(part_record) == 80 && sizeof(waypoint_record) == 64,
+                  "The snapshot records must not have padding");
+
+    uint64_t checksum(const uint8_t *data, size_t size)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ data[i]) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    bool write_all(int fd, const uint8_t *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return false;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+}
+
+std::vector<uint8_t> MissionSnapshot::encode(const snapshot &state)
+{
+    const size_t records = state.parts.size() * sizeof(part_record) + state.waypoints.size() * sizeof(waypoint_record);
+    std::vector<uint8_t> data(sizeof(file_header) + records, 0);
+
+    uint8_t *next = data.data() + sizeof(file_header);
+    for (const auto &part : state.parts)
+    {
+        part_record record{};
+        record.color = static_cast<uint8_t>(part.color);
+        record.type = static_cast<uint8_t>(part.type);
+        std::memcpy(record.pose, part.pose, sizeof(record.pose));
+        record.weight = part.weight;
+        record.best_weight = part.best_weight;
+        std::memcpy(next, &record, sizeof(record));
+        next += sizeof(record);
+    }
+    for (const auto &waypoint : state.waypoints)
+    {
+        waypoint_record record{};
+        record.type = static_cast<uint8_t>(waypoint.type);
+        record.color = static_cast<uint8_t>(waypoint.color);
+        record.pose_assigned = waypoint.pose_assigned;
+        record.reached = waypoint.reached;
+        std::memcpy(record.pose, waypoint.pose, sizeof(record.pose));
+        std::memcpy(next, &record, sizeof(record));
+        next += sizeof(record);
+    }
+
+    file_header header{};
+    header.magic = snapshot_magic;
+    header.version = snapshot_version;
+    header.part_count = static_cast<uint32_t>(state.parts.size());
+    header.waypoint_count = static_cast<uint32_t>(state.waypoints.size());
+    header.marker_id = state.marker_id;
+    header.current_waypoint_index = state.current_waypoint_index;
+    header.checksum = checksum(data.data() + sizeof(file_header), records);
+    std::memcpy(data.data(), &header, sizeof(header));
+    return data;
+}
+
+void MissionSnapshot::write(const std::string &file, const std::vector<uint8_t> &data)
+{
+    // The new snapshot replaces the old one only once it is complete on disk
+    const std::string temporary = file + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot create snapshot " + temporary);
+    }
+    bool written = write_all(fd, data.data(), data.size()) && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!written || ::rename(temporary.c_str(), file.c_str()) != 0)
+    {
+        ::unlink(temporary.c_str());
+        throw std::runtime_error("Cannot write snapshot " + file);
+    }
+
+    // The rename is only durable once the directory entry is on disk
+    size_t slash = file.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : file.substr(0, slash);
+    int directory_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    bool synced = directory_fd >= 0 && ::fsync(directory_fd) == 0;
+    if (directory_fd >= 0)
+    {
+        ::close(directory_fd);
+    }
+    if (!synced)
+    {
+        throw std::runtime_error("Cannot sync the directory of snapshot " + file);
+    }
+}
+
+SnapshotWriter::SnapshotWriter(const std::string &file, error_sink on_error)
+    : file_(file),
+      on_error_(std::move(on_error)),
+      has_pending_(false),
+      stop_(false)
+{
+    thread_ = std::thread(&SnapshotWriter::run, this);
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+void SnapshotWriter::submit(std::vector<uint8_t> data)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = std::move(data);
+        has_pending_ = true;
+    }
+    wake_.notify_one();
+}
+
+void SnapshotWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        wake_.wait(lock, [this]
+                   { return has_pending_ || stop_; });
+        if (!has_pending_)
+        {
+            return;
+        }
+        std::vector<uint8_t> data = std::move(pending_);
+        has_pending_ = false;
+        lock.unlock();
+
+        if (data != written_)
+        {
+            try
+            {
+                MissionSnapshot::write(file_, data);
+                written_ = std::move(data);
+            }
+            catch (const std::exception &ex)
+            {
+                written_.clear();
+                on_error_(ex.what());
+            }
+        }
+        lock.lock();
+    }
+}
+
+bool MissionSnapshot::read(const std::string &file, snapshot &state)
+{
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+        {
+            return false;
+        }
+        throw std::runtime_error("Cannot open snapshot " + file);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(file_header))
+    {
+        ::close(fd);
+        throw std::runtime_error("Snapshot " + file + " is truncated");
+    }
+    const size_t size = static_cast<size_t>(info.st_size);
+    void *mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        throw std::runtime_error("Cannot map snapshot " + file);
+    }
+    const uint8_t *data = static_cast<const uint8_t *>(mapped);
+
+    file_header header;
+    std::memcpy(&header, data, sizeof(header));
+    const size_t records = size - sizeof(file_header);
+    std::string error;
+    if (header.magic != snapshot_magic || header.version != snapshot_version)
+    {
+        error = "Snapshot " + file + " has another format";
+    }
+    else if (records != header.part_count * sizeof(part_record) + header.waypoint_count * sizeof(waypoint_record))
+    {
+        error = "Snapshot " + file + " is truncated";
+    }
+    else if (checksum(data + sizeof(file_header), records) != header.checksum)
+    {
+        error = "Snapshot " + file + " has a wrong checksum";
+    }
+
+    snapshot loaded;
+    const uint8_t *next = data + sizeof(file_header);
+    for (uint32_t k = 0; error.empty() && k < header.part_count; ++k, next += sizeof(part_record))
+    {
+        part_record record;
+        std::memcpy(&record, next, sizeof(record));
+        if (record.color > static_cast<uint8_t>(part_color::purple) || record.type > static_cast<uint8_t>(part_type::regulator))
+        {
+            error = "Snapshot " + file + " has an unknown part";
+            break;
+        }
+        snapshot_part part;
+        part.color = static_cast<part_color>(record.color);
+        part.type = static_cast<part_type>(record.type);
+        std::memcpy(part.pose, record.pose, sizeof(part.pose));
+        part.weight = record.weight;
+        part.best_weight = record.best_weight;
+        loaded.parts.push_back(part);
+    }
+    for (uint32_t k = 0; error.empty() && k < header.waypoint_count; ++k, next += sizeof(waypoint_record))
+    {
+        waypoint_record record;
+        std::memcpy(&record, next, sizeof(record));
+        if (record.color > static_cast<uint8_t>(part_color::purple) || record.type > static_cast<uint8_t>(part_type::regulator))
+        {
+            error = "Snapshot " + file + " has an unknown waypoint";
+            break;
+        }
+        snapshot_waypoint waypoint;
+        waypoint.type = static_cast<part_type>(record.type);
+        waypoint.color = static_cast<part_color>(record.color);
+        waypoint.pose_assigned = record.pose_assigned != 0;
+        waypoint.reached = record.reached != 0;
+        std::memcpy(waypoint.pose, record.pose, sizeof(waypoint.pose));
+        loaded.waypoints.push_back(waypoint);
+    }
+    ::munmap(mapped, size);
+
+    if (!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+    loaded.marker_id = header.marker_id;
+    loaded.current_waypoint_index = header.current_waypoint_index;
+    state = std::move(loaded);
+    return true;
+}
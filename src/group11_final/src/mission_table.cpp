@@ -0,0 +1,155 @@
+#include "mission_table.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <map>
+#include <stdexcept>
+
+namespace
+{
+    constexpr std::array<const char *, 4> type_names = {"BATTERY", "PUMP", "SENSOR", "REGULATOR"};
+    constexpr std::array<const char *, 5> color_names = {"RED", "GREEN", "BLUE", "ORANGE", "PURPLE"};
+
+    /**
+     * @brief Index of a name in a list of upper case names, case insensitive, -1 when not found.
+     *
+     */
+    template <size_t N>
+    int find_name(const std::array<const char *, N> &names, const std::string &name)
+    {
+        std::string upper(name);
+        std::transform(upper.begin(), upper.end(), upper.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+        for (size_t k = 0; k < N; ++k)
+        {
+            if (upper == names[k])
+            {
+                return static_cast<int>(k);
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * @brief Parses a decimal number that makes up the whole string.
+     *
+     */
+    bool parse_number(const std::string &text, long &value)
+    {
+        // The characters go through unsigned char, the <cctype> functions are undefined for negative values
+        if (text.empty() || text.size() > 9 ||
+            !std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isdigit(c) != 0; }))
+        {
+            return false;
+        }
+        value = std::stol(text);
+        return true;
+    }
+
+    /**
+     * @brief  struct to store a waypoint while the parameters are read
+     *
+     */
+    struct partial_waypoint
+    {
+        std::string type;
+        std::string color;
+    };
+}
+
+MissionTable MissionTable::parse(const std::vector<std::pair<std::string, std::string>> &parameters)
+{
+    // Group the parameters by marker id and waypoint number, both sorted
+    std::map<long, std::map<long, partial_waypoint>> missions;
+    for (const auto &parameter : parameters)
+    {
+        const std::string &name = parameter.first;
+        if (name.compare(0, 6, "aruco_") != 0)
+        {
+            continue;
+        }
+
+        // aruco_<id>.wp<n>.<field>
+        size_t first_dot = name.find('.');
+        size_t second_dot = first_dot == std::string::npos ? std::string::npos : name.find('.', first_dot + 1);
+        long id = 0;
+        long number = 0;
+        if (second_dot == std::string::npos || !parse_number(name.substr(6, first_dot - 6), id) ||
+            name.compare(first_dot + 1, 2, "wp") != 0 || !parse_number(name.substr(first_dot + 3, second_dot - first_dot - 3), number))
+        {
+            throw std::runtime_error("Malformed mission parameter " + name);
+        }
+        if (id > max_marker_id)
+        {
+            throw std::runtime_error("Marker id of " + name + " is larger than " + std::to_string(max_marker_id));
+        }
+
+        std::string field = name.substr(second_dot + 1);
+        partial_waypoint &waypoint = missions[id][number];
+        if (field == "type")
+        {
+            waypoint.type = parameter.second;
+        }
+        else if (field == "color")
+        {
+            waypoint.color = parameter.second;
+        }
+        else
+        {
+            throw std::runtime_error("Unknown mission field " + name);
+        }
+    }
+
+    MissionTable table;
+    table.offsets_.assign(missions.empty() ? 1 : static_cast<size_t>(missions.rbegin()->first) + 2, 0);
+    for (const auto &entry : missions)
+    {
+        const std::string prefix = "aruco_" + std::to_string(entry.first);
+        long expected = 1;
+        for (const auto &numbered : entry.second)
+        {
+            const std::string name = prefix + ".wp" + std::to_string(numbered.first);
+            if (numbered.first != expected++)
+            {
+                throw std::runtime_error("Mission " + prefix + " has no wp" + std::to_string(expected - 1) + " before " + name);
+            }
+            mission_waypoint waypoint;
+            if (!parse_type(numbered.second.type, waypoint.type))
+            {
+                throw std::runtime_error("Unknown or missing type '" + numbered.second.type + "' for " + name);
+            }
+            if (!parse_color(numbered.second.color, waypoint.color))
+            {
+                throw std::runtime_error("Unknown or missing color '" + numbered.second.color + "' for " + name);
+            }
+            table.waypoints_.push_back(waypoint);
+        }
+        // The markers without a mission in between get empty ranges
+        std::fill(table.offsets_.begin() + entry.first + 1, table.offsets_.end(), static_cast<uint32_t>(table.waypoints_.size()));
+        table.mission_count_++;
+    }
+    return table;
+}
+
+bool MissionTable::parse_type(const std::string &name, part_type &type)
+{
+    int index = find_name(type_names, name);
+    type = static_cast<part_type>(std::max(index, 0));
+    return index >= 0;
+}
+
+bool MissionTable::parse_color(const std::string &name, part_color &color)
+{
+    int index = find_name(color_names, name);
+    color = static_cast<part_color>(std::max(index, 0));
+    return index >= 0;
+}
+
+const char *MissionTable::to_string(part_type type)
+{
+    return type_names[static_cast<size_t>(type)];
+}
+
+const char *MissionTable::to_string(part_color color)
+{
+    return color_names[static_cast<size_t>(color)];
+}
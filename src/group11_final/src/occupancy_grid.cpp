@@ -0,0 +1,466 @@
+#include "occupancy_grid.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    /**
+     * @brief  struct to store the fields of a Nav2 map yaml file
+     *
+     */
+    struct map_metadata
+    {
+        std::string image;
+        double resolution = 0.05;
+        double origin_x = 0.0;
+        double origin_y = 0.0;
+        bool negate = false;
+        double occupied_thresh = 0.65;
+        double free_thresh = 0.25;
+    };
+
+    std::string trim(const std::string &text)
+    {
+        size_t begin = text.find_first_not_of(" \t\r'\"");
+        size_t end = text.find_last_not_of(" \t\r'\"");
+        return begin == std::string::npos ? std::string() : text.substr(begin, end - begin + 1);
+    }
+
+    map_metadata read_metadata(const std::string &yaml_path)
+    {
+        std::ifstream file(yaml_path);
+        if (!file)
+        {
+            throw std::runtime_error("Cannot open map file " + yaml_path);
+        }
+
+        map_metadata metadata;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            line = line.substr(0, line.find('#'));
+            size_t colon = line.find(':');
+            if (colon == std::string::npos)
+            {
+                continue;
+            }
+            std::string key = trim(line.substr(0, colon));
+            std::string value = trim(line.substr(colon + 1));
+
+            if (key == "image")
+            {
+                metadata.image = value;
+            }
+            else if (key == "resolution")
+            {
+                metadata.resolution = std::stod(value);
+            }
+            else if (key == "origin")
+            {
+                std::string list = value.substr(value.find('[') + 1);
+                std::replace(list.begin(), list.end(), ',', ' ');
+                std::istringstream stream(list);
+                stream >> metadata.origin_x >> metadata.origin_y;
+            }
+            else if (key == "negate")
+            {
+                metadata.negate = value == "1" || value == "true";
+            }
+            else if (key == "occupied_thresh")
+            {
+                metadata.occupied_thresh = std::stod(value);
+            }
+            else if (key == "free_thresh")
+            {
+                metadata.free_thresh = std::stod(value);
+            }
+        }
+
+        if (metadata.image.empty())
+        {
+            throw std::runtime_error("Map file " + yaml_path + " has no image");
+        }
+        if (metadata.image.front() != '/')
+        {
+            size_t slash = yaml_path.find_last_of('/');
+            if (slash != std::string::npos)
+            {
+                metadata.image = yaml_path.substr(0, slash + 1) + metadata.image;
+            }
+        }
+        return metadata;
+    }
+
+    /**
+     * @brief  read only memory mapping of a file, unmapped when destroyed
+     *
+     */
+    class mapped_file
+    {
+    public:
+        explicit mapped_file(const std::string &path)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Cannot open map image " + path);
+            }
+            struct stat info;
+            if (::fstat(fd, &info) != 0 || info.st_size <= 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("Cannot read map image " + path);
+            }
+            size_ = static_cast<size_t>(info.st_size);
+            void *data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED)
+            {
+                throw std::runtime_error("Cannot map map image " + path);
+            }
+            ::madvise(data, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const uint8_t *>(data);
+        }
+        ~mapped_file() { ::munmap(const_cast<uint8_t *>(data_), size_); }
+        mapped_file(const mapped_file &) = delete;
+        mapped_file &operator=(const mapped_file &) = delete;
+
+        const uint8_t *data() const { return data_; }
+        size_t size() const { return size_; }
+
+    private:
+        const uint8_t *data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    /**
+     * @brief Reads the next token of a pgm header, skipping the comments. position is moved past the token.
+     *
+     */
+    std::string next_header_token(const mapped_file &file, size_t &position)
+    {
+        const uint8_t *data = file.data();
+        while (position < file.size())
+        {
+            if (data[position] == '#')
+            {
+                while (position < file.size() && data[position] != '\n')
+                {
+                    position++;
+                }
+            }
+            else if (std::isspace(data[position]))
+            {
+                position++;
+            }
+            else
+            {
+                break;
+            }
+        }
+        size_t begin = position;
+        while (position < file.size() && !std::isspace(data[position]))
+        {
+            position++;
+        }
+        if (begin == position)
+        {
+            throw std::runtime_error("Truncated pgm header");
+        }
+        return std::string(reinterpret_cast<const char *>(data + begin), position - begin);
+    }
+
+    /**
+     * @brief Returns a word with all the cells in the given state.
+     *
+     */
+    uint64_t fill_word(cell_state state)
+    {
+        return static_cast<uint64_t>(state) * 0x5555555555555555ull;
+    }
+
+    /**
+     * @brief Returns the mask of the bits of the columns first to last (inclusive) of a tile row.
+     *
+     */
+    uint64_t column_mask(int first, int last)
+    {
+        uint64_t high = last == OccupancyGrid::tile_width - 1 ? ~0ull : (1ull << (2 * (last + 1))) - 1;
+        uint64_t low = ~((1ull << (2 * first)) - 1);
+        return high & low;
+    }
+}
+
+OccupancyGrid::OccupancyGrid(int width, int height, double resolution, double origin_x, double origin_y, cell_state state)
+    : width_(width),
+      height_(height),
+      resolution_(resolution),
+      origin_x_(origin_x),
+      origin_y_(origin_y)
+{
+    allocate(state);
+}
+
+void OccupancyGrid::allocate(cell_state state)
+{
+    tiles_x_ = static_cast<size_t>((width_ + tile_width - 1) / tile_width);
+    size_t tiles_y = static_cast<size_t>((height_ + tile_height - 1) / tile_height);
+    word_count_ = tiles_x_ * tiles_y * tile_height;
+
+    // A tile is 8 words, so the size is a multiple of the 64 byte alignment
+    void *words = std::aligned_alloc(64, std::max<size_t>(word_count_, tile_height) * sizeof(uint64_t));
+    if (!words)
+    {
+        throw std::bad_alloc();
+    }
+    words_.reset(static_cast<uint64_t *>(words));
+    std::fill(words_.get(), words_.get() + word_count_, fill_word(state));
+}
+
+OccupancyGrid OccupancyGrid::load(const std::string &yaml_path)
+{
+    map_metadata metadata = read_metadata(yaml_path);
+    mapped_file image(metadata.image);
+
+    size_t position = 0;
+    if (next_header_token(image, position) != "P5")
+    {
+        throw std::runtime_error("Map image " + metadata.image + " is not a binary pgm");
+    }
+    int width = std::stoi(next_header_token(image, position));
+    int height = std::stoi(next_header_token(image, position));
+    int max_value = std::stoi(next_header_token(image, position));
+    position++;
+    if (width <= 0 || height <= 0 || max_value <= 0 || max_value > 255)
+    {
+        throw std::runtime_error("Unsupported pgm format in " + metadata.image);
+    }
+    if (image.size() < position + static_cast<size_t>(width) * height)
+    {
+        throw std::runtime_error("Truncated map image " + metadata.image);
+    }
+
+    // Classify every possible pixel value once
+    std::array<uint64_t, 256> states;
+    for (int value = 0; value < 256; ++value)
+    {
+        double occupancy = metadata.negate ? value / static_cast<double>(max_value) : 1.0 - value / static_cast<double>(max_value);
+        cell_state state = cell_state::unknown;
+        if (occupancy > metadata.occupied_thresh)
+        {
+            state = cell_state::occupied;
+        }
+        else if (occupancy < metadata.free_thresh)
+        {
+            state = cell_state::free;
+        }
+        states[static_cast<size_t>(value)] = static_cast<uint64_t>(state);
+    }
+
+    OccupancyGrid grid;
+    grid.width_ = width;
+    grid.height_ = height;
+    grid.resolution_ = metadata.resolution;
+    grid.origin_x_ = metadata.origin_x;
+    grid.origin_y_ = metadata.origin_y;
+    grid.allocate(cell_state::unknown);
+
+    // The first row of the image is the top of the map
+    const uint8_t *pixels = image.data() + position;
+    for (int row = 0; row < height; ++row)
+    {
+        int y = height - 1 - row;
+        const uint8_t *line = pixels + static_cast<size_t>(row) * width;
+        for (int x0 = 0; x0 < width; x0 += tile_width)
+        {
+            int count = std::min(tile_width, width - x0);
+            uint64_t word = count < tile_width ? fill_word(cell_state::unknown) & ~column_mask(0, count - 1) : 0;
+            for (int i = 0; i < count; ++i)
+            {
+                word |= states[line[x0 + i]] << (2 * i);
+            }
+            grid.words_.get()[grid.word_index(x0, y)] = word;
+        }
+    }
+    return grid;
+}
+
+void OccupancyGrid::set_state(int x, int y, cell_state state)
+{
+    if (!in_bounds(x, y))
+    {
+        return;
+    }
+    uint64_t &word = words_.get()[word_index(x, y)];
+    word = (word & ~(3ull << bit_shift(x))) | (static_cast<uint64_t>(state) << bit_shift(x));
+}
+
+bool OccupancyGrid::span_free(int y, int x0, int x1) const
+{
+    if (x0 > x1)
+    {
+        std::swap(x0, x1);
+    }
+    if (y < 0 || y >= height_ || x0 < 0 || x1 >= width_)
+    {
+        return false;
+    }
+
+    for (int x = x0; x <= x1; x = (x / tile_width + 1) * tile_width)
+    {
+        int last = std::min(x1, (x / tile_width + 1) * tile_width - 1);
+        if (words_.get()[word_index(x, y)] & column_mask(x % tile_width, last % tile_width))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool OccupancyGrid::rect_free(int x0, int y0, int x1, int y1) const
+{
+    if (y0 > y1)
+    {
+        std::swap(y0, y1);
+    }
+    for (int y = y0; y <= y1; ++y)
+    {
+        if (!span_free(y, x0, x1))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool OccupancyGrid::footprint_free(double x, double y, double radius) const
+{
+    double gx = (x - origin_x_) / resolution_;
+    double gy = (y - origin_y_) / resolution_;
+    double r = radius / resolution_;
+
+    for (int row = static_cast<int>(std::floor(gy - r)); row <= static_cast<int>(std::floor(gy + r)); ++row)
+    {
+        // Half width of the circle at the point of the row closest to the center
+        double dy = std::clamp(gy, static_cast<double>(row), row + 1.0) - gy;
+        double half = std::sqrt(std::max(0.0, r * r - dy * dy));
+        if (!span_free(row, static_cast<int>(std::floor(gx - half)), static_cast<int>(std::floor(gx + half))))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool OccupancyGrid::line_of_sight(const map_cell &from, const map_cell &to) const
+{
+    if (from.y == to.y)
+    {
+        return span_free(from.y, from.x, to.x);
+    }
+
+    // Walk the rows crossed by the segment and test the run of cells it covers in each row
+    double x_start = from.x + 0.5;
+    double y_start = from.y + 0.5;
+    double dx = to.x - from.x;
+    double dy = to.y - from.y;
+    int step = dy > 0 ? 1 : -1;
+    for (int row = from.y;; row += step)
+    {
+        double t0 = std::clamp((row - y_start) / dy, 0.0, 1.0);
+        double t1 = std::clamp((row + 1 - y_start) / dy, 0.0, 1.0);
+        double xa = x_start + dx * t0;
+        double xb = x_start + dx * t1;
+        if (!span_free(row, static_cast<int>(std::floor(std::min(xa, xb))), static_cast<int>(std::floor(std::max(xa, xb)))))
+        {
+            return false;
+        }
+        if (row == to.y)
+        {
+            break;
+        }
+    }
+    return true;
+}
+
+map_cell OccupancyGrid::world_to_cell(double x, double y) const
+{
+    return map_cell{static_cast<int>(std::floor((x - origin_x_) / resolution_)),
+                    static_cast<int>(std::floor((y - origin_y_) / resolution_))};
+}
+
+void OccupancyGrid::cell_to_world(const map_cell &cell, double &x, double &y) const
+{
+    x = origin_x_ + (cell.x + 0.5) * resolution_;
+    y = origin_y_ + (cell.y + 0.5) * resolution_;
+}
+
+bool OccupancyGrid::nearest_free(const map_cell &cell, int max_radius, map_cell &free) const
+{
+    if (is_free(cell.x, cell.y))
+    {
+        free = cell;
+        return true;
+    }
+
+    // A closer cell can still be found in the next rings while the ring radius is below the best distance
+    bool found = false;
+    int best = 0;
+    for (int radius = 1; radius <= max_radius && (!found || radius * radius <= best); ++radius)
+    {
+        for (int dy = -radius; dy <= radius; ++dy)
+        {
+            for (int dx = -radius; dx <= radius; ++dx)
+            {
+                if (std::abs(dx) != radius && std::abs(dy) != radius)
+                {
+                    continue;
+                }
+                int distance = dx * dx + dy * dy;
+                if (is_free(cell.x + dx, cell.y + dy) && (!found || distance < best))
+                {
+                    free = map_cell{cell.x + dx, cell.y + dy};
+                    best = distance;
+                    found = true;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+uint64_t OccupancyGrid::content_hash() const
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](uint64_t value)
+    {
+        for (int byte = 0; byte < 8; ++byte)
+        {
+            hash = (hash ^ ((value >> (8 * byte)) & 0xffu)) * 1099511628211ull;
+        }
+    };
+
+    uint64_t bits;
+    mix(static_cast<uint64_t>(width_));
+    mix(static_cast<uint64_t>(height_));
+    for (double value : {resolution_, origin_x_, origin_y_})
+    {
+        std::memcpy(&bits, &value, sizeof(bits));
+        mix(bits);
+    }
+    for (size_t i = 0; i < word_count_; ++i)
+    {
+        mix(words_.get()[i]);
+    }
+    return hash;
+}
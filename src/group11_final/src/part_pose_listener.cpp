@@ -1,47 +1,114 @@
 #include "part_pose_listener.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <ament_index_cpp/get_package_share_directory.hpp>
 
-void PartPoseListener::part_data(int part_color, int part_type, std::string &pat_color, std::string &pat_type)
-{
-    switch (part_color)
-    {
-    case mage_msgs::msg::Part::BLUE:
-        pat_color = "BLUE";
-        break;
-    case mage_msgs::msg::Part::GREEN:
-        pat_color = "GREEN";
-        break;
-    case mage_msgs::msg::Part::ORANGE:
-        pat_color = "ORANGE";
-        break;
-    case mage_msgs::msg::Part::RED:
-        pat_color = "RED";
-        break;
-    case mage_msgs::msg::Part::PURPLE:
-        pat_color = "PURPLE";
-        break;
-    }
-
-    switch (part_type)
-    {
-    case mage_msgs::msg::Part::BATTERY:
-        pat_type = "BATTERY";
-        break;
-    case mage_msgs::msg::Part::PUMP:
-        pat_type = "PUMP";
-        break;
-    case mage_msgs::msg::Part::SENSOR:
-        pat_type = "SENSOR";
-        break;
-    case mage_msgs::msg::Part::REGULATOR:
-        pat_type = "REGULATOR";
-        break;
-    }
-    std::transform(pat_color.begin(), pat_color.end(), pat_color.begin(), ::toupper);
-    std::transform(pat_type.begin(), pat_type.end(), pat_type.begin(), ::toupper);
+namespace
+{
+    // Length of the end of a path used for its arrival heading, the same 10 cells as the DistanceMatrix
+    constexpr size_t heading_lookback = 10;
+
+    /**
+     * @brief Returns the heading (radians, map frame) in which a path of cells arrives at its last cell, NaN for a path of one cell.
+     *
+     */
+    double arrival_heading(const std::vector<map_cell> &path)
+    {
+        if (path.size() < 2)
+        {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        const map_cell &from = path[path.size() - 1 - std::min(heading_lookback, path.size() - 1)];
+        return std::atan2(static_cast<double>(path.back().y - from.y), static_cast<double>(path.back().x - from.x));
+    }
+
+    /**
+     * @brief Copies a pose to x, y, z and the quaternion x, y, z, w, the layout of the snapshot poses.
+     *
+     */
+    void pose_to_array(const geometry_msgs::msg::Pose &pose, double *values)
+    {
+        values[0] = pose.position.x;
+        values[1] = pose.position.y;
+        values[2] = pose.position.z;
+        values[3] = pose.orientation.x;
+        values[4] = pose.orientation.y;
+        values[5] = pose.orientation.z;
+        values[6] = pose.orientation.w;
+    }
+
+    geometry_msgs::msg::Pose array_to_pose(const double *values)
+    {
+        geometry_msgs::msg::Pose pose;
+        pose.position.x = values[0];
+        pose.position.y = values[1];
+        pose.position.z = values[2];
+        pose.orientation.x = values[3];
+        pose.orientation.y = values[4];
+        pose.orientation.z = values[5];
+        pose.orientation.w = values[6];
+        return pose;
+    }
+
+    /**
+     * @brief Converts between the messages and the types of the core logic.
+     *
+     */
+    pose3 to_core(const geometry_msgs::msg::Pose &pose)
+    {
+        return pose3{point3{pose.position.x, pose.position.y, pose.position.z},
+                     quaternion{pose.orientation.x, pose.orientation.y, pose.orientation.z, pose.orientation.w}};
+    }
+
+    rigid_transform to_core(const geometry_msgs::msg::Transform &transform)
+    {
+        return rigid_transform{point3{transform.translation.x, transform.translation.y, transform.translation.z},
+                               quaternion{transform.rotation.x, transform.rotation.y, transform.rotation.z, transform.rotation.w}};
+    }
+
+    geometry_msgs::msg::Pose from_core(const pose3 &pose)
+    {
+        geometry_msgs::msg::Pose message;
+        message.position.x = pose.position.x;
+        message.position.y = pose.position.y;
+        message.position.z = pose.position.z;
+        message.orientation.x = pose.orientation.x;
+        message.orientation.y = pose.orientation.y;
+        message.orientation.z = pose.orientation.z;
+        message.orientation.w = pose.orientation.w;
+        return message;
+    }
+
+    MissionSequencer::goal_result to_core(rclcpp_action::ResultCode code)
+    {
+        switch (code)
+        {
+        case rclcpp_action::ResultCode::SUCCEEDED:
+            return MissionSequencer::goal_result::succeeded;
+        case rclcpp_action::ResultCode::ABORTED:
+            return MissionSequencer::goal_result::aborted;
+        case rclcpp_action::ResultCode::CANCELED:
+            return MissionSequencer::goal_result::canceled;
+        default:
+            return MissionSequencer::goal_result::unknown;
+        }
+    }
 }
 
 void PartPoseListener::camera_callback(const mage_msgs::msg::AdvancedLogicalCameraImage::SharedPtr msg, const std::string &camera_name)
 {
+    // The image id is only computed when tracing, the hash covers every part of the image
+    uint64_t trace_id = 0;
+    if (trace_)
+    {
+        uint64_t received = trace::TraceBuffer::now_ns();
+        trace_id = trace::image_id(*msg);
+        trace_->emit_at(received, trace::camera_callback, trace_id);
+    }
+
     std::string camera_frame;
 
     try
@@ -74,46 +141,58 @@ void PartPoseListener::camera_callback(const mage_msgs::msg::AdvancedLogicalCame
 
         if (!info_logged_)
         {
+            bool new_parts = false;
+            rclcpp::Time stamp = this->get_clock()->now();
             for (const auto &part_pose : msg->part_poses)
             {
-                std::string pat_color, pat_type;
-                part_data(part_pose.part.color, part_pose.part.type, pat_color, pat_type);
-
-                geometry_msgs::msg::PoseStamped stamped_pose;
-                stamped_pose.header.frame_id = camera_frame;
-                stamped_pose.header.stamp = this->get_clock()->now();
-                stamped_pose.pose = part_pose.pose;
+                part_color color;
+                part_type type;
+                if (!classify_part(part_pose.part.color, part_pose.part.type, color, type))
+                {
+                    continue;
+                }
 
                 geometry_msgs::msg::TransformStamped transformStamped = tf_buffer.lookupTransform(
                     "map", camera_frame, tf2::TimePointZero);
-                geometry_msgs::msg::PoseStamped pose_transformed;
-                tf2::doTransform(stamped_pose, pose_transformed, transformStamped);
+                geometry_msgs::msg::Pose map_pose = from_core(transform_pose(to_core(transformStamped.transform), to_core(part_pose.pose)));
 
-                part_key key{pat_color, pat_type};
+                part_key key{color, type};
+                double weight = observation_weight(part_pose.pose);
 
-                if (part_poses_.find(key) == part_poses_.end())
+                auto estimate = part_poses_.find(key);
+                if (estimate == part_poses_.end())
                 {
-                    part_poses_[key] = pose_transformed.pose;
-                    parts_detected++;
-                    detected_part detected_part{pat_type, pat_color, pose_transformed.pose};
+                    part_poses_[key] = part_estimate{map_pose, stamp, detected_parts_.size(), weight, weight, 0,
+                                                     map_pose.position};
+                    new_parts = true;
+                    metrics_.part_detected(now_seconds());
+                    detected_part detected_part{type, color, map_pose, trace_id};
                     detected_parts_.push_back(detected_part);
-
-                    if (parts_detected >= total_parts_to_detect && !all_parts_logged_)
-                    {
-                        log_all_part_poses();
-                        all_parts_logged_ = true;
-                        camera1_subscription.reset();
-                        camera2_subscription.reset();
-                        camera3_subscription.reset();
-                        camera4_subscription.reset();
-                        camera5_subscription.reset();
-                        info_logged_ = true;
-                        break;
-                    }
+                }
+                else
+                {
+                    track_part(key, estimate->second, map_pose, weight, stamp);
+                    // A part restored from the snapshot counts as detected once a camera sees it again
+                    estimate->second.restored = false;
                 }
             }
-            process_detected_parts();
-            navigate_to_waypoints();
+            if (trace_)
+            {
+                trace_->emit(trace::transform_done, trace_id);
+            }
+
+            // In continuous mode the waypoints are only matched again when a new part shows up, moved parts are
+            // pushed individually by track_part.
+            if (new_parts || !continuous_tracking_)
+            {
+                process_detected_parts();
+                sequencer_->navigate();
+                prefetch_mission();
+            }
+            if (!all_parts_logged_ && required_parts_detected())
+            {
+                finish_part_detection();
+            }
         }
     }
     catch (tf2::TransformException &ex)
@@ -124,34 +203,615 @@ void PartPoseListener::camera_callback(const mage_msgs::msg::AdvancedLogicalCame
 
 void PartPoseListener::aruco_marker_callback(const ros2_aruco_interfaces::msg::ArucoMarkers::SharedPtr msg)
 {
-    if (!msg->marker_ids.empty())
+    // Every marker in view is queued once, the subscription stays alive so that the missions can be chained
+    std::vector<long> unknown;
+    std::vector<marker_mission> new_missions = new_marker_missions(msg->marker_ids, *missions_, markers_seen_, unknown);
+    for (long aruco_id : unknown)
+    {
+        RCLCPP_ERROR(this->get_logger(), "No mission for aruco marker %ld", aruco_id);
+    }
+
+    for (const auto &marker : new_missions)
+    {
+        queued_mission next;
+        next.marker_id = marker.marker_id;
+        if (marker.index < msg->poses.size())
+        {
+            next.marker_pose = to_core(msg->poses[marker.index]);
+        }
+        next.waypoints.reserve(marker.steps.size);
+        for (const auto &step : marker.steps)
+        {
+            waypoint waypoint;
+            waypoint.type = step.type;
+            waypoint.color = step.color;
+            next.waypoints.push_back(waypoint);
+        }
+        RCLCPP_INFO(this->get_logger(), "Queued the mission of aruco marker %ld with %zu waypoints, marker at [x = %f, y = %f, z = %f]",
+                    next.marker_id, next.waypoints.size(), next.marker_pose.position.x, next.marker_pose.position.y,
+                    next.marker_pose.position.z);
+        sequencer_->queue_mission(std::move(next));
+    }
+
+    if (new_missions.empty())
+    {
+        return;
+    }
+    if (sequencer_->mission_finished())
+    {
+        start_next_mission();
+    }
+    else
+    {
+        prefetch_mission();
+    }
+}
+
+void PartPoseListener::start_next_mission()
+{
+    if (!sequencer_->start_next_mission())
+    {
+        if (sequencer_->marker_id() >= 0)
+        {
+            RCLCPP_INFO(this->get_logger(), "Mission of aruco marker %ld done, waiting for the next marker", sequencer_->marker_id());
+        }
+        return;
+    }
+    metrics_.mission_started(sequencer_->marker_id(), now_seconds());
+    RCLCPP_INFO(this->get_logger(), "Starting the mission of aruco marker %ld with %zu waypoints, %zu resolved, %zu missions queued",
+                sequencer_->marker_id(), sequencer_->waypoints().size(), sequencer_->resolved_waypoints(),
+                sequencer_->queued_missions());
+
+    // Every mission finishes its own part detection, the cameras come back when it needs a part not seen yet
+    all_parts_logged_ = false;
+    if (!required_parts_detected())
+    {
+        resume_part_detection();
+    }
+
+    // Parts detected before the marker can resolve the waypoints right away
+    if (!detected_parts_.empty() && !sequencer_->all_waypoints_resolved())
+    {
+        process_detected_parts();
+    }
+    if (!all_parts_logged_ && required_parts_detected())
+    {
+        finish_part_detection();
+    }
+    sequencer_->navigate();
+    prefetch_mission();
+}
+
+MissionSequencer::hooks PartPoseListener::sequencer_hooks()
+{
+    MissionSequencer::hooks hooks;
+    hooks.send_goal = [this](size_t first, size_t count, size_t sequence)
+    {
+        return count > 1 ? send_through_poses_goal(first, count, sequence) : send_navigation_goal(first, sequence);
+    };
+    hooks.send_fleet_goal = [this](size_t robot, size_t sequence)
+    {
+        send_fleet_goal(robot, sequence);
+    };
+    hooks.cancel_goal = [this](long robot)
+    {
+        if (robot >= 0)
+        {
+            fleet_robot &fleet_robot = robots_[static_cast<size_t>(robot)];
+            if (fleet_robot.goal_handle)
+            {
+                fleet_robot.client->async_cancel_goal(fleet_robot.goal_handle);
+            }
+            fleet_robot.goal_handle.reset();
+            return;
+        }
+        if (current_goal_handle_)
+        {
+            navigate_to_pose_client_->async_cancel_goal(current_goal_handle_);
+        }
+        if (current_poses_goal_handle_)
+        {
+            navigate_through_poses_client_->async_cancel_goal(current_poses_goal_handle_);
+        }
+        current_goal_handle_.reset();
+        current_poses_goal_handle_.reset();
+    };
+    hooks.schedule_retry = [this](long robot, double delay, size_t sequence)
+    {
+        schedule_retry(robot, delay, sequence);
+    };
+    hooks.robot_ready = [this](size_t robot)
+    {
+        return robots_[robot].client->action_server_is_ready();
+    };
+    hooks.costs = [this](const std::vector<point3> &points, std::vector<double> *arrivals, size_t first_waypoint)
+    {
+        return waypoint_cost_matrix(points, arrivals, first_waypoint);
+    };
+    hooks.waypoint_reached = [this](size_t waypoint)
+    {
+        record_waypoint_metrics(waypoint);
+    };
+    hooks.goal_aborted = [this](size_t waypoint)
+    {
+        metrics_.goal_aborted(waypoint);
+        publish_metrics();
+    };
+    hooks.waypoints_reordered = [this]()
+    {
+        log_waypoints();
+    };
+    hooks.mission_done = [this]()
+    {
+        record_mission_metrics();
+        start_next_mission();
+    };
+    hooks.log = [this](MissionSequencer::log_level level, const std::string &message)
+    {
+        switch (level)
+        {
+        case MissionSequencer::log_level::info:
+            RCLCPP_INFO(this->get_logger(), "%s", message.c_str());
+            break;
+        case MissionSequencer::log_level::warn:
+            RCLCPP_WARN(this->get_logger(), "%s", message.c_str());
+            break;
+        default:
+            RCLCPP_ERROR(this->get_logger(), "%s", message.c_str());
+            break;
+        }
+    };
+    return hooks;
+}
+
+void PartPoseListener::prefetch_mission()
+{
+    queued_mission *queued = sequencer_->next_mission();
+    if (!queued || queued->planned)
+    {
+        return;
+    }
+
+    // Resolve the waypoints of the next mission with the parts detected so far, bound the same way as process_detected_parts
+    // binds them when the mission starts
+    queued_mission &next = *queued;
+    for (const part_match &match : match_parts(detected_parts_, next.waypoints))
+    {
+        const detected_part &detected_part = detected_parts_[match.part];
+        waypoint &waypoint = next.waypoints[match.waypoint];
+        waypoint.pose = to_core(goal_pose(detected_part.pose));
+        waypoint.pose_assigned = true;
+        waypoint.trace_id = detected_part.trace_id;
+    }
+    if (!std::all_of(next.waypoints.begin(), next.waypoints.end(), [](const waypoint &waypoint)
+                     { return waypoint.pose_assigned; }))
+    {
+        return;
+    }
+
+    // Plan the routes between its waypoints now, so that they come from the route cache when the mission starts
+    std::vector<point3> points;
+    points.reserve(next.waypoints.size());
+    for (const auto &waypoint : next.waypoints)
+    {
+        points.push_back(waypoint.pose.position);
+    }
+    waypoint_cost_matrix(points);
+    next.planned = true;
+    RCLCPP_INFO(this->get_logger(), "Prefetched the mission of aruco marker %ld", next.marker_id);
+}
+
+void PartPoseListener::reload_missions_callback(const std::shared_ptr<std_srvs::srv::Trigger::Request>,
+                                                std::shared_ptr<std_srvs::srv::Trigger::Response> response)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<const MissionTable> missions;
+    try
     {
-        long aruco_id = msg->marker_ids[0];
-        aruco_marker_subscription_.reset();
-        if (!declared)
+        std::string file = mission_file_.empty()
+                               ? ament_index_cpp::get_package_share_directory("group11_final") + "/config/waypoint_params.yaml"
+                               : mission_file_;
+        std::vector<std::pair<std::string, std::string>> mission_parameters;
+        for (const auto &node : rclcpp::parameter_map_from_yaml_file(file))
         {
-            for (int i = 0; i < 5; ++i)
+            if (node.first != this->get_fully_qualified_name() && node.first != "/**")
+            {
+                continue;
+            }
+            for (const auto &parameter : node.second)
             {
-                std::string base_param_path = "aruco_" + std::to_string(aruco_id) + ".wp" + std::to_string(i + 1);
-                this->declare_parameter<std::string>(base_param_path + ".type", "default_type");
-                this->declare_parameter<std::string>(base_param_path + ".color", "default_color");
+                if (parameter.get_type() == rclcpp::ParameterType::PARAMETER_STRING)
+                {
+                    mission_parameters.emplace_back(parameter.get_name(), parameter.as_string());
+                }
             }
-            declared = true;
         }
-        std::string base_param_path = "aruco_" + std::to_string(aruco_id);
+        missions = std::make_shared<const MissionTable>(MissionTable::parse(mission_parameters));
+    }
+    catch (const std::exception &ex)
+    {
+        response->success = false;
+        response->message = std::string("Missions not reloaded: ") + ex.what();
+        RCLCPP_ERROR(this->get_logger(), "%s", response->message.c_str());
+        return;
+    }
 
-        for (int i = 0; i < 5; ++i)
+    missions_ = missions;
+    long marker_id = sequencer_->marker_id();
+    if (marker_id >= 0)
+    {
+        mission steps = missions->find(marker_id);
+        if (steps.size == 0)
+        {
+            RCLCPP_WARN(this->get_logger(), "The new missions have no mission for marker %ld, keeping its waypoints", marker_id);
+        }
+        else
         {
-            std::string wp_key = "wp" + std::to_string(i + 1);
-            std::string type_key = base_param_path + "." + wp_key + ".type";
-            std::string color_key = base_param_path + "." + wp_key + ".color";
+            apply_mission(steps);
+        }
+    }
 
-            waypoint waypoint;
-            this->get_parameter(type_key, waypoint.type);
-            this->get_parameter(color_key, waypoint.color);
-            waypoints_.push_back(waypoint);
+    // The queued missions have not started, they are built again from the new table
+    std::vector<long> dropped;
+    sequencer_->reload_queue(*missions, dropped);
+    for (long dropped_marker : dropped)
+    {
+        RCLCPP_WARN(this->get_logger(), "The new missions have no mission for marker %ld, dropping it from the queue", dropped_marker);
+    }
+    prefetch_mission();
+
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    response->success = true;
+    response->message = "Reloaded the missions of " + std::to_string(missions->mission_count()) + " markers";
+    RCLCPP_INFO(this->get_logger(), "%s in %.2f ms", response->message.c_str(), elapsed);
+}
+
+void PartPoseListener::apply_mission(const mission &steps)
+{
+    size_t first_open = sequencer_->replace_mission(steps);
+
+    // Only the parts that lost their waypoint are matched again, the others keep their binding
+    const std::vector<waypoint> &waypoints = sequencer_->waypoints();
+    for (const auto &detected_part : detected_parts_)
+    {
+        if (sequencer_->bound_waypoint(detected_part.type, detected_part.color) != MissionSequencer::no_waypoint)
+        {
+            continue;
+        }
+        for (size_t i = first_open; i < waypoints.size(); ++i)
+        {
+            const waypoint &waypoint = waypoints[i];
+            if (waypoint.type == detected_part.type && waypoint.color == detected_part.color && !waypoint.pose_assigned)
+            {
+                sequencer_->resolve_waypoint(i, to_core(goal_pose(detected_part.pose)), detected_part.trace_id);
+                part_poses_[part_key{detected_part.color, detected_part.type}].pushed_position = detected_part.pose.position;
+                trace_waypoint(trace::waypoint_resolved, i);
+                break;
+            }
+        }
+    }
+    log_waypoints();
+    if (!required_parts_detected())
+    {
+        resume_part_detection();
+    }
+    else if (!all_parts_logged_)
+    {
+        finish_part_detection();
+    }
+    sequencer_->navigate();
+}
+
+void PartPoseListener::save_snapshot()
+{
+    snapshot state;
+    state.marker_id = sequencer_->marker_id();
+    state.current_waypoint_index = sequencer_->current_waypoint();
+    state.parts.reserve(detected_parts_.size());
+    for (const auto &detected_part : detected_parts_)
+    {
+        const part_estimate &estimate = part_poses_.at(part_key{detected_part.color, detected_part.type});
+        snapshot_part part;
+        part.color = detected_part.color;
+        part.type = detected_part.type;
+        pose_to_array(estimate.pose, part.pose);
+        part.weight = estimate.weight;
+        part.best_weight = estimate.best_weight;
+        state.parts.push_back(part);
+    }
+    state.waypoints.reserve(sequencer_->waypoints().size());
+    for (const auto &waypoint : sequencer_->waypoints())
+    {
+        snapshot_waypoint saved;
+        saved.type = waypoint.type;
+        saved.color = waypoint.color;
+        saved.pose_assigned = waypoint.pose_assigned;
+        saved.reached = waypoint.reached;
+        pose_to_array(from_core(waypoint.pose), saved.pose);
+        state.waypoints.push_back(saved);
+    }
+
+    // The writer thread skips the snapshots that did not change and does the blocking write
+    snapshot_writer_->submit(MissionSnapshot::encode(state));
+}
+
+void PartPoseListener::restore_snapshot()
+{
+    snapshot state;
+    try
+    {
+        if (!MissionSnapshot::read(snapshot_file_, state))
+        {
+            RCLCPP_INFO(this->get_logger(), "No snapshot in %s, starting without detected parts", snapshot_file_.c_str());
+            return;
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        RCLCPP_WARN(this->get_logger(), "Ignoring the snapshot: %s", ex.what());
+        return;
+    }
+
+    // A restored part counts as one observation, so the first detections after the restart quickly replace it
+    rclcpp::Time now = this->get_clock()->now();
+    for (const auto &part : state.parts)
+    {
+        part_key key{part.color, part.type};
+        if (part_poses_.count(key) != 0)
+        {
+            continue;
+        }
+        geometry_msgs::msg::Pose pose = array_to_pose(part.pose);
+        part_poses_[key] = part_estimate{pose, now, detected_parts_.size(), part.best_weight, part.best_weight, 0, pose.position, true};
+        detected_parts_.push_back(detected_part{part.type, part.color, pose});
+    }
+
+    // The mission progress is only restored when the mission of the marker has the same parts, in any order
+    mission steps = missions_->find(state.marker_id);
+    std::unordered_map<part_key, int, part_key_hash> balance;
+    for (const auto &step : steps)
+    {
+        balance[part_key{step.color, step.type}]++;
+    }
+    for (const auto &saved : state.waypoints)
+    {
+        balance[part_key{saved.color, saved.type}]--;
+    }
+    bool same_parts = std::all_of(balance.begin(), balance.end(), [](const std::pair<const part_key, int> &count)
+                                  { return count.second == 0; });
+    if (state.marker_id < 0 || steps.size == 0 || !same_parts)
+    {
+        if (state.marker_id >= 0)
+        {
+            RCLCPP_WARN(this->get_logger(), "The mission of aruco marker %ld changed since the snapshot, only the parts are restored",
+                        state.marker_id);
+        }
+        RCLCPP_INFO(this->get_logger(), "Restored %zu parts from %s", state.parts.size(), snapshot_file_.c_str());
+        return;
+    }
+
+    markers_seen_.insert(state.marker_id);
+    std::vector<waypoint> waypoints;
+    waypoints.reserve(state.waypoints.size());
+    for (const auto &saved : state.waypoints)
+    {
+        waypoint restored;
+        restored.type = saved.type;
+        restored.color = saved.color;
+        restored.pose = to_core(array_to_pose(saved.pose));
+        restored.pose_assigned = saved.pose_assigned;
+        restored.reached = saved.reached;
+        waypoints.push_back(restored);
+    }
+    sequencer_->restore(state.marker_id, std::move(waypoints), static_cast<size_t>(state.current_waypoint_index));
+    metrics_.mission_started(state.marker_id, now_seconds());
+    RCLCPP_INFO(this->get_logger(), "Restored %zu parts and the mission of aruco marker %ld at waypoint %zu of %zu from %s",
+                state.parts.size(), state.marker_id, sequencer_->current_waypoint(), sequencer_->waypoints().size(),
+                snapshot_file_.c_str());
+}
+
+double PartPoseListener::now_seconds()
+{
+    return this->get_clock()->now().seconds();
+}
+
+void PartPoseListener::record_waypoint_metrics(size_t waypoint)
+{
+    append_metrics_csv(MissionMetrics::csv_row(metrics_.goal_succeeded(waypoint, now_seconds())));
+    publish_metrics();
+}
+
+void PartPoseListener::record_mission_metrics()
+{
+    mission_metrics metrics = metrics_.mission_finished(now_seconds());
+    RCLCPP_INFO(this->get_logger(), "Mission of aruco marker %ld: %zu waypoints in %.1f s, %.1f m travelled, %zu aborts",
+                metrics.marker_id, metrics.waypoints_reached, metrics.duration, metrics.distance, metrics.aborts);
+    append_metrics_csv(MissionMetrics::csv_row(metrics));
+    metrics_file_.flush();
+    publish_metrics();
+}
+
+void PartPoseListener::publish_metrics()
+{
+    mission_metrics metrics = metrics_.current(now_seconds());
+    diagnostic_msgs::msg::DiagnosticStatus status;
+    status.level = metrics.aborts > 0 ? diagnostic_msgs::msg::DiagnosticStatus::WARN : diagnostic_msgs::msg::DiagnosticStatus::OK;
+    status.name = "mission";
+    status.hardware_id = this->get_fully_qualified_name();
+    status.message = "aruco marker " + std::to_string(metrics.marker_id);
+    auto add = [&status](const std::string &key, const std::string &value)
+    {
+        diagnostic_msgs::msg::KeyValue entry;
+        entry.key = key;
+        entry.value = value;
+        status.values.push_back(entry);
+    };
+    add("marker_id", std::to_string(metrics.marker_id));
+    add("time_to_first_detection", std::to_string(metrics.first_detection));
+    add("time_to_all_detected", std::to_string(metrics.all_detected));
+    add("duration", std::to_string(metrics.duration));
+    add("distance", std::to_string(metrics.distance));
+    add("waypoints_reached", std::to_string(metrics.waypoints_reached));
+    add("aborts", std::to_string(metrics.aborts));
+    add("mean_dispatch_to_accept", std::to_string(metrics.mean_dispatch_to_accept));
+    add("mean_accept_to_succeed", std::to_string(metrics.mean_accept_to_succeed));
+    metrics_publisher_->publish(status);
+}
+
+void PartPoseListener::open_metrics_csv()
+{
+    if (metrics_csv_.empty())
+    {
+        return;
+    }
+    metrics_file_.open(metrics_csv_, std::ios::app);
+    if (!metrics_file_)
+    {
+        RCLCPP_WARN(this->get_logger(), "Cannot append to the metrics file %s", metrics_csv_.c_str());
+        return;
+    }
+    metrics_file_.seekp(0, std::ios::end);
+    if (metrics_file_.tellp() == 0)
+    {
+        metrics_file_ << MissionMetrics::csv_header() << "\n";
+    }
+}
+
+void PartPoseListener::append_metrics_csv(const std::string &row)
+{
+    if (metrics_file_.is_open())
+    {
+        metrics_file_ << row << "\n";
+    }
+}
+
+void PartPoseListener::subscribe_cameras()
+{
+    auto qos = rclcpp::SensorDataQoS();
+    camera1_subscription = this->create_subscription<mage_msgs::msg::AdvancedLogicalCameraImage>(
+        "/mage/camera1/image", qos,
+        [this](const mage_msgs::msg::AdvancedLogicalCameraImage::SharedPtr msg)
+        {
+            this->camera_callback(msg, "Camera 1");
+        });
+
+    camera2_subscription = this->create_subscription<mage_msgs::msg::AdvancedLogicalCameraImage>(
+        "/mage/camera2/image", qos,
+        [this](const mage_msgs::msg::AdvancedLogicalCameraImage::SharedPtr msg)
+        {
+            this->camera_callback(msg, "Camera 2");
+        });
+
+    camera3_subscription = this->create_subscription<mage_msgs::msg::AdvancedLogicalCameraImage>(
+        "/mage/camera3/image", qos,
+        [this](const mage_msgs::msg::AdvancedLogicalCameraImage::SharedPtr msg)
+        {
+            this->camera_callback(msg, "Camera 3");
+        });
+
+    camera4_subscription = this->create_subscription<mage_msgs::msg::AdvancedLogicalCameraImage>(
+        "/mage/camera4/image", qos,
+        [this](const mage_msgs::msg::AdvancedLogicalCameraImage::SharedPtr msg)
+        {
+            this->camera_callback(msg, "Camera 4");
+        });
+
+    camera5_subscription = this->create_subscription<mage_msgs::msg::AdvancedLogicalCameraImage>(
+        "/mage/camera5/image", qos,
+        [this](const mage_msgs::msg::AdvancedLogicalCameraImage::SharedPtr msg)
+        {
+            this->camera_callback(msg, "Camera 5");
+        });
+}
+
+void PartPoseListener::resume_part_detection()
+{
+    all_parts_logged_ = false;
+    if (!info_logged_)
+    {
+        return;
+    }
+    RCLCPP_INFO(this->get_logger(), "The mission needs parts not detected yet, subscribing to the cameras again");
+    info_logged_ = false;
+    subscribe_cameras();
+}
+
+bool PartPoseListener::required_parts_detected() const
+{
+    if (sequencer_->marker_id() < 0 || sequencer_->waypoints().empty())
+    {
+        return false;
+    }
+    // A part repeated in the mission is one part, and the parts the mission does not need are not waited for
+    for (const auto &waypoint : sequencer_->waypoints())
+    {
+        auto estimate = part_poses_.find(part_key{waypoint.color, waypoint.type});
+        if (estimate == part_poses_.end() || estimate->second.restored)
+        {
+            return false;
         }
     }
+    return true;
+}
+
+void PartPoseListener::finish_part_detection()
+{
+    metrics_.all_parts_detected(now_seconds());
+    log_all_part_poses();
+    all_parts_logged_ = true;
+    if (!continuous_tracking_)
+    {
+        camera1_subscription.reset();
+        camera2_subscription.reset();
+        camera3_subscription.reset();
+        camera4_subscription.reset();
+        camera5_subscription.reset();
+        info_logged_ = true;
+    }
+}
+
+void PartPoseListener::start_event_log(size_t capacity, double max_rate)
+{
+    // rclcpp loggers can be used from any thread
+    rclcpp::Logger logger = this->get_logger();
+    event_log_ = std::make_unique<EventLog>(capacity, [logger](const std::string &line)
+                                            { RCLCPP_INFO(logger, "%s", line.c_str()); });
+
+    // Formats a part event as "<prefix>: Type = ..., Color = ..., Pose: [x = ..., y = ..., z = ...]"
+    auto part_format = [](const char *prefix, bool numbered)
+    {
+        return [prefix, numbered](const log_record &record)
+        {
+            char line[256];
+            char name[64];
+            std::snprintf(name, sizeof(name), numbered ? "%s %u" : "%s", prefix, record.index);
+            std::snprintf(line, sizeof(line), "%s: Type = %s, Color = %s, Pose: [x = %f, y = %f, z = %f]", name,
+                          MissionTable::to_string(static_cast<part_type>(record.codes[0])),
+                          MissionTable::to_string(static_cast<part_color>(record.codes[1])), record.values[0], record.values[1],
+                          record.values[2]);
+            return std::string(line);
+        };
+    };
+    event_log_->register_event(static_cast<uint16_t>(log_event::detected_part), "detected part", max_rate,
+                               part_format("Processing Detected Part", false));
+    event_log_->register_event(static_cast<uint16_t>(log_event::waypoint), "waypoint", max_rate, part_format("waypoint", true));
+    event_log_->register_event(static_cast<uint16_t>(log_event::part_pose), "part pose", max_rate, part_format("Part", false));
+    event_log_->register_event(static_cast<uint16_t>(log_event::part_moved), "part moved", max_rate, part_format("Part moved", false));
+    event_log_->start();
+}
+
+void PartPoseListener::log_part(log_event event, uint32_t index, part_type type, part_color color,
+                                const geometry_msgs::msg::Point &position)
+{
+    log_record record;
+    record.event = static_cast<uint16_t>(event);
+    record.codes[0] = static_cast<uint8_t>(type);
+    record.codes[1] = static_cast<uint8_t>(color);
+    record.index = index;
+    record.values[0] = position.x;
+    record.values[1] = position.y;
+    record.values[2] = position.z;
+    event_log_->push(record);
 }
 
 void PartPoseListener::log_all_part_poses()
@@ -159,9 +819,8 @@ void PartPoseListener::log_all_part_poses()
     for (const auto &entry : part_poses_)
     {
         const auto &key = entry.first;
-        const auto &pose = entry.second;
-        RCLCPP_INFO(this->get_logger(), "Part: Color = %s, Type = %s, Pose: x = %f, y = %f, z = %f",
-                    key.color.c_str(), key.type.c_str(), pose.position.x, pose.position.y, pose.position.z);
+        log_part(log_event::part_pose, static_cast<uint32_t>(entry.second.detected_index), key.type, key.color,
+                 entry.second.pose.position);
     }
 }
 
@@ -169,52 +828,117 @@ void PartPoseListener::process_detected_parts()
 {
     for (const auto &detected_part : detected_parts_)
     {
-        RCLCPP_INFO(this->get_logger(), "Processing Detected Part: Type = %s, Color = %s, Pose: [x = %f, y = %f, z = %f]",
-                    detected_part.type.c_str(), detected_part.color.c_str(),
-                    detected_part.pose.position.x, detected_part.pose.position.y, detected_part.pose.position.z);
-        std::string detected_type = detected_part.type;
-        std::string detected_color = detected_part.color;
+        log_part(log_event::detected_part, static_cast<uint32_t>(&detected_part - detected_parts_.data()), detected_part.type,
+                 detected_part.color, detected_part.pose.position);
+    }
 
-        std::transform(detected_type.begin(), detected_type.end(), detected_type.begin(), ::toupper);
-        std::transform(detected_color.begin(), detected_color.end(), detected_color.begin(), ::toupper);
+    for (const part_match &match : match_parts(detected_parts_, sequencer_->waypoints()))
+    {
+        const detected_part &detected_part = detected_parts_[match.part];
+        sequencer_->resolve_waypoint(match.waypoint, to_core(goal_pose(detected_part.pose)), detected_part.trace_id);
+        part_poses_[part_key{detected_part.color, detected_part.type}].pushed_position = detected_part.pose.position;
+        trace_waypoint(trace::waypoint_resolved, match.waypoint);
+    }
+    log_waypoints();
+}
 
-        for (auto &waypoint : waypoints_)
-        {
-            std::string waypoint_type = waypoint.type;
-            std::string waypoint_color = waypoint.color;
+double PartPoseListener::observation_weight(const geometry_msgs::msg::Pose &camera_pose) const
+{
+    // The logical camera looks along its x axis
+    const auto &p = camera_pose.position;
+    double range = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+    double angle = std::atan2(std::sqrt(p.y * p.y + p.z * p.z), p.x);
+    double sigma = fusion_base_sigma_ + fusion_range_sigma_ * range + fusion_angle_sigma_ * std::abs(angle);
+    return 1.0 / (sigma * sigma);
+}
 
-            std::transform(waypoint_type.begin(), waypoint_type.end(), waypoint_type.begin(), ::toupper);
-            std::transform(waypoint_color.begin(), waypoint_color.end(), waypoint_color.begin(), ::toupper);
+void PartPoseListener::track_part(const part_key &key, part_estimate &estimate, const geometry_msgs::msg::Pose &pose, double weight, const rclcpp::Time &stamp)
+{
+    // The older observations fade, otherwise the weight grows without bound and the estimate stops following the part
+    double prior = estimate.weight * fusion_decay_;
 
-            if (waypoint_type == detected_type && waypoint_color == detected_color && !waypoint.pose_assigned)
-            {
-                waypoint.pose = detected_part.pose;
-                waypoint.pose.position.z = 0.0;
-                waypoint.pose_assigned = true;
-                break;
-            }
+    auto &position = estimate.pose.position;
+    double dx = pose.position.x - position.x;
+    double dy = pose.position.y - position.y;
+    double dz = pose.position.z - position.z;
+    double gate = fusion_outlier_gate_ * fusion_outlier_gate_ * (1.0 / prior + 1.0 / weight);
+
+    if (dx * dx + dy * dy + dz * dz > gate)
+    {
+        if (++estimate.outliers < fusion_outlier_limit_)
+        {
+            return;
         }
+        estimate.pose = pose;
+        estimate.weight = weight;
+        estimate.best_weight = weight;
+        estimate.outliers = 0;
+        estimate.stamp = stamp;
     }
-    log_waypoints();
+    else
+    {
+        double total = prior + weight;
+        position.x += dx * weight / total;
+        position.y += dy * weight / total;
+        position.z += dz * weight / total;
+        // Orientations are not averaged, the one from the best placed camera is kept
+        estimate.best_weight *= fusion_decay_;
+        if (weight >= estimate.best_weight)
+        {
+            estimate.pose.orientation = pose.orientation;
+            estimate.best_weight = weight;
+        }
+        estimate.weight = total;
+        estimate.outliers = 0;
+        estimate.stamp = stamp;
+    }
+    detected_parts_[estimate.detected_index].pose = estimate.pose;
+
+    dx = position.x - estimate.pushed_position.x;
+    dy = position.y - estimate.pushed_position.y;
+    dz = position.z - estimate.pushed_position.z;
+    if (dx * dx + dy * dy + dz * dz < tracking_update_threshold_ * tracking_update_threshold_)
+    {
+        return;
+    }
+    estimate.pushed_position = position;
+
+    size_t binding = sequencer_->bound_waypoint(key.type, key.color);
+    if (binding != MissionSequencer::no_waypoint)
+    {
+        log_part(log_event::part_moved, static_cast<uint32_t>(binding), key.type, key.color, position);
+        update_waypoint(binding, estimate.pose);
+    }
+}
+
+void PartPoseListener::update_waypoint(size_t index, const geometry_msgs::msg::Pose &pose)
+{
+    // The sequencer sends the goal again when a robot is driving to the waypoint
+    sequencer_->move_waypoint(index, to_core(goal_pose(pose)));
 }
 
 void PartPoseListener::log_waypoints()
 {
-    for (const auto &waypoint : waypoints_)
+    const std::vector<waypoint> &waypoints = sequencer_->waypoints();
+    for (size_t i = 0; i < waypoints.size(); ++i)
     {
-        RCLCPP_INFO(this->get_logger(), "waypoint: Type = %s, Color = %s, Pose: [x = %f, y = %f, z = %f]",
-                    waypoint.type.c_str(), waypoint.color.c_str(),
-                    waypoint.pose.position.x, waypoint.pose.position.y, waypoint.pose.position.z);
+        log_part(log_event::waypoint, static_cast<uint32_t>(i), waypoints[i].type, waypoints[i].color,
+                 from_core(waypoints[i].pose).position);
     }
 }
 
 void PartPoseListener::odom_callback(const nav_msgs::msg::Odometry::SharedPtr msg)
 {
+    if (robots_.empty())
+    {
+        metrics_.odometry(0, msg->pose.pose.position.x, msg->pose.pose.position.y);
+    }
     if (!initial_pose_set_)
     {
         initial_pose_ = msg->pose.pose;
         initial_pose_.position.z = 0.0;
         initial_pose_set_ = true;
+        sequencer_->set_mission_start(to_core(initial_pose_));
         RCLCPP_INFO(this->get_logger(), "Initial pose set: [x = %f, y = %f, z = %f]",
                     initial_pose_.position.x, initial_pose_.position.y, initial_pose_.position.z);
 
@@ -227,86 +951,505 @@ void PartPoseListener::odom_callback(const nav_msgs::msg::Odometry::SharedPtr ms
     }
 }
 
-void PartPoseListener::send_navigation_goal(const geometry_msgs::msg::Pose &pose)
+bool PartPoseListener::action_servers_ready()
 {
-    if (!navigate_to_pose_client_->wait_for_action_server())
+    bool ready = navigate_to_pose_client_->action_server_is_ready() &&
+                 (navigation_mode_ != navigation_mode::through_poses || navigate_through_poses_client_->action_server_is_ready());
+    if (!ready && sequencer_->server_ready())
     {
-        RCLCPP_ERROR(this->get_logger(), "Action server not available");
-        return;
+        RCLCPP_WARN(this->get_logger(), "Action server lost, queuing the goal until it is back");
+        sequencer_->server_lost();
+        current_goal_handle_.reset();
+        current_poses_goal_handle_.reset();
+        action_server_wait_start_ = this->get_clock()->now();
+        action_server_timeouts_ = 0;
+        action_server_timer_->reset();
+    }
+    return ready;
+}
+
+bool PartPoseListener::send_navigation_goal(size_t index, size_t sequence)
+{
+    if (!action_servers_ready())
+    {
+        return false;
     }
 
     auto goal_msg = nav2_msgs::action::NavigateToPose::Goal();
     goal_msg.pose.header.frame_id = "map";
-    goal_msg.pose.pose = pose;
+    goal_msg.pose.pose = from_core(sequencer_->waypoints()[index].pose);
+
+    metrics_.goal_dispatched(index, now_seconds());
+    trace_waypoint(trace::goal_sent, index);
 
     auto send_goal_options = rclcpp_action::Client<nav2_msgs::action::NavigateToPose>::SendGoalOptions();
     send_goal_options.goal_response_callback =
-        [this](const rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateToPose>::SharedPtr &goal_handle)
+        [this, index, sequence](const rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateToPose>::SharedPtr &goal_handle)
     {
-        if (!goal_handle)
+        // A rejected goal is retried by the sequencer
+        if (!sequencer_->goal_response(sequence, goal_handle != nullptr) || !goal_handle)
         {
-            // RCLCPP_ERROR(this->get_logger(), "Goal was rejected by server");
+            return;
         }
-        else
+        this->current_goal_handle_ = goal_handle;
+        metrics_.goal_accepted(index, now_seconds());
+        trace_waypoint(trace::goal_accepted, index);
+    };
+
+    send_goal_options.feedback_callback =
+        [this, sequence](rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateToPose>::SharedPtr,
+                         const std::shared_ptr<const nav2_msgs::action::NavigateToPose::Feedback> feedback)
+    {
+        const auto &position = feedback->current_pose.pose.position;
+        sequencer_->goal_feedback(sequence, point3{position.x, position.y, position.z});
+    };
+
+    send_goal_options.result_callback =
+        [this, sequence](const rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateToPose>::WrappedResult &result)
+    {
+        if (sequence == sequencer_->goal_sequence())
         {
-            this->current_goal_handle_ = goal_handle;
+            current_goal_handle_.reset();
+            sequencer_->goal_finished(sequence, to_core(result.code));
         }
     };
 
-    send_goal_options.result_callback = std::bind(&PartPoseListener::result_callback, this, std::placeholders::_1);
-
     navigate_to_pose_client_->async_send_goal(goal_msg, send_goal_options);
+    return true;
+}
+
+bool PartPoseListener::send_through_poses_goal(size_t first, size_t count, size_t sequence)
+{
+    if (!action_servers_ready())
+    {
+        return false;
+    }
+
+    const std::vector<waypoint> &waypoints = sequencer_->waypoints();
+    auto goal_msg = nav2_msgs::action::NavigateThroughPoses::Goal();
+    goal_msg.poses.reserve(count);
+    for (size_t i = first; i < first + count; ++i)
+    {
+        geometry_msgs::msg::PoseStamped pose;
+        pose.header.frame_id = "map";
+        pose.pose = from_core(waypoints[i].pose);
+        goal_msg.poses.push_back(pose);
+    }
+
+    double dispatched = now_seconds();
+    for (size_t i = first; i < first + count; ++i)
+    {
+        metrics_.goal_dispatched(i, dispatched);
+        trace_waypoint(trace::goal_sent, i);
+    }
+
+    auto send_goal_options = rclcpp_action::Client<nav2_msgs::action::NavigateThroughPoses>::SendGoalOptions();
+    send_goal_options.goal_response_callback =
+        [this, first, count, sequence](const rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateThroughPoses>::SharedPtr &goal_handle)
+    {
+        // A rejected goal is retried by the sequencer
+        if (!sequencer_->goal_response(sequence, goal_handle != nullptr) || !goal_handle)
+        {
+            return;
+        }
+        this->current_poses_goal_handle_ = goal_handle;
+        double accepted = now_seconds();
+        for (size_t i = first; i < first + count; ++i)
+        {
+            metrics_.goal_accepted(i, accepted);
+            trace_waypoint(trace::goal_accepted, i);
+        }
+    };
+
+    send_goal_options.feedback_callback =
+        [this, sequence](rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateThroughPoses>::SharedPtr,
+                         const std::shared_ptr<const nav2_msgs::action::NavigateThroughPoses::Feedback> feedback)
+    {
+        sequencer_->poses_remaining(sequence, static_cast<size_t>(std::max<int16_t>(feedback->number_of_poses_remaining, 0)));
+    };
+
+    send_goal_options.result_callback =
+        [this, sequence](const rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateThroughPoses>::WrappedResult &result)
+    {
+        if (sequence == sequencer_->goal_sequence())
+        {
+            current_poses_goal_handle_.reset();
+            sequencer_->goal_finished(sequence, to_core(result.code));
+        }
+    };
+
+    navigate_through_poses_client_->async_send_goal(goal_msg, send_goal_options);
+    return true;
 }
 
-void PartPoseListener::navigate_to_waypoints()
+void PartPoseListener::check_action_server()
 {
-    if (waypoints_.empty())
+    double waited = (this->get_clock()->now() - action_server_wait_start_).seconds();
+
+    // In fleet mode the robots are dispatched as soon as one of them has its action server
+    bool ready = robots_.empty() ? navigate_to_pose_client_->action_server_is_ready() &&
+                                       (navigation_mode_ != navigation_mode::through_poses ||
+                                        navigate_through_poses_client_->action_server_is_ready())
+                                 : std::any_of(robots_.begin(), robots_.end(), [](const fleet_robot &robot)
+                                               { return robot.client->action_server_is_ready(); });
+    if (ready)
     {
-        RCLCPP_WARN(this->get_logger(), "No waypoints to navigate to.");
+        RCLCPP_INFO(this->get_logger(), "Action server available after %.1f s", waited);
+        action_server_timer_->cancel();
+        sequencer_->server_available();
         return;
     }
 
-    if (current_waypoint_index_ < 5)
+    if (waited > action_server_timeout_ * (action_server_timeouts_ + 1))
+    {
+        action_server_timeouts_++;
+        RCLCPP_ERROR(this->get_logger(), "Action server not available after %.1f s, goals stay queued", waited);
+    }
+}
+
+void PartPoseListener::load_map(std::string map_yaml)
+{
+    try
+    {
+        if (map_yaml.empty())
+        {
+            map_yaml = ament_index_cpp::get_package_share_directory("final_project") + "/maps/final2_map.yaml";
+        }
+        map_ = std::make_shared<OccupancyGrid>(OccupancyGrid::load(map_yaml));
+        std::shared_ptr<RouteCache> route_cache;
+        try
+        {
+            route_cache = std::make_shared<RouteCache>(static_cast<size_t>(std::max(1, route_cache_capacity_)), route_cache_file_);
+        }
+        catch (const std::exception &ex)
+        {
+            RCLCPP_WARN(this->get_logger(), "Failed to open the route cache, keeping it in memory: %s", ex.what());
+            route_cache = std::make_shared<RouteCache>(static_cast<size_t>(std::max(1, route_cache_capacity_)));
+        }
+        distance_matrix_ = std::make_unique<DistanceMatrix>(map_, 0, 20, route_cache);
+        // The goals only check the clearance against goal_clearance, so the field is capped there and a map update only recomputes
+        // the cells within goal_clearance of the changed cells
+        distance_field_ = std::make_unique<DistanceField>(*map_, goal_clearance_);
+        grid_planner_ = std::make_unique<GridPlanner>(map_);
+        RCLCPP_INFO(this->get_logger(), "Loaded map %s (%d x %d cells)", map_yaml.c_str(), map_->width(), map_->height());
+        if (hierarchical_map_cells_ > 0 &&
+            static_cast<size_t>(map_->width()) * static_cast<size_t>(map_->height()) >= static_cast<size_t>(hierarchical_map_cells_))
+        {
+            hierarchical_planner_ = std::make_unique<HierarchicalPlanner>(map_);
+            RCLCPP_INFO(this->get_logger(), "Costing the routes with HPA*, %zu abstract nodes", hierarchical_planner_->node_count());
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        RCLCPP_WARN(this->get_logger(), "Failed to load the map, using straight line distances: %s", ex.what());
+    }
+}
+
+geometry_msgs::msg::Pose PartPoseListener::goal_pose(const geometry_msgs::msg::Pose &part_pose)
+{
+    geometry_msgs::msg::Pose goal = part_pose;
+    goal.position.z = 0.0;
+    if (!adjust_goals_ || !distance_field_)
     {
-        const auto &waypoint = waypoints_[current_waypoint_index_];
-        if (waypoint.pose_assigned)
+        return goal;
+    }
+
+    // The reachable cells are flooded from the robot start once it is known
+    if (!distance_field_->has_reachable() && initial_pose_set_)
+    {
+        distance_field_->compute_reachable(map_->world_to_cell(initial_pose_.position.x, initial_pose_.position.y), goal_clearance_);
+    }
+
+    map_cell target = map_->world_to_cell(part_pose.position.x, part_pose.position.y);
+    map_cell cell;
+    if (!distance_field_->standoff(target, goal_clearance_, goal_max_standoff_, cell))
+    {
+        RCLCPP_WARN(this->get_logger(), "No standoff pose with %.2f m clearance near [x = %f, y = %f], using the part pose",
+                    goal_clearance_, part_pose.position.x, part_pose.position.y);
+        return goal;
+    }
+    if (cell.x == target.x && cell.y == target.y)
+    {
+        return goal;
+    }
+
+    map_->cell_to_world(cell, goal.position.x, goal.position.y);
+    double yaw = std::atan2(part_pose.position.y - goal.position.y, part_pose.position.x - goal.position.x);
+    goal.orientation.x = 0.0;
+    goal.orientation.y = 0.0;
+    goal.orientation.z = std::sin(yaw / 2.0);
+    goal.orientation.w = std::cos(yaw / 2.0);
+    return goal;
+}
+
+std::vector<double> PartPoseListener::waypoint_cost_matrix(const std::vector<point3> &points,
+                                                            std::vector<double> *arrivals, size_t first_waypoint)
+{
+    size_t size = points.size();
+    std::vector<double> costs;
+    if (hierarchical_planner_)
+    {
+        std::vector<map_cell> cells;
+        cells.reserve(size);
+        for (const auto &point : points)
         {
-            send_navigation_goal(waypoint.pose);
+            cells.push_back(map_->world_to_cell(point.x, point.y));
         }
+        costs.assign(size * size, std::numeric_limits<double>::infinity());
+        if (arrivals)
+        {
+            arrivals->assign(size * size, std::numeric_limits<double>::quiet_NaN());
+        }
+        // The route lengths are symmetric, the routes are only refined for the arrival headings
+        for (size_t i = 0; i < size; ++i)
+        {
+            costs[i * size + i] = 0.0;
+            for (size_t j = arrivals ? 0 : i + 1; j < size; ++j)
+            {
+                if (i == j)
+                {
+                    continue;
+                }
+                HierarchicalPlanner::result route = hierarchical_planner_->route(cells[i], cells[j], arrivals != nullptr);
+                costs[i * size + j] = route.length;
+                if (arrivals)
+                {
+                    (*arrivals)[i * size + j] = arrival_heading(route.path);
+                }
+                else
+                {
+                    costs[j * size + i] = route.length;
+                }
+            }
+        }
+    }
+    else if (distance_matrix_)
+    {
+        std::vector<map_cell> cells;
+        cells.reserve(size);
+        for (const auto &point : points)
+        {
+            cells.push_back(map_->world_to_cell(point.x, point.y));
+        }
+        // With map updates the routes of the waypoints are tracked, so that they are repaired instead of searched again. A robot
+        // position is a new cell at every call, tracking it would run a complete search of the map and evict a waypoint.
+        if (map_update_subscription_ && first_waypoint < cells.size())
+        {
+            distance_matrix_->track(std::vector<map_cell>(cells.begin() + static_cast<std::ptrdiff_t>(first_waypoint), cells.end()));
+        }
+        costs = distance_matrix_->compute(cells, arrivals);
     }
+    else
+    {
+        costs.assign(size * size, std::numeric_limits<double>::infinity());
+        if (arrivals)
+        {
+            arrivals->assign(size * size, std::numeric_limits<double>::quiet_NaN());
+        }
+    }
+
+    size_t unreachable = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        for (size_t j = 0; j < size; ++j)
+        {
+            if (std::isinf(costs[i * size + j]))
+            {
+                costs[i * size + j] = std::hypot(points[j].x - points[i].x, points[j].y - points[i].y);
+                unreachable++;
+            }
+        }
+    }
+    if (map_ && unreachable > 0)
+    {
+        RCLCPP_WARN(this->get_logger(), "%zu waypoint pairs have no path on the map, using straight line distances", unreachable);
+    }
+    return costs;
 }
 
-void PartPoseListener::result_callback(
-    const rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateToPose>::WrappedResult &result)
+void PartPoseListener::map_update_callback(const nav_msgs::msg::OccupancyGrid::SharedPtr msg)
 {
-    switch (result.code)
+    const auto &info = msg->info;
+    if (static_cast<int>(info.width) != map_->width() || static_cast<int>(info.height) != map_->height() ||
+        std::abs(info.resolution - map_->resolution()) > 1e-6 || std::abs(info.origin.position.x - map_->origin_x()) > 1e-6 ||
+        std::abs(info.origin.position.y - map_->origin_y()) > 1e-6 || msg->data.size() != size_t(info.width) * info.height)
     {
-    case rclcpp_action::ResultCode::SUCCEEDED:
-        RCLCPP_INFO(this->get_logger(), "Reached waypoint %zu successfully", current_waypoint_index_);
-        current_waypoint_index_++;
-        if (current_waypoint_index_ < waypoints_.size() && current_waypoint_index_ < 5)
+        RCLCPP_WARN(this->get_logger(), "Ignoring a map update of %u x %u cells that does not match the loaded map", info.width,
+                    info.height);
+        return;
+    }
+
+    // Same thresholds as the Nav2 map server: free up to 25, occupied from 65, unknown in between and for -1
+    std::vector<map_cell> changed;
+    for (int y = 0; y < map_->height(); ++y)
+    {
+        for (int x = 0; x < map_->width(); ++x)
+        {
+            int8_t value = msg->data[static_cast<size_t>(y) * info.width + x];
+            cell_state state = value < 0 ? cell_state::unknown : value >= 65 ? cell_state::occupied
+                                                               : value <= 25 ? cell_state::free
+                                                                             : cell_state::unknown;
+            if (map_->state(x, y) != state)
+            {
+                map_->set_state(x, y, state);
+                changed.push_back(map_cell{x, y});
+            }
+        }
+    }
+    if (changed.empty())
+    {
+        return;
+    }
+
+    int x0 = map_->width();
+    int y0 = map_->height();
+    int x1 = -1;
+    int y1 = -1;
+    for (const auto &cell : changed)
+    {
+        x0 = std::min(x0, cell.x);
+        y0 = std::min(y0, cell.y);
+        x1 = std::max(x1, cell.x);
+        y1 = std::max(y1, cell.y);
+    }
+
+    size_t changed_routes = distance_matrix_->update(changed);
+    distance_field_->update(*map_, changed);
+    grid_planner_->update(x0, y0, x1, y1);
+    if (hierarchical_planner_)
+    {
+        // Any route between the waypoints may use a changed entrance or edge of the abstract graph. Otherwise only the routes from
+        // or to a waypoint in a cluster with changed cells change, since they are searched in that cluster up to the entrances.
+        const bool graph_changed = hierarchical_planner_->update(x0, y0, x1, y1);
+        std::unordered_set<size_t> changed_clusters;
+        for (const auto &cell : changed)
         {
-            const auto &next_waypoint = waypoints_[current_waypoint_index_];
-            if (next_waypoint.pose_assigned)
+            changed_clusters.insert(hierarchical_planner_->cluster_of(cell));
+        }
+        const auto &waypoints = sequencer_->waypoints();
+        size_t outside = 0;
+        for (const auto &waypoint : waypoints)
+        {
+            map_cell cell = map_->world_to_cell(waypoint.pose.position.x, waypoint.pose.position.y);
+            if (!map_->in_bounds(cell.x, cell.y) || changed_clusters.count(hierarchical_planner_->cluster_of(cell)) == 0)
             {
-                send_navigation_goal(next_waypoint.pose);
+                outside++;
             }
         }
+        auto pairs = [](size_t count)
+        {
+            return count > 1 ? count * (count - 1) / 2 : 0;
+        };
+        changed_routes = pairs(waypoints.size()) - (graph_changed ? 0 : pairs(outside));
+    }
+    RCLCPP_INFO(this->get_logger(), "Map update: %zu cells changed, %zu waypoint routes changed", changed.size(), changed_routes);
+    if (changed_routes > 0)
+    {
+        sequencer_->routes_changed();
+    }
+}
+
+void PartPoseListener::schedule_retry(long robot, double delay, size_t sequence)
+{
+    rclcpp::TimerBase::SharedPtr &timer = robot < 0 ? goal_retry_timer_ : robots_[static_cast<size_t>(robot)].retry_timer;
+    timer = this->create_wall_timer(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(delay)),
+        [this, robot, sequence]()
+        {
+            (robot < 0 ? goal_retry_timer_ : robots_[static_cast<size_t>(robot)].retry_timer)->cancel();
+            sequencer_->retry_elapsed(robot, sequence);
+        });
+}
+
+void PartPoseListener::send_fleet_goal(size_t index, size_t sequence)
+{
+    fleet_robot &robot = robots_[index];
+    size_t waypoint = static_cast<size_t>(sequencer_->robot(index).waypoint);
+    const point3 from = sequencer_->robot(index).pose.position;
+    const point3 to = sequencer_->waypoints()[waypoint].pose.position;
+
+    if (approach_heading_)
+    {
+        // The robot position is a new cell at every goal, a single JPS+ query is much cheaper than a search of the distance matrix.
+        // The matrix is the fallback when the goal is not on a free cell, since it snaps the cells inside obstacles.
+        double arrival = std::numeric_limits<double>::quiet_NaN();
+        GridPlanner::result path;
+        if (grid_planner_)
+        {
+            path = grid_planner_->jps(map_->world_to_cell(from.x, from.y), map_->world_to_cell(to.x, to.y));
+        }
+        if (path.found)
+        {
+            arrival = arrival_heading(path.path);
+        }
         else
         {
-            RCLCPP_INFO(this->get_logger(), "Reached the 5th waypoint or all waypoints have been reached");
+            std::vector<double> arrivals;
+            waypoint_cost_matrix({from, to}, &arrivals, 1);
+            arrival = arrivals[1];
+        }
+        double dx = to.x - from.x;
+        double dy = to.y - from.y;
+        if (!std::isnan(arrival) || dx * dx + dy * dy > 1e-6)
+        {
+            sequencer_->set_heading(waypoint, !std::isnan(arrival) ? arrival : std::atan2(dy, dx));
+        }
+    }
+
+    auto goal_msg = nav2_msgs::action::NavigateToPose::Goal();
+    goal_msg.pose.header.frame_id = "map";
+    goal_msg.pose.pose = from_core(sequencer_->waypoints()[waypoint].pose);
+
+    metrics_.goal_dispatched(waypoint, now_seconds());
+    trace_waypoint(trace::goal_sent, waypoint);
+
+    auto send_goal_options = rclcpp_action::Client<nav2_msgs::action::NavigateToPose>::SendGoalOptions();
+    send_goal_options.goal_response_callback =
+        [this, index, sequence](const rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateToPose>::SharedPtr &goal_handle)
+    {
+        // A rejected goal releases the waypoint in the sequencer
+        if (!sequencer_->fleet_goal_response(index, sequence, goal_handle != nullptr) || !goal_handle)
+        {
+            return;
         }
-        break;
-    case rclcpp_action::ResultCode::ABORTED:
+        robots_[index].goal_handle = goal_handle;
+        size_t waypoint = static_cast<size_t>(sequencer_->robot(index).waypoint);
+        metrics_.goal_accepted(waypoint, now_seconds());
+        trace_waypoint(trace::goal_accepted, waypoint);
+    };
 
-        break;
-    case rclcpp_action::ResultCode::CANCELED:
-        RCLCPP_INFO(this->get_logger(), "Goal was canceled");
-        break;
-    default:
-        RCLCPP_ERROR(this->get_logger(), "Unknown result code");
-        break;
+    send_goal_options.result_callback =
+        [this, index, sequence](const rclcpp_action::ClientGoalHandle<nav2_msgs::action::NavigateToPose>::WrappedResult &result)
+    {
+        if (sequence == sequencer_->robot(index).sequence)
+        {
+            robots_[index].goal_handle.reset();
+            sequencer_->fleet_goal_finished(index, sequence, to_core(result.code));
+        }
+    };
+
+    robot.client->async_send_goal(goal_msg, send_goal_options);
+}
+
+void PartPoseListener::fleet_odom_callback(size_t index, const nav_msgs::msg::Odometry::SharedPtr msg)
+{
+    fleet_robot &robot = robots_[index];
+    geometry_msgs::msg::Pose pose = msg->pose.pose;
+    pose.position.z = 0.0;
+    metrics_.odometry(index, pose.position.x, pose.position.y);
+    if (!sequencer_->update_robot_pose(index, to_core(pose)))
+    {
+        return;
     }
+    RCLCPP_INFO(this->get_logger(), "Initial pose of robot %s set: [x = %f, y = %f, z = %f]", robot.name.c_str(),
+                pose.position.x, pose.position.y, pose.position.z);
+
+    geometry_msgs::msg::PoseWithCovarianceStamped pose_msg;
+    pose_msg.header.stamp = this->get_clock()->now();
+    pose_msg.header.frame_id = "map";
+    pose_msg.pose.pose = pose;
+    robot.initialpose_publisher->publish(pose_msg);
+    sequencer_->navigate();
 }
 
 int main(int argc, char **argv)
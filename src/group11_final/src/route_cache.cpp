@@ -0,0 +1,294 @@
+#include "route_cache.hpp"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr uint64_t cache_magic = 0x3145484341435452ull;  // "RTCACHE1"
+    constexpr uint32_t cache_version = 1;
+    constexpr uint32_t empty = std::numeric_limits<uint32_t>::max();
+    constexpr uint16_t has_waypoints_flag = 1;
+
+    uint32_t pack(const map_cell &cell)
+    {
+        return (static_cast<uint32_t>(static_cast<uint16_t>(cell.y)) << 16) | static_cast<uint16_t>(cell.x);
+    }
+
+    map_cell unpack(uint32_t value)
+    {
+        return map_cell{static_cast<int>(value & 0xffffu), static_cast<int>(value >> 16)};
+    }
+}
+
+/**
+ * @brief  header of the cache block
+ *
+ */
+struct RouteCache::header
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t bucket_count;
+    uint32_t size;
+    uint32_t lru_head;  // most recently used slot
+    uint32_t lru_tail;  // least recently used slot
+    uint32_t clean;     // 1 when the file was closed after the last change
+    uint32_t reserved;
+};
+
+/**
+ * @brief  slot of the cache block, one route
+ *
+ */
+struct RouteCache::slot
+{
+    uint64_t map_hash;
+    uint32_t start;
+    uint32_t goal;
+    uint32_t hash_next;
+    uint32_t lru_previous;
+    uint32_t lru_next;
+    uint16_t count;
+    uint16_t flags;
+    double length;
+    float arrival;
+    uint32_t waypoints[max_waypoints];
+};
+
+RouteCache::RouteCache(size_t capacity, const std::string &file)
+    : capacity_(std::max<size_t>(1, std::min<size_t>(capacity, empty - 1))),
+      bucket_count_(1),
+      persistent_(!file.empty()),
+      data_(nullptr)
+{
+    while (bucket_count_ < capacity_)
+    {
+        bucket_count_ <<= 1;
+    }
+    size_bytes_ = sizeof(header) + bucket_count_ * sizeof(uint32_t) + capacity_ * sizeof(slot);
+
+    void *data = MAP_FAILED;
+    if (persistent_)
+    {
+        int fd = ::open(file.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Cannot open route cache " + file);
+        }
+        if (::ftruncate(fd, static_cast<off_t>(size_bytes_)) == 0)
+        {
+            data = ::mmap(nullptr, size_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+    }
+    else
+    {
+        data = ::mmap(nullptr, size_bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (data == MAP_FAILED)
+    {
+        throw std::runtime_error(persistent_ ? "Cannot map route cache " + file : "Cannot allocate route cache");
+    }
+    data_ = static_cast<uint8_t *>(data);
+
+    if (!valid())
+    {
+        clear();
+    }
+    head().clean = 0;
+}
+
+RouteCache::~RouteCache()
+{
+    head().clean = 1;
+    flush();
+    ::munmap(data_, size_bytes_);
+}
+
+RouteCache::header &RouteCache::head() const
+{
+    return *reinterpret_cast<header *>(data_);
+}
+
+uint32_t *RouteCache::buckets() const
+{
+    return reinterpret_cast<uint32_t *>(data_ + sizeof(header));
+}
+
+RouteCache::slot *RouteCache::slots() const
+{
+    return reinterpret_cast<slot *>(data_ + sizeof(header) + bucket_count_ * sizeof(uint32_t));
+}
+
+bool RouteCache::valid() const
+{
+    const header &h = head();
+    return h.magic == cache_magic && h.version == cache_version && h.capacity == capacity_ && h.bucket_count == bucket_count_ &&
+           h.clean == 1 && h.size <= capacity_;
+}
+
+size_t RouteCache::size() const
+{
+    return head().size;
+}
+
+void RouteCache::clear()
+{
+    header &h = head();
+    h.magic = cache_magic;
+    h.version = cache_version;
+    h.capacity = static_cast<uint32_t>(capacity_);
+    h.bucket_count = static_cast<uint32_t>(bucket_count_);
+    h.size = 0;
+    h.lru_head = empty;
+    h.lru_tail = empty;
+    std::fill(buckets(), buckets() + bucket_count_, empty);
+}
+
+void RouteCache::flush()
+{
+    if (persistent_)
+    {
+        ::msync(data_, size_bytes_, MS_SYNC);
+    }
+}
+
+uint32_t &RouteCache::bucket_of(uint64_t map_hash, uint32_t start, uint32_t goal) const
+{
+    uint64_t key = map_hash ^ ((static_cast<uint64_t>(start) << 32) | goal);
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return buckets()[key & (bucket_count_ - 1)];
+}
+
+void RouteCache::unlink(uint32_t index)
+{
+    header &h = head();
+    slot &entry = slots()[index];
+    if (entry.lru_previous != empty)
+    {
+        slots()[entry.lru_previous].lru_next = entry.lru_next;
+    }
+    else
+    {
+        h.lru_head = entry.lru_next;
+    }
+    if (entry.lru_next != empty)
+    {
+        slots()[entry.lru_next].lru_previous = entry.lru_previous;
+    }
+    else
+    {
+        h.lru_tail = entry.lru_previous;
+    }
+}
+
+void RouteCache::push_front(uint32_t index)
+{
+    header &h = head();
+    slot &entry = slots()[index];
+    entry.lru_previous = empty;
+    entry.lru_next = h.lru_head;
+    if (h.lru_head != empty)
+    {
+        slots()[h.lru_head].lru_previous = index;
+    }
+    h.lru_head = index;
+    if (h.lru_tail == empty)
+    {
+        h.lru_tail = index;
+    }
+}
+
+bool RouteCache::find(uint64_t map_hash, uint32_t start, uint32_t goal, route &found)
+{
+    for (uint32_t index = bucket_of(map_hash, start, goal); index != empty; index = slots()[index].hash_next)
+    {
+        const slot &entry = slots()[index];
+        if (entry.map_hash != map_hash || entry.start != start || entry.goal != goal)
+        {
+            continue;
+        }
+        found.length = entry.length;
+        found.arrival = entry.arrival;
+        found.has_waypoints = entry.flags & has_waypoints_flag;
+        found.waypoints.clear();
+        for (uint16_t k = 0; k < entry.count; ++k)
+        {
+            found.waypoints.push_back(unpack(entry.waypoints[k]));
+        }
+        if (head().lru_head != index)
+        {
+            unlink(index);
+            push_front(index);
+        }
+        return true;
+    }
+    return false;
+}
+
+void RouteCache::insert(uint64_t map_hash, uint32_t start, uint32_t goal, const route &value)
+{
+    header &h = head();
+    uint32_t &bucket = bucket_of(map_hash, start, goal);
+
+    uint32_t index = bucket;
+    while (index != empty &&
+           (slots()[index].map_hash != map_hash || slots()[index].start != start || slots()[index].goal != goal))
+    {
+        index = slots()[index].hash_next;
+    }
+
+    if (index != empty)
+    {
+        unlink(index);
+    }
+    else
+    {
+        if (h.size < capacity_)
+        {
+            index = h.size++;
+        }
+        else
+        {
+            // Reuse the least recently used slot: take it out of its bucket chain first
+            index = h.lru_tail;
+            unlink(index);
+            const slot &evicted = slots()[index];
+            uint32_t *link = &bucket_of(evicted.map_hash, evicted.start, evicted.goal);
+            while (*link != index)
+            {
+                link = &slots()[*link].hash_next;
+            }
+            *link = evicted.hash_next;
+        }
+        slot &entry = slots()[index];
+        entry.map_hash = map_hash;
+        entry.start = start;
+        entry.goal = goal;
+        entry.hash_next = bucket;
+        bucket = index;
+    }
+
+    slot &entry = slots()[index];
+    entry.length = value.length;
+    entry.arrival = static_cast<float>(value.arrival);
+    entry.flags = 0;
+    entry.count = 0;
+    if (value.has_waypoints && value.waypoints.size() <= max_waypoints)
+    {
+        entry.flags = has_waypoints_flag;
+        entry.count = static_cast<uint16_t>(value.waypoints.size());
+        for (size_t k = 0; k < value.waypoints.size(); ++k)
+        {
+            entry.waypoints[k] = pack(value.waypoints[k]);
+        }
+    }
+    push_front(index);
+}
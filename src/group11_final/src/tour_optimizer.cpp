@@ -0,0 +1,266 @@
+#include "tour_optimizer.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+    constexpr double improvement_epsilon = 1e-9;
+    constexpr size_t no_node = std::numeric_limits<size_t>::max();
+
+    /**
+     * @brief Cost of the edge between two nodes, edges to no_node (open ends of the path) are free.
+     *
+     */
+    double edge(const std::vector<double> &costs, size_t size, size_t from, size_t to)
+    {
+        if (from == no_node || to == no_node)
+        {
+            return 0.0;
+        }
+        return costs[from * size + to];
+    }
+}
+
+std::vector<size_t> TourOptimizer::optimize(const std::vector<double> &costs, size_t size, const options &opts)
+{
+    if (size <= 2)
+    {
+        std::vector<size_t> order;
+        for (size_t i = 0; i < size; ++i)
+        {
+            order.push_back(i);
+        }
+        if (size == 2 && !opts.fixed_first && !opts.fixed_last && costs[2] < costs[1])
+        {
+            std::swap(order[0], order[1]);
+        }
+        return order;
+    }
+
+    if (size <= opts.exact_limit)
+    {
+        return solve_exact(costs, size, opts);
+    }
+
+    std::vector<size_t> order = nearest_neighbour(costs, size, opts);
+    improve(costs, size, opts, order);
+    return order;
+}
+
+double TourOptimizer::path_cost(const std::vector<double> &costs, size_t size, const std::vector<size_t> &order)
+{
+    double cost = 0.0;
+    for (size_t i = 1; i < order.size(); ++i)
+    {
+        cost += costs[order[i - 1] * size + order[i]];
+    }
+    return cost;
+}
+
+void TourOptimizer::improve(const std::vector<double> &costs, size_t size, const options &opts, std::vector<size_t> &order)
+{
+    for (size_t pass = 0; pass < opts.max_passes; ++pass)
+    {
+        bool improved = two_opt_pass(costs, size, opts, order);
+        improved = or_opt_pass(costs, size, opts, order) || improved;
+        if (!improved)
+        {
+            break;
+        }
+    }
+}
+
+std::vector<size_t> TourOptimizer::solve_exact(const std::vector<double> &costs, size_t size, const options &opts)
+{
+    const double infinity = std::numeric_limits<double>::infinity();
+    const size_t full = (size_t(1) << size) - 1;
+    const size_t last = size - 1;
+
+    // best[mask * size + j] is the cost of the cheapest path that visits the nodes in mask and ends in j
+    std::vector<double> best((full + 1) * size, infinity);
+    std::vector<size_t> parent((full + 1) * size, no_node);
+
+    if (opts.fixed_first)
+    {
+        best[size_t(1) * size + 0] = 0.0;
+    }
+    else
+    {
+        for (size_t j = 0; j < size; ++j)
+        {
+            if (!opts.fixed_last || j != last)
+            {
+                best[(size_t(1) << j) * size + j] = 0.0;
+            }
+        }
+    }
+
+    for (size_t mask = 1; mask <= full; ++mask)
+    {
+        for (size_t j = 0; j < size; ++j)
+        {
+            double cost = best[mask * size + j];
+            if (cost == infinity)
+            {
+                continue;
+            }
+            for (size_t k = 0; k < size; ++k)
+            {
+                size_t next_mask = mask | (size_t(1) << k);
+                if (next_mask == mask || (opts.fixed_last && k == last && next_mask != full))
+                {
+                    continue;
+                }
+                double next_cost = cost + costs[j * size + k];
+                if (next_cost < best[next_mask * size + k])
+                {
+                    best[next_mask * size + k] = next_cost;
+                    parent[next_mask * size + k] = j;
+                }
+            }
+        }
+    }
+
+    size_t end = last;
+    if (!opts.fixed_last)
+    {
+        for (size_t j = 0; j < size; ++j)
+        {
+            if (best[full * size + j] < best[full * size + end])
+            {
+                end = j;
+            }
+        }
+    }
+
+    std::vector<size_t> order;
+    order.reserve(size);
+    size_t mask = full;
+    for (size_t node = end; node != no_node;)
+    {
+        order.push_back(node);
+        size_t previous = parent[mask * size + node];
+        mask &= ~(size_t(1) << node);
+        node = previous;
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+std::vector<size_t> TourOptimizer::nearest_neighbour(const std::vector<double> &costs, size_t size, const options &opts)
+{
+    std::vector<bool> visited(size, false);
+    std::vector<size_t> order;
+    order.reserve(size);
+
+    size_t current = 0;
+    visited[current] = true;
+    order.push_back(current);
+    if (opts.fixed_last)
+    {
+        visited[size - 1] = true;
+    }
+
+    size_t remaining = size - (opts.fixed_last ? 2 : 1);
+    for (size_t step = 0; step < remaining; ++step)
+    {
+        size_t next = no_node;
+        for (size_t k = 0; k < size; ++k)
+        {
+            if (!visited[k] && (next == no_node || costs[current * size + k] < costs[current * size + next]))
+            {
+                next = k;
+            }
+        }
+        visited[next] = true;
+        order.push_back(next);
+        current = next;
+    }
+
+    if (opts.fixed_last)
+    {
+        order.push_back(size - 1);
+    }
+    return order;
+}
+
+bool TourOptimizer::two_opt_pass(const std::vector<double> &costs, size_t size, const options &opts, std::vector<size_t> &order)
+{
+    const size_t n = order.size();
+    if (n < 3)
+    {
+        return false;
+    }
+    const size_t low = opts.fixed_first ? 1 : 0;
+    const size_t high = opts.fixed_last ? n - 2 : n - 1;
+    bool improved = false;
+
+    for (size_t i = low; i < high; ++i)
+    {
+        for (size_t k = i + 1; k <= high; ++k)
+        {
+            size_t a = i > 0 ? order[i - 1] : no_node;
+            size_t b = order[i];
+            size_t c = order[k];
+            size_t d = k + 1 < n ? order[k + 1] : no_node;
+            double delta = edge(costs, size, a, c) + edge(costs, size, b, d) - edge(costs, size, a, b) - edge(costs, size, c, d);
+            if (delta < -improvement_epsilon)
+            {
+                std::reverse(order.begin() + static_cast<long>(i), order.begin() + static_cast<long>(k) + 1);
+                improved = true;
+            }
+        }
+    }
+    return improved;
+}
+
+bool TourOptimizer::or_opt_pass(const std::vector<double> &costs, size_t size, const options &opts, std::vector<size_t> &order)
+{
+    const long n = static_cast<long>(order.size());
+    if (n < 3)
+    {
+        return false;
+    }
+    const long low = opts.fixed_first ? 1 : 0;
+    const long high = opts.fixed_last ? n - 2 : n - 1;
+    bool improved = false;
+
+    auto at = [&order, n](long position)
+    {
+        return position >= 0 && position < n ? order[static_cast<size_t>(position)] : no_node;
+    };
+
+    for (long length = 1; length <= 3; ++length)
+    {
+        for (long i = low; i + length - 1 <= high; ++i)
+        {
+            size_t first = at(i);
+            size_t last = at(i + length - 1);
+            size_t previous = at(i - 1);
+            size_t next = at(i + length);
+            double removed = edge(costs, size, previous, first) + edge(costs, size, last, next) - edge(costs, size, previous, next);
+
+            // Insert the segment between the nodes at positions j and j + 1
+            for (long j = low - 1; j <= high; ++j)
+            {
+                if (j >= i - 1 && j <= i + length - 1)
+                {
+                    continue;
+                }
+                size_t p = at(j);
+                size_t q = at(j + 1);
+                double added = edge(costs, size, p, first) + edge(costs, size, last, q) - edge(costs, size, p, q);
+                if (added - removed < -improvement_epsilon)
+                {
+                    std::vector<size_t> segment(order.begin() + i, order.begin() + i + length);
+                    order.erase(order.begin() + i, order.begin() + i + length);
+                    long insert_at = j < i ? j + 1 : j + 1 - length;
+                    order.insert(order.begin() + insert_at, segment.begin(), segment.end());
+                    improved = true;
+                    break;
+                }
+            }
+        }
+    }
+    return improved;
+}
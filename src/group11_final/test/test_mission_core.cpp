@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "mission_core.hpp"
+
+namespace
+{
+    struct test_part
+    {
+        part_type type;
+        part_color color;
+    };
+
+    struct test_waypoint
+    {
+        part_type type;
+        part_color color;
+        bool pose_assigned;
+    };
+}
+
+TEST(MissionCore, ClassifyPartKnownAndUnknownCodes)
+{
+    part_color color;
+    part_type type;
+    ASSERT_TRUE(classify_part(part_codes::purple, part_codes::regulator, color, type));
+    EXPECT_EQ(color, part_color::purple);
+    EXPECT_EQ(type, part_type::regulator);
+
+    EXPECT_FALSE(classify_part(7, part_codes::battery, color, type));
+    EXPECT_FALSE(classify_part(part_codes::red, 42, color, type));
+}
+
+TEST(MissionCore, TransformPoseRotatesThenTranslates)
+{
+    // Quarter turn about z, then one meter along x
+    rigid_transform transform{point3{1.0, 0.0, 0.0}, quaternion{0.0, 0.0, std::sin(M_PI / 4.0), std::cos(M_PI / 4.0)}};
+    pose3 pose{point3{1.0, 0.0, 0.5}, quaternion{}};
+    pose3 result = transform_pose(transform, pose);
+    EXPECT_NEAR(result.position.x, 1.0, 1e-12);
+    EXPECT_NEAR(result.position.y, 1.0, 1e-12);
+    EXPECT_NEAR(result.position.z, 0.5, 1e-12);
+    EXPECT_NEAR(result.orientation.z, transform.rotation.z, 1e-12);
+    EXPECT_NEAR(result.orientation.w, transform.rotation.w, 1e-12);
+}
+
+TEST(MissionCore, MatchPartsBindsTheFirstOpenWaypointOfEachPart)
+{
+    std::vector<test_part> parts = {{part_type::battery, part_color::red},
+                                    {part_type::pump, part_color::blue},
+                                    {part_type::battery, part_color::red},
+                                    {part_type::sensor, part_color::green}};
+    std::vector<test_waypoint> waypoints = {{part_type::pump, part_color::blue, false},
+                                            {part_type::battery, part_color::red, true},
+                                            {part_type::battery, part_color::red, false},
+                                            {part_type::battery, part_color::red, false}};
+
+    // The second red battery takes the next open red battery waypoint, the green sensor has no waypoint
+    std::vector<part_match> matches = match_parts(parts, waypoints);
+    ASSERT_EQ(matches.size(), 3u);
+    EXPECT_EQ(matches[0].part, 0u);
+    EXPECT_EQ(matches[0].waypoint, 2u);
+    EXPECT_EQ(matches[1].part, 1u);
+    EXPECT_EQ(matches[1].waypoint, 0u);
+    EXPECT_EQ(matches[2].part, 2u);
+    EXPECT_EQ(matches[2].waypoint, 3u);
+}
+
+TEST(MissionCore, MatchPartsSkipsTheWaypointsBeforeFirst)
+{
+    std::vector<test_part> parts = {{part_type::pump, part_color::blue}};
+    std::vector<test_waypoint> waypoints = {{part_type::pump, part_color::blue, false}, {part_type::pump, part_color::blue, false}};
+    std::vector<part_match> matches = match_parts(parts, waypoints, 1);
+    ASSERT_EQ(matches.size(), 1u);
+    EXPECT_EQ(matches[0].waypoint, 1u);
+    EXPECT_TRUE(match_parts(parts, waypoints, 2).empty());
+}
+
+TEST(MissionCore, NewMarkerMissionsQueuesEveryMarkerOnce)
+{
+    MissionTable missions = MissionTable::parse({{"aruco_0.wp1.type", "battery"}, {"aruco_0.wp1.color", "green"},
+                                                 {"aruco_1.wp1.type", "pump"}, {"aruco_1.wp1.color", "red"},
+                                                 {"aruco_1.wp2.type", "sensor"}, {"aruco_1.wp2.color", "blue"}});
+    std::unordered_set<long> seen;
+    std::vector<long> unknown;
+
+    std::vector<marker_mission> queued = new_marker_missions({1, 7, 0}, missions, seen, unknown);
+    ASSERT_EQ(queued.size(), 2u);
+    EXPECT_EQ(queued[0].marker_id, 1);
+    EXPECT_EQ(queued[0].index, 0u);
+    EXPECT_EQ(queued[0].steps.size, 2u);
+    EXPECT_EQ(queued[1].marker_id, 0);
+    EXPECT_EQ(queued[1].index, 2u);
+    EXPECT_EQ(unknown, (std::vector<long>{7}));
+
+    // The markers still in view are not queued again, nor reported again when unknown
+    unknown.clear();
+    EXPECT_TRUE(new_marker_missions({0, 1, 7}, missions, seen, unknown).empty());
+    EXPECT_TRUE(unknown.empty());
+}
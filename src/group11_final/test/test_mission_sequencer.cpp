@@ -0,0 +1,405 @@
+#include <gtest/gtest.h>
+#include "mission_sequencer.hpp"
+
+namespace
+{
+    using goal_result = MissionSequencer::goal_result;
+
+    /**
+     * @brief  struct to store the calls of the sequencer to the node
+     *
+     */
+    struct recorder
+    {
+        struct goal
+        {
+            size_t first;
+            size_t count;
+            size_t sequence;
+        };
+        struct retry
+        {
+            long robot;
+            double delay;
+            size_t sequence;
+        };
+        std::vector<goal> goals;
+        std::vector<std::pair<size_t, size_t>> fleet_goals;  // robot and sequence
+        std::vector<retry> retries;
+        std::vector<long> cancels;
+        std::vector<size_t> reached;
+        size_t missions_done = 0;
+
+        MissionSequencer::hooks hooks()
+        {
+            MissionSequencer::hooks hooks;
+            hooks.send_goal = [this](size_t first, size_t count, size_t sequence)
+            {
+                goals.push_back(goal{first, count, sequence});
+                return true;
+            };
+            hooks.send_fleet_goal = [this](size_t robot, size_t sequence)
+            {
+                fleet_goals.emplace_back(robot, sequence);
+            };
+            hooks.cancel_goal = [this](long robot)
+            {
+                cancels.push_back(robot);
+            };
+            hooks.schedule_retry = [this](long robot, double delay, size_t sequence)
+            {
+                retries.push_back(retry{robot, delay, sequence});
+            };
+            hooks.waypoint_reached = [this](size_t waypoint)
+            {
+                reached.push_back(waypoint);
+            };
+            hooks.mission_done = [this]()
+            {
+                missions_done++;
+            };
+            return hooks;
+        }
+    };
+
+    // Part of the waypoint k of the test missions, every waypoint has another part
+    part_type type_of(size_t k) { return static_cast<part_type>(k / 5 % 4); }
+    part_color color_of(size_t k) { return static_cast<part_color>(k % 5); }
+
+    MissionSequencer::queued_mission make_mission(long marker_id, size_t size)
+    {
+        MissionSequencer::queued_mission next;
+        next.marker_id = marker_id;
+        for (size_t k = 0; k < size; ++k)
+        {
+            MissionSequencer::waypoint waypoint;
+            waypoint.type = type_of(k);
+            waypoint.color = color_of(k);
+            next.waypoints.push_back(waypoint);
+        }
+        return next;
+    }
+
+    pose3 at(double x, double y = 0.0)
+    {
+        return pose3{point3{x, y, 0.0}, quaternion{}};
+    }
+}
+
+TEST(MissionSequencer, SequentialDispatchSendsOneResolvedWaypointAtATime)
+{
+    recorder calls;
+    MissionSequencer sequencer(MissionSequencer::options{}, calls.hooks());
+    sequencer.queue_mission(make_mission(0, 3));
+    ASSERT_TRUE(sequencer.start_next_mission());
+    sequencer.server_available();
+    EXPECT_TRUE(calls.goals.empty());
+
+    sequencer.resolve_waypoint(0, at(1.0), 0);
+    sequencer.navigate();
+    ASSERT_EQ(calls.goals.size(), 1u);
+    EXPECT_EQ(calls.goals[0].first, 0u);
+    EXPECT_EQ(calls.goals[0].count, 1u);
+
+    // Only one goal is in flight
+    sequencer.resolve_waypoint(1, at(2.0), 0);
+    sequencer.navigate();
+    EXPECT_EQ(calls.goals.size(), 1u);
+
+    EXPECT_TRUE(sequencer.goal_response(calls.goals[0].sequence, true));
+    sequencer.goal_finished(calls.goals[0].sequence, goal_result::succeeded);
+    ASSERT_EQ(calls.goals.size(), 2u);
+    EXPECT_EQ(calls.goals[1].first, 1u);
+
+    // The last waypoint is sent once it is resolved
+    sequencer.goal_finished(calls.goals[1].sequence, goal_result::succeeded);
+    EXPECT_EQ(calls.goals.size(), 2u);
+    sequencer.resolve_waypoint(2, at(3.0), 0);
+    sequencer.navigate();
+    ASSERT_EQ(calls.goals.size(), 3u);
+    sequencer.goal_finished(calls.goals[2].sequence, goal_result::succeeded);
+
+    EXPECT_EQ(calls.reached, (std::vector<size_t>{0, 1, 2}));
+    EXPECT_EQ(calls.missions_done, 1u);
+    EXPECT_TRUE(sequencer.mission_finished());
+}
+
+TEST(MissionSequencer, ThroughPosesSendsTheResolvedWaypointsAsOneGoal)
+{
+    recorder calls;
+    MissionSequencer::options opts;
+    opts.mode = MissionSequencer::navigation_mode::through_poses;
+    MissionSequencer sequencer(opts, calls.hooks());
+    sequencer.queue_mission(make_mission(0, 3));
+    sequencer.start_next_mission();
+    for (size_t i = 0; i < 3; ++i)
+    {
+        sequencer.resolve_waypoint(i, at(static_cast<double>(i + 1)), 0);
+    }
+    sequencer.server_available();
+    ASSERT_EQ(calls.goals.size(), 1u);
+    EXPECT_EQ(calls.goals[0].first, 0u);
+    EXPECT_EQ(calls.goals[0].count, 3u);
+
+    // The last pose is only reached when the goal succeeds
+    size_t sequence = calls.goals[0].sequence;
+    sequencer.poses_remaining(sequence, 2);
+    EXPECT_EQ(calls.reached, (std::vector<size_t>{0}));
+    sequencer.poses_remaining(sequence, 0);
+    EXPECT_EQ(calls.reached, (std::vector<size_t>{0, 1}));
+    sequencer.goal_finished(sequence, goal_result::succeeded);
+    EXPECT_EQ(calls.reached, (std::vector<size_t>{0, 1, 2}));
+    EXPECT_EQ(calls.missions_done, 1u);
+}
+
+TEST(MissionSequencer, FailedGoalIsRetriedThenSkipped)
+{
+    recorder calls;
+    MissionSequencer::options opts;
+    opts.retry_limit = 2;
+    opts.retry_delay = 2.0;
+    MissionSequencer sequencer(opts, calls.hooks());
+    sequencer.queue_mission(make_mission(0, 2));
+    sequencer.start_next_mission();
+    sequencer.resolve_waypoint(0, at(1.0), 0);
+    sequencer.resolve_waypoint(1, at(2.0), 0);
+    sequencer.server_available();
+    ASSERT_EQ(calls.goals.size(), 1u);
+
+    // A rejected goal and an aborted goal are retried after a doubling backoff
+    EXPECT_TRUE(sequencer.goal_response(calls.goals[0].sequence, false));
+    ASSERT_EQ(calls.retries.size(), 1u);
+    EXPECT_DOUBLE_EQ(calls.retries[0].delay, 2.0);
+    EXPECT_EQ(calls.goals.size(), 1u);
+    sequencer.retry_elapsed(-1, calls.retries[0].sequence);
+    ASSERT_EQ(calls.goals.size(), 2u);
+    EXPECT_EQ(calls.goals[1].first, 0u);
+
+    sequencer.goal_finished(calls.goals[1].sequence, goal_result::aborted);
+    ASSERT_EQ(calls.retries.size(), 2u);
+    EXPECT_DOUBLE_EQ(calls.retries[1].delay, 4.0);
+    sequencer.retry_elapsed(-1, calls.retries[1].sequence);
+    ASSERT_EQ(calls.goals.size(), 3u);
+
+    // After retry_limit retries the waypoint is skipped and the next one is sent
+    sequencer.goal_finished(calls.goals[2].sequence, goal_result::aborted);
+    EXPECT_EQ(calls.retries.size(), 2u);
+    ASSERT_EQ(calls.goals.size(), 4u);
+    EXPECT_EQ(calls.goals[3].first, 1u);
+    EXPECT_TRUE(calls.reached.empty());
+    EXPECT_EQ(sequencer.current_waypoint(), 1u);
+}
+
+TEST(MissionSequencer, NextMissionStartsAtTheLastReachedWaypoint)
+{
+    recorder calls;
+    MissionSequencer::options opts;
+    opts.retry_limit = 0;
+    MissionSequencer sequencer(opts, calls.hooks());
+    sequencer.set_mission_start(at(-1.0));
+    sequencer.queue_mission(make_mission(0, 2));
+    sequencer.start_next_mission();
+    sequencer.resolve_waypoint(0, at(1.0), 0);
+    sequencer.resolve_waypoint(1, at(2.0), 0);
+    sequencer.server_available();
+    sequencer.goal_finished(calls.goals[0].sequence, goal_result::succeeded);
+    ASSERT_EQ(calls.goals.size(), 2u);
+
+    // The last waypoint is skipped, so the robot is still at the first one
+    sequencer.goal_finished(calls.goals[1].sequence, goal_result::aborted);
+    EXPECT_EQ(calls.missions_done, 1u);
+    sequencer.queue_mission(make_mission(1, 1));
+    ASSERT_TRUE(sequencer.start_next_mission());
+    EXPECT_DOUBLE_EQ(sequencer.mission_start().position.x, 1.0);
+
+    // Without a reached waypoint the start does not move
+    sequencer.resolve_waypoint(0, at(3.0), 0);
+    sequencer.navigate();
+    ASSERT_EQ(calls.goals.size(), 3u);
+    sequencer.goal_finished(calls.goals[2].sequence, goal_result::aborted);
+    sequencer.queue_mission(make_mission(2, 1));
+    ASSERT_TRUE(sequencer.start_next_mission());
+    EXPECT_DOUBLE_EQ(sequencer.mission_start().position.x, 1.0);
+}
+
+TEST(MissionSequencer, StaleResponsesAndResultsAreIgnored)
+{
+    recorder calls;
+    MissionSequencer sequencer(MissionSequencer::options{}, calls.hooks());
+    sequencer.queue_mission(make_mission(0, 2));
+    sequencer.start_next_mission();
+    sequencer.resolve_waypoint(0, at(1.0), 0);
+    sequencer.server_available();
+    ASSERT_EQ(calls.goals.size(), 1u);
+    size_t lost = calls.goals[0].sequence;
+
+    // The goal sent to a lost server is sent again once the server is back, the late result of the lost goal is ignored
+    sequencer.server_lost();
+    EXPECT_FALSE(sequencer.goal_response(lost, true));
+    sequencer.goal_finished(lost, goal_result::succeeded);
+    EXPECT_TRUE(calls.reached.empty());
+    EXPECT_EQ(sequencer.current_waypoint(), 0u);
+
+    sequencer.server_available();
+    ASSERT_EQ(calls.goals.size(), 2u);
+    EXPECT_NE(calls.goals[1].sequence, lost);
+
+    // A retry armed before the server was lost does not send a second goal
+    sequencer.goal_finished(calls.goals[1].sequence, goal_result::aborted);
+    ASSERT_EQ(calls.retries.size(), 1u);
+    sequencer.server_lost();
+    sequencer.retry_elapsed(-1, calls.retries[0].sequence);
+    EXPECT_EQ(calls.goals.size(), 2u);
+}
+
+TEST(MissionSequencer, HandoffSendsTheNextWaypointWithinTheRadius)
+{
+    recorder calls;
+    MissionSequencer::options opts;
+    opts.handoff_radius = 0.5;
+    MissionSequencer sequencer(opts, calls.hooks());
+    sequencer.queue_mission(make_mission(0, 2));
+    sequencer.start_next_mission();
+    sequencer.resolve_waypoint(0, at(1.0), 0);
+    sequencer.resolve_waypoint(1, at(5.0), 0);
+    sequencer.server_available();
+    sequencer.goal_response(calls.goals[0].sequence, true);
+
+    sequencer.goal_feedback(calls.goals[0].sequence, point3{0.0, 0.0, 0.0});
+    EXPECT_EQ(calls.goals.size(), 1u);
+    sequencer.goal_feedback(calls.goals[0].sequence, point3{0.7, 0.0, 0.0});
+    ASSERT_EQ(calls.goals.size(), 2u);
+    EXPECT_EQ(calls.goals[1].first, 1u);
+    EXPECT_EQ(calls.reached, (std::vector<size_t>{0}));
+
+    // The result of the preempted goal is ignored
+    sequencer.goal_finished(calls.goals[0].sequence, goal_result::canceled);
+    EXPECT_EQ(sequencer.current_waypoint(), 1u);
+}
+
+TEST(MissionSequencer, StartNextMissionKeepsThePrefetchedWaypoints)
+{
+    recorder calls;
+    MissionSequencer sequencer(MissionSequencer::options{}, calls.hooks());
+    EXPECT_TRUE(sequencer.mission_finished());
+    EXPECT_FALSE(sequencer.start_next_mission());
+
+    sequencer.queue_mission(make_mission(4, 3));
+    MissionSequencer::queued_mission *next = sequencer.next_mission();
+    ASSERT_NE(next, nullptr);
+    next->waypoints[1].pose = at(2.0);
+    next->waypoints[1].pose_assigned = true;
+
+    ASSERT_TRUE(sequencer.start_next_mission());
+    EXPECT_EQ(sequencer.marker_id(), 4);
+    EXPECT_EQ(sequencer.queued_missions(), 0u);
+    EXPECT_EQ(sequencer.resolved_waypoints(), 1u);
+    EXPECT_EQ(sequencer.bound_waypoint(type_of(1), color_of(1)), 1u);
+    EXPECT_EQ(sequencer.bound_waypoint(type_of(0), color_of(0)), MissionSequencer::no_waypoint);
+    EXPECT_FALSE(sequencer.all_waypoints_resolved());
+    EXPECT_FALSE(sequencer.mission_finished());
+}
+
+TEST(MissionSequencer, ReplaceMissionKeepsTheReachedWaypointsAndRemapsTheParts)
+{
+    recorder calls;
+    MissionSequencer sequencer(MissionSequencer::options{}, calls.hooks());
+    sequencer.queue_mission(make_mission(0, 3));
+    sequencer.start_next_mission();
+    for (size_t i = 0; i < 3; ++i)
+    {
+        sequencer.resolve_waypoint(i, at(static_cast<double>(i + 1)), 0);
+    }
+    sequencer.server_available();
+    sequencer.goal_finished(calls.goals[0].sequence, goal_result::succeeded);
+    ASSERT_EQ(calls.goals.size(), 2u);
+    EXPECT_EQ(calls.goals[1].first, 1u);
+
+    // The new mission swaps the last two parts and adds a part not resolved yet
+    std::vector<mission_waypoint> steps = {{type_of(2), color_of(2)}, {type_of(0), color_of(0)}, {type_of(1), color_of(1)},
+                                           {type_of(3), color_of(3)}};
+    size_t first_open = sequencer.replace_mission(mission{steps.data(), steps.size()});
+    EXPECT_EQ(first_open, 1u);
+    ASSERT_EQ(sequencer.waypoints().size(), 4u);
+    EXPECT_EQ(sequencer.waypoints()[0].color, color_of(0));
+    EXPECT_EQ(sequencer.waypoints()[1].color, color_of(2));
+    EXPECT_DOUBLE_EQ(sequencer.waypoints()[1].pose.position.x, 3.0);
+    EXPECT_EQ(sequencer.bound_waypoint(type_of(1), color_of(1)), 2u);
+    EXPECT_EQ(sequencer.bound_waypoint(type_of(2), color_of(2)), 1u);
+    EXPECT_EQ(sequencer.bound_waypoint(type_of(3), color_of(3)), MissionSequencer::no_waypoint);
+    EXPECT_EQ(sequencer.resolved_waypoints(), 3u);
+
+    // The goal to the waypoint that moved is canceled and the new waypoint 1 is sent
+    EXPECT_EQ(calls.cancels, (std::vector<long>{-1}));
+    sequencer.navigate();
+    ASSERT_EQ(calls.goals.size(), 3u);
+    EXPECT_EQ(calls.goals[2].first, 1u);
+}
+
+TEST(MissionSequencer, FleetAssignsEachRobotItsClosestWaypoint)
+{
+    recorder calls;
+    MissionSequencer::options opts;
+    opts.robots = {"robot_a", "robot_b"};
+    MissionSequencer sequencer(opts, calls.hooks());
+    sequencer.queue_mission(make_mission(0, 2));
+    sequencer.start_next_mission();
+    sequencer.resolve_waypoint(0, at(1.0), 0);
+    sequencer.resolve_waypoint(1, at(10.0), 0);
+    EXPECT_TRUE(sequencer.update_robot_pose(0, at(9.0)));
+    EXPECT_FALSE(sequencer.update_robot_pose(0, at(9.0)));
+    EXPECT_TRUE(sequencer.update_robot_pose(1, at(0.0)));
+    sequencer.server_available();
+
+    ASSERT_EQ(calls.fleet_goals.size(), 2u);
+    EXPECT_EQ(sequencer.robot(0).waypoint, 1);
+    EXPECT_EQ(sequencer.robot(1).waypoint, 0);
+    EXPECT_EQ(sequencer.waypoints()[1].robot, 0);
+
+    for (const auto &goal : calls.fleet_goals)
+    {
+        EXPECT_TRUE(sequencer.fleet_goal_response(goal.first, goal.second, true));
+        sequencer.fleet_goal_finished(goal.first, goal.second, goal_result::succeeded);
+    }
+    EXPECT_EQ(calls.missions_done, 1u);
+    EXPECT_TRUE(sequencer.mission_finished());
+}
+
+TEST(MissionSequencer, FleetReleasesAFailedWaypointThenSkipsIt)
+{
+    recorder calls;
+    MissionSequencer::options opts;
+    opts.robots = {"robot_a", "robot_b"};
+    opts.retry_limit = 1;
+    MissionSequencer sequencer(opts, calls.hooks());
+    sequencer.queue_mission(make_mission(0, 2));
+    sequencer.start_next_mission();
+    sequencer.resolve_waypoint(0, at(1.0), 0);
+    sequencer.resolve_waypoint(1, at(10.0), 0);
+    sequencer.update_robot_pose(0, at(0.0));
+    sequencer.update_robot_pose(1, at(11.0));
+    sequencer.server_available();
+    ASSERT_EQ(calls.fleet_goals.size(), 2u);
+    size_t sequence_a = sequencer.robot(0).sequence;
+    size_t sequence_b = sequencer.robot(1).sequence;
+
+    // Robot b reaches its waypoint, robot a fails its own: the waypoint goes to robot b and robot a waits for the backoff
+    sequencer.fleet_goal_finished(1, sequence_b, goal_result::succeeded);
+    sequencer.fleet_goal_finished(0, sequence_a, goal_result::aborted);
+    ASSERT_EQ(calls.retries.size(), 1u);
+    EXPECT_EQ(calls.retries[0].robot, 0);
+    EXPECT_EQ(sequencer.robot(0).state, MissionSequencer::goal_state::retrying);
+    ASSERT_EQ(calls.fleet_goals.size(), 3u);
+    EXPECT_EQ(calls.fleet_goals[2].first, 1u);
+    EXPECT_EQ(sequencer.robot(1).waypoint, 0);
+
+    // The second failure exceeds the limit, the waypoint is skipped and the mission finishes
+    sequencer.fleet_goal_response(1, calls.fleet_goals[2].second, false);
+    EXPECT_TRUE(sequencer.waypoints()[0].reached);
+    EXPECT_EQ(calls.missions_done, 1u);
+    EXPECT_EQ(calls.reached, (std::vector<size_t>{1}));
+
+    // The backoff of robot a elapsing after the mission has nothing left to assign
+    sequencer.retry_elapsed(0, calls.retries[0].sequence);
+    EXPECT_EQ(calls.fleet_goals.size(), 3u);
+}
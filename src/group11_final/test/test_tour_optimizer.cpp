@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "tour_optimizer.hpp"
+
+TEST(TourOptimizer, TwoWaypointsTakeTheCheaperDirection)
+{
+    // 0 -> 1 costs 5, 1 -> 0 costs 2
+    std::vector<double> costs = {0.0, 5.0, 2.0, 0.0};
+    EXPECT_EQ(TourOptimizer::optimize(costs, 2, TourOptimizer::options{}), (std::vector<size_t>{1, 0}));
+
+    // 0 -> 1 costs 2, 1 -> 0 costs 5
+    costs = {0.0, 2.0, 5.0, 0.0};
+    EXPECT_EQ(TourOptimizer::optimize(costs, 2, TourOptimizer::options{}), (std::vector<size_t>{0, 1}));
+}
+
+TEST(TourOptimizer, TwoWaypointsKeepAFixedEnd)
+{
+    std::vector<double> costs = {0.0, 5.0, 2.0, 0.0};
+    TourOptimizer::options opts;
+    opts.fixed_first = true;
+    EXPECT_EQ(TourOptimizer::optimize(costs, 2, opts), (std::vector<size_t>{0, 1}));
+}
+
+TEST(TourOptimizer, ExactAndLocalSearchFindTheLineOrder)
+{
+    // Nodes on a line, visited in a shuffled index order
+    const std::vector<double> position = {0.0, 4.0, 1.0, 3.0, 2.0, 6.0, 5.0};
+    const size_t size = position.size();
+    std::vector<double> costs(size * size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        for (size_t j = 0; j < size; ++j)
+        {
+            costs[i * size + j] = std::abs(position[i] - position[j]);
+        }
+    }
+    TourOptimizer::options opts;
+    opts.fixed_first = true;
+    for (size_t exact_limit : {size_t{12}, size_t{0}})
+    {
+        opts.exact_limit = exact_limit;
+        std::vector<size_t> order = TourOptimizer::optimize(costs, size, opts);
+        EXPECT_EQ(order.front(), 0u);
+        EXPECT_DOUBLE_EQ(TourOptimizer::path_cost(costs, size, order), 6.0);
+    }
+}